@@ -0,0 +1,66 @@
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+
+Arena &Arena::local()
+{
+  thread_local Arena arena;
+  return arena;
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment)
+{
+  while (true)
+  {
+    if (current < blocks.size())
+    {
+      auto &block = blocks[current];
+      uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+      uintptr_t aligned = (base + offset + alignment - 1) & ~(uintptr_t(alignment) - 1);
+      size_t newOffset = (aligned - base) + bytes;
+      if (newOffset <= block.size)
+      {
+        offset = newOffset;
+        return reinterpret_cast<void *>(aligned);
+      }
+
+      // Move on to the next retained block, if any
+      if (current + 1 < blocks.size() && bytes + alignment <= blocks[current + 1].size)
+      {
+        current++;
+        offset = 0;
+        continue;
+      }
+    }
+
+    // Grow geometrically so a thread converges on a handful of blocks
+    size_t lastSize = blocks.empty() ? INITIAL_BLOCK_SIZE / 2 : blocks.back().size;
+    size_t size = std::max(lastSize * 2, bytes + alignment);
+    // Any retained blocks after the current one are too small; replace them
+    while (blocks.size() > current + 1)
+    {
+      totalCapacity -= blocks.back().size;
+      blocks.pop_back();
+    }
+    blocks.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+    totalCapacity += size;
+    current = blocks.size() - 1;
+    offset = 0;
+  }
+}
+
+void Arena::rewind(Marker marker)
+{
+  current = marker.block;
+  offset = marker.offset;
+
+  // Fully idle: give back oversized growth from a pathological request
+  if (current == 0 && offset == 0 && totalCapacity > MAX_RETAINED_BYTES)
+  {
+    while (blocks.size() > 1)
+    {
+      totalCapacity -= blocks.back().size;
+      blocks.pop_back();
+    }
+  }
+}
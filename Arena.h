@@ -0,0 +1,79 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Per-thread bump allocator for request scratch containers.
+//
+// Allocation is a pointer bump inside a retained block list and deallocation
+// is a no-op; memory is reclaimed all at once when a Scope ends by rewinding
+// to the position it started at. Blocks are kept between requests, so a
+// warmed-up thread serves requests without touching the global heap.
+//
+// Scopes nest (Hybrid calls into Collaborative per candidate), and each one
+// rewinds only what was allocated inside it. Containers must therefore not
+// outlive the Scope that was active when they were created - copy results
+// into a std:: container before returning them.
+class Arena : public std::pmr::memory_resource
+{
+public:
+  struct Marker
+  {
+    size_t block;
+    size_t offset;
+  };
+
+  static constexpr size_t INITIAL_BLOCK_SIZE = 64 * 1024;
+  // Blocks beyond this are returned to the heap once the arena is idle
+  static constexpr size_t MAX_RETAINED_BYTES = 16 * 1024 * 1024;
+
+  // The calling thread's arena
+  static Arena &local();
+
+  Marker mark() const { return {current, offset}; }
+  void rewind(Marker marker);
+
+  size_t capacity() const { return totalCapacity; }
+  size_t blockCount() const { return blocks.size(); }
+
+  class Scope
+  {
+  private:
+    Arena &arena;
+    Marker marker;
+
+  public:
+    Scope() : arena(Arena::local()), marker(arena.mark()) {}
+    ~Scope() { arena.rewind(marker); }
+
+    std::pmr::memory_resource *resource() { return &arena; }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+  {
+    return this == &other;
+  }
+
+private:
+  struct Block
+  {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  std::vector<Block> blocks;
+  size_t current = 0;
+  size_t offset = 0;
+  size_t totalCapacity = 0;
+};
+
+#endif
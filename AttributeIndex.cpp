@@ -0,0 +1,51 @@
+#include "AttributeIndex.h"
+#include "MemoryAccounting.h"
+#include <algorithm>
+#include <cmath>
+
+int AttributeIndex::lengthBucket(int length)
+{
+  return std::clamp(length / LENGTH_BUCKET_MINUTES, 0, LENGTH_BUCKETS - 1);
+}
+
+int AttributeIndex::imdbBucket(float imdb)
+{
+  if (!(imdb > 0.0f))
+    return 0;
+  return std::min(static_cast<int>(std::floor(imdb / IMDB_BUCKET_WIDTH)), IMDB_BUCKETS - 1);
+}
+
+void AttributeIndex::add(size_t index, const std::vector<std::string> &genres, int length, float imdb, int rating)
+{
+  byRating[rating].set(index);
+  byLength[lengthBucket(length)].set(index);
+  byImdb[imdbBucket(imdb)].set(index);
+  for (const auto &genre : genres)
+  {
+    byGenre[genre].set(index);
+  }
+}
+
+void AttributeIndex::remove(size_t index, const std::vector<std::string> &genres, int length, float imdb, int rating)
+{
+  byRating[rating].reset(index);
+  byLength[lengthBucket(length)].reset(index);
+  byImdb[imdbBucket(imdb)].reset(index);
+  for (const auto &genre : genres)
+  {
+    byGenre[genre].reset(index);
+  }
+}
+
+const Bitset &AttributeIndex::getGenreItems(const std::string &genre) const
+{
+  static const Bitset empty;
+  auto it = byGenre.find(genre);
+  return it != byGenre.end() ? it->second : empty;
+}
+
+size_t AttributeIndex::bytes() const
+{
+  return MemoryAccounting::heapBytes(byRating) + MemoryAccounting::heapBytes(byLength) +
+         MemoryAccounting::heapBytes(byImdb) + MemoryAccounting::heapBytes(byGenre);
+}
@@ -0,0 +1,48 @@
+#ifndef ATTRIBUTEINDEX_H
+#define ATTRIBUTEINDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Bitset.h"
+
+// Bitmaps over dense item indices, one per attribute value or bucket.
+//
+// Maintained by BipartiteGraph::addItem so item filters can be answered
+// with a few word-wide ORs instead of a catalog scan. Lengths and imdb
+// scores are bucketed; filters whose bounds fall inside a bucket check the
+// exact values of that bucket's items only.
+class AttributeIndex
+{
+public:
+  static constexpr int LENGTH_BUCKET_MINUTES = 15;
+  // The last length bucket is open-ended
+  static constexpr int LENGTH_BUCKETS = 16;
+  static constexpr float IMDB_BUCKET_WIDTH = 0.5f;
+  // The last imdb bucket holds 10 and above
+  static constexpr int IMDB_BUCKETS = 20;
+
+  static int lengthBucket(int length);
+  static int imdbBucket(float imdb);
+
+  void add(size_t index, const std::vector<std::string> &genres, int length, float imdb, int rating);
+  void remove(size_t index, const std::vector<std::string> &genres, int length, float imdb, int rating);
+
+  // Age rating -> items
+  const std::unordered_map<int, Bitset> &getRatingItems() const { return byRating; }
+  const Bitset &getLengthBucketItems(int bucket) const { return byLength[bucket]; }
+  const Bitset &getImdbBucketItems(int bucket) const { return byImdb[bucket]; }
+  // Empty for unknown genres
+  const Bitset &getGenreItems(const std::string &genre) const;
+
+  // Heap bytes of the bitmaps and their maps
+  size_t bytes() const;
+
+private:
+  std::unordered_map<int, Bitset> byRating;
+  std::vector<Bitset> byLength = std::vector<Bitset>(LENGTH_BUCKETS);
+  std::vector<Bitset> byImdb = std::vector<Bitset>(IMDB_BUCKETS);
+  std::unordered_map<std::string, Bitset> byGenre;
+};
+
+#endif
@@ -1,29 +1,135 @@
 #include "BipartiteGraph.h"
+#include <algorithm>
+#include <cstdint>
 
 using namespace std;
 
+BipartiteGraph::Catalog::Catalog(const Catalog &other)
+    : items(other.items),
+      itemIndex(other.itemIndex),
+      itemIds(other.itemIds),
+      attributes(other.attributes)
+{
+  rebuildDenseItems();
+}
+
+// Re-points the dense item table at this catalog's own item storage
+void BipartiteGraph::Catalog::rebuildDenseItems()
+{
+  denseItems.clear();
+  denseItems.reserve(itemIds.size());
+  for (int id : itemIds)
+  {
+    denseItems.push_back(&items.at(id));
+  }
+}
+
+void BipartiteGraph::orderNewUser(int id)
+{
+  if (userOrder->order.empty() || user_to_items.count(id))
+    return;
+  UserOrder &order = userOrder.edit();
+  order.index[id] = static_cast<int>(order.order.size());
+  order.order.push_back(id);
+}
+
 void BipartiteGraph::addUser(int id, const std::vector<std::pair<int, float>> &ratings)
 {
+  const Catalog &items = *catalog;
+
   // Filter out ratings for non-existent movies
   std::vector<std::pair<int, float>> validRatings;
   validRatings.reserve(ratings.size());
 
   for (const auto &[movieId, rating] : ratings)
   {
-    if (items.find(movieId) != items.end())
+    if (items.items.find(movieId) != items.items.end())
     {
       validRatings.push_back({movieId, rating});
     }
   }
 
+  orderNewUser(id);
+
   // Add user_to_items edges (only for valid movies)
-  user_to_items[id] = validRatings;
+  user_to_items.set(id, validRatings);
+  version++;
+
+  // Rebuild the watched-item bitset from scratch; addUser replaces ratings
+  Bitset watched(items.itemIds.size());
+  for (const auto &[movieId, rating] : validRatings)
+  {
+    watched.set(items.itemIndex.at(movieId));
+  }
+  watchedItems.set(id, std::move(watched));
 
   // Update item_to_users for each valid movie this user rated
   for (const auto &[movieId, rating] : validRatings)
   {
-    item_to_users[movieId].push_back({id, rating});
+    item_to_users.edit(movieId).push_back({id, rating});
+  }
+}
+
+bool BipartiteGraph::addRating(int userId, int movieId, float rating)
+{
+  auto indexIt = catalog->itemIndex.find(movieId);
+  if (indexIt == catalog->itemIndex.end())
+  {
+    return false;
+  }
+
+  auto upsert = [](std::vector<std::pair<int, float>> &edges, int id, float weight)
+  {
+    for (auto &[otherId, otherWeight] : edges)
+    {
+      if (otherId == id)
+      {
+        otherWeight = weight;
+        return;
+      }
+    }
+    edges.push_back({id, weight});
+  };
+
+  version++;
+  orderNewUser(userId);
+  upsert(user_to_items.edit(userId), movieId, rating);
+  upsert(item_to_users.edit(movieId), userId, rating);
+  watchedItems.edit(userId).set(indexIt->second);
+  return true;
+}
+
+bool BipartiteGraph::removeRating(int userId, int movieId)
+{
+  auto userIt = user_to_items.find(userId);
+  if (userIt == user_to_items.end())
+  {
+    return false;
+  }
+
+  auto find = [](const std::vector<std::pair<int, float>> &edges, int id)
+  {
+    return std::find_if(edges.begin(), edges.end(),
+                        [id](const auto &edge)
+                        { return edge.first == id; });
+  };
+  auto erase = [&](std::vector<std::pair<int, float>> &edges, int id)
+  {
+    auto it = find(edges, id);
+    if (it != edges.end())
+      edges.erase(it);
+  };
+
+  // Checked on the shared list so a miss copies nothing
+  if (find(userIt->second, movieId) == userIt->second.end())
+  {
+    return false;
   }
+  erase(user_to_items.edit(userId), movieId);
+  erase(item_to_users.edit(movieId), userId);
+  watchedItems.edit(userId).reset(catalog->itemIndex.at(movieId));
+  version++;
+  return true;
 }
 
 void BipartiteGraph::addItem(int id, vector<string> genres, int length, float imdb, int rating)
@@ -34,7 +140,101 @@ void BipartiteGraph::addItem(int id, vector<string> genres, int length, float im
   item.length = length;
   item.imdb = imdb;
   item.rating = rating;
-  items[id] = item; // Store the item
+  version++;
+
+  Catalog &items = catalog.edit();
+  auto indexIt = items.itemIndex.find(id);
+  if (indexIt != items.itemIndex.end())
+  {
+    // Replacing an item: drop its old attributes from the bitmaps
+    const Item &old = items.items[id];
+    items.attributes.remove(indexIt->second, old.genres, old.length, old.imdb, old.rating);
+  }
+  items.items[id] = item; // Store the item
+
+  if (indexIt == items.itemIndex.end())
+  {
+    items.itemIndex[id] = static_cast<int>(items.itemIds.size());
+    items.itemIds.push_back(id);
+    items.denseItems.push_back(&items.items[id]);
+  }
+  items.attributes.add(items.itemIndex[id], item.genres, item.length, item.imdb, item.rating);
+}
+
+bool BipartiteGraph::applyOrdering(const std::vector<int> &users, const std::vector<int> &newItemIds)
+{
+  auto isPermutation = [](std::vector<int> ids, std::vector<int> expected)
+  {
+    std::sort(ids.begin(), ids.end());
+    std::sort(expected.begin(), expected.end());
+    return ids == expected;
+  };
+  std::vector<int> knownUsers;
+  knownUsers.reserve(user_to_items.size());
+  for (const auto &[userId, _] : user_to_items)
+  {
+    knownUsers.push_back(userId);
+  }
+  if (!isPermutation(users, knownUsers) || !isPermutation(newItemIds, catalog->itemIds))
+    return false;
+
+  Catalog &items = catalog.edit();
+  items.itemIds = newItemIds;
+  items.itemIndex.clear();
+  items.attributes = AttributeIndex();
+  for (size_t i = 0; i < items.itemIds.size(); i++)
+  {
+    items.itemIndex[items.itemIds[i]] = static_cast<int>(i);
+    const Item &item = items.items.at(items.itemIds[i]);
+    items.attributes.add(i, item.genres, item.length, item.imdb, item.rating);
+  }
+  items.rebuildDenseItems();
+
+  UserOrder &order = userOrder.edit();
+  order.order = users;
+  order.index.clear();
+  for (size_t i = 0; i < order.order.size(); i++)
+  {
+    order.index[order.order[i]] = static_cast<int>(i);
+  }
+
+  // Every list changes, so each is edited (and unshared) in turn
+  for (int userId : knownUsers)
+  {
+    auto &ratings = user_to_items.edit(userId);
+    std::sort(ratings.begin(), ratings.end(), [&](const auto &a, const auto &b)
+              { return items.itemIndex.at(a.first) < items.itemIndex.at(b.first); });
+    Bitset watched(items.itemIds.size());
+    for (const auto &[movieId, _] : ratings)
+    {
+      watched.set(items.itemIndex.at(movieId));
+    }
+    watchedItems.set(userId, std::move(watched));
+  }
+  for (int itemId : items.itemIds)
+  {
+    if (!item_to_users.count(itemId))
+      continue;
+    // Raters missing from user_to_items (replaced by addUser) sort last
+    auto position = [&](int userId)
+    {
+      auto it = order.index.find(userId);
+      return it != order.index.end() ? it->second : INT32_MAX;
+    };
+    auto &raters = item_to_users.edit(itemId);
+    std::stable_sort(raters.begin(), raters.end(), [&](const auto &a, const auto &b)
+                     { return position(a.first) < position(b.first); });
+  }
+
+  version++;
+  return true;
+}
+
+const Bitset &BipartiteGraph::getWatchedItems(int userId) const
+{
+  static const Bitset empty;
+  auto it = watchedItems.find(userId);
+  return it != watchedItems.end() ? it->second : empty;
 }
 
 std::vector<BipartiteGraph::User> BipartiteGraph::getAllUsers() const
@@ -49,7 +249,7 @@ std::vector<BipartiteGraph::User> BipartiteGraph::getAllUsers() const
     for (const auto &[movieId, weight] : items)
     {
       // Only include ratings for existing movies
-      if (this->items.find(movieId) != this->items.end())
+      if (catalog->items.count(movieId))
       {
         // Assuming weight represents rating
         user.rating.push_back({movieId, weight});
@@ -60,4 +260,97 @@ std::vector<BipartiteGraph::User> BipartiteGraph::getAllUsers() const
     allUsers.push_back(user);
   }
   return allUsers;
-}
\ No newline at end of file
+}
+
+namespace
+{
+  // FNV-1a over raw bytes
+  struct Fnv1a
+  {
+    uint64_t hash = 1469598103934665603ULL;
+
+    void add(const void *data, size_t size)
+    {
+      const unsigned char *bytes = static_cast<const unsigned char *>(data);
+      for (size_t i = 0; i < size; i++)
+      {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+      }
+    }
+
+    template <typename T>
+    void add(const T &value)
+    {
+      add(&value, sizeof(T));
+    }
+  };
+}
+
+uint64_t BipartiteGraph::fingerprint() const
+{
+  if (cachedFingerprint.version.load(std::memory_order_acquire) == version)
+    return cachedFingerprint.value.load(std::memory_order_relaxed);
+
+  Fnv1a fnv;
+
+  // Hash maps iterate in arbitrary order, so walk ids in sorted order
+  const auto &items = catalog->items;
+  std::vector<int> itemKeys;
+  itemKeys.reserve(items.size());
+  for (const auto &[id, _] : items)
+    itemKeys.push_back(id);
+  std::sort(itemKeys.begin(), itemKeys.end());
+  for (int id : itemKeys)
+  {
+    const Item &item = items.at(id);
+    fnv.add(id);
+    fnv.add(item.length);
+    fnv.add(item.imdb);
+    fnv.add(item.rating);
+    for (const auto &genre : item.genres)
+    {
+      fnv.add(genre.data(), genre.size() + 1);
+    }
+  }
+
+  std::vector<int> userKeys;
+  userKeys.reserve(user_to_items.size());
+  for (const auto &[id, _] : user_to_items)
+    userKeys.push_back(id);
+  std::sort(userKeys.begin(), userKeys.end());
+  for (int id : userKeys)
+  {
+    auto ratings = user_to_items.at(id);
+    std::sort(ratings.begin(), ratings.end());
+    fnv.add(id);
+    fnv.add(ratings.size());
+    for (const auto &[movieId, rating] : ratings)
+    {
+      fnv.add(movieId);
+      fnv.add(rating);
+    }
+  }
+
+  cachedFingerprint.value.store(fnv.hash, std::memory_order_relaxed);
+  cachedFingerprint.version.store(version, std::memory_order_release);
+  return fnv.hash;
+}
+
+void BipartiteGraph::reportMemory(MemoryAccounting::Report &report) const
+{
+  report.add("graph.user_items", user_to_items.heapBytes());
+  report.add("graph.item_users", item_to_users.heapBytes());
+  size_t itemBytes = MemoryAccounting::nodeBytes(catalog->items);
+  for (const auto &[_, item] : catalog->items)
+  {
+    itemBytes += MemoryAccounting::heapBytes(item.genres);
+  }
+  report.add("graph.items", itemBytes);
+  report.add("graph.dense_indexes",
+             MemoryAccounting::heapBytes(catalog->itemIndex) + MemoryAccounting::heapBytes(catalog->itemIds) +
+                 MemoryAccounting::heapBytes(catalog->denseItems) + MemoryAccounting::heapBytes(userOrder->order) +
+                 MemoryAccounting::heapBytes(userOrder->index));
+  report.add("graph.watched_items", watchedItems.heapBytes());
+  report.add("graph.attributes", catalog->attributes.bytes());
+}
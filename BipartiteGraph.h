@@ -1,9 +1,15 @@
 #ifndef BIPARTITEGRAPH_H
 #define BIPARTITEGRAPH_H
 
+#include <atomic>
+#include <cstdint>
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include "AttributeIndex.h"
+#include "Bitset.h"
+#include "CopyOnWrite.h"
+#include "MemoryAccounting.h"
 
 class BipartiteGraph
 {
@@ -30,33 +36,172 @@ public:
     int rating;
   };
 
+public:
+  // Rating lists by user or item id, shared with copies of the graph until
+  // either side changes them
+  using Adjacency = SharedMap<int, std::vector<std::pair<int, float>>>;
+
 private:
   // User -> [(Item, Weight)]
-  std::unordered_map<int, std::vector<std::pair<int, float>>> user_to_items;
+  Adjacency user_to_items;
   // Item -> [(User, Weight)]
-  std::unordered_map<int, std::vector<std::pair<int, float>>> item_to_users;
-  // Item storage
-  std::unordered_map<int, Item> items;
+  Adjacency item_to_users;
+
+  // Items and everything indexed by them. Rating changes leave it alone, so
+  // graphs copied for a rating batch share one catalog
+  struct Catalog
+  {
+    // Item storage
+    std::unordered_map<int, Item> items;
+
+    // Dense item indices, assigned in insertion order
+    std::unordered_map<int, int> itemIndex;
+    std::vector<int> itemIds;
+    // Index -> item; points into `items`, whose nodes never move
+    std::vector<const Item *> denseItems;
+
+    // Item attribute bitmaps over dense item indices
+    AttributeIndex attributes;
+
+    Catalog() = default;
+    // Re-points the dense item table at the copy's own items
+    Catalog(const Catalog &other);
+    Catalog &operator=(const Catalog &) = delete;
+
+    void rebuildDenseItems();
+  };
+  CopyOnWrite<Catalog> catalog;
+
+  // User -> watched items as a bitset over dense item indices
+  SharedMap<int, Bitset> watchedItems;
+
+  // Dense user positions set by applyOrdering; empty until then. Users
+  // added afterwards go at the end
+  struct UserOrder
+  {
+    std::vector<int> order;
+    std::unordered_map<int, int> index;
+  };
+  CopyOnWrite<UserOrder> userOrder;
+  // Appends a user not yet in the graph to the order, if there is one
+  void orderNewUser(int id);
+
+  // Bumped by every mutation so derived data can tell it is stale
+  uint64_t version = 0;
+
+  // fingerprint() of one version. Concurrent readers of the same version
+  // compute the same value, so a race only repeats the work. Copies start
+  // empty
+  struct CachedFingerprint
+  {
+    static constexpr uint64_t NONE = ~uint64_t(0);
+    std::atomic<uint64_t> version{NONE};
+    std::atomic<uint64_t> value{0};
+
+    CachedFingerprint() = default;
+    CachedFingerprint(const CachedFingerprint &) {}
+    CachedFingerprint &operator=(const CachedFingerprint &)
+    {
+      version.store(NONE, std::memory_order_relaxed);
+      return *this;
+    }
+  };
+  mutable CachedFingerprint cachedFingerprint;
 
 public:
+  // Copies share every list, bitset and the catalog with the original until
+  // one of the two changes them (see CopyOnWrite.h)
+  BipartiteGraph() = default;
+  BipartiteGraph(const BipartiteGraph &) = default;
+  BipartiteGraph &operator=(const BipartiteGraph &) = default;
+  BipartiteGraph(BipartiteGraph &&) = default;
+  BipartiteGraph &operator=(BipartiteGraph &&) = default;
+
   void addItem(int id, std::vector<std::string> genres, int length, float imdb, int rating);
   void addUser(int id, const std::vector<std::pair<int, float>> &ratings);
+
+  // Adds or updates a single rating in both directions. Returns false if the
+  // movie does not exist
+  bool addRating(int userId, int movieId, float rating);
+
+  // Removes a single rating from both directions. Returns false if the user
+  // had not rated the movie
+  bool removeRating(int userId, int movieId);
   std::vector<User> getAllUsers() const;
 
-  const std::unordered_map<int, std::vector<std::pair<int, float>>> &getUserItems() const
+  const Adjacency &getUserItems() const
   {
     return user_to_items;
   }
 
-  const std::unordered_map<int, std::vector<std::pair<int, float>>> &getItemUsers() const
+  const Adjacency &getItemUsers() const
   {
     return item_to_users;
   }
 
   const std::unordered_map<int, Item> &getItems() const
   {
-    return items;
+    return catalog->items;
+  }
+
+  size_t getItemCount() const
+  {
+    return catalog->itemIds.size();
+  }
+
+  // Dense index of an item, or -1 if it does not exist
+  int getItemIndex(int itemId) const
+  {
+    auto it = catalog->itemIndex.find(itemId);
+    return it != catalog->itemIndex.end() ? it->second : -1;
+  }
+
+  int getItemId(size_t index) const
+  {
+    return catalog->itemIds[index];
+  }
+
+  const Item &getItemAt(size_t index) const
+  {
+    return *catalog->denseItems[index];
   }
+
+  // Items the user has rated; empty for unknown users
+  const Bitset &getWatchedItems(int userId) const;
+
+  const AttributeIndex &getAttributeIndex() const
+  {
+    return catalog->attributes;
+  }
+
+  // Changes whenever an item, user or rating is added, replaced or removed
+  uint64_t getVersion() const
+  {
+    return version;
+  }
+
+  // Renumbers the dense item indices to follow items and fixes the dense
+  // user order to users, then sorts every adjacency list by those
+  // positions, so data touched together sits together (see GraphOrdering).
+  // External ids are unchanged. Each list must name every item or user
+  // exactly once; otherwise returns false and leaves the graph untouched
+  bool applyOrdering(const std::vector<int> &users, const std::vector<int> &items);
+
+  // Users in their dense order; empty unless applyOrdering was called, in
+  // which case engines that lay users out in arrays follow it
+  const std::vector<int> &getUserOrder() const
+  {
+    return userOrder->order;
+  }
+
+  // Order-independent hash of every item and rating, used to check that a
+  // persisted model was computed from this exact graph. Computed once per
+  // version
+  uint64_t fingerprint() const;
+
+  // Adjacency maps, items, dense indexes, watched bitsets and attributes.
+  // Storage shared with other copies is counted in each of them
+  void reportMemory(MemoryAccounting::Report &report) const;
 };
 
 #endif
\ No newline at end of file
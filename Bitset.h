@@ -0,0 +1,110 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <cstdint>
+#include <vector>
+
+// Growable packed bitset over dense item indices.
+//
+// With the catalog sizes this project targets (hundreds to tens of thousands
+// of items) a plain word array is both smaller and faster than a hash set:
+// membership is one shift and mask, and scans walk 64 items per word.
+class Bitset
+{
+private:
+  std::vector<uint64_t> words;
+
+public:
+  Bitset() = default;
+  explicit Bitset(size_t bits) : words((bits + 63) / 64, 0) {}
+
+  size_t wordCount() const { return words.size(); }
+  const std::vector<uint64_t> &getWords() const { return words; }
+
+  void set(size_t index)
+  {
+    if (index / 64 >= words.size())
+      words.resize(index / 64 + 1, 0);
+    words[index / 64] |= uint64_t(1) << (index % 64);
+  }
+
+  void reset(size_t index)
+  {
+    if (index / 64 < words.size())
+      words[index / 64] &= ~(uint64_t(1) << (index % 64));
+  }
+
+  // Bits past the stored words read as clear
+  bool test(size_t index) const
+  {
+    return index / 64 < words.size() && (words[index / 64] >> (index % 64)) & 1;
+  }
+
+  void clear() { words.clear(); }
+
+  Bitset &operator|=(const Bitset &other)
+  {
+    if (other.words.size() > words.size())
+      words.resize(other.words.size(), 0);
+    for (size_t w = 0; w < other.words.size(); w++)
+      words[w] |= other.words[w];
+    return *this;
+  }
+
+  // Sets every bit below limit that is clear in other
+  void orNot(const Bitset &other, size_t limit)
+  {
+    size_t needed = (limit + 63) / 64;
+    if (needed > words.size())
+      words.resize(needed, 0);
+    for (size_t w = 0; w < needed; w++)
+    {
+      uint64_t bits = ~(w < other.words.size() ? other.words[w] : 0);
+      if ((w + 1) * 64 > limit)
+        bits &= (uint64_t(1) << (limit % 64)) - 1;
+      words[w] |= bits;
+    }
+  }
+
+  size_t count() const
+  {
+    size_t total = 0;
+    for (uint64_t w : words)
+      total += __builtin_popcountll(w);
+    return total;
+  }
+
+  // Calls fn(index) for every clear bit below limit, one word at a time
+  template <typename Fn>
+  void forEachClear(size_t limit, Fn &&fn) const
+  {
+    for (size_t w = 0; w * 64 < limit; w++)
+    {
+      uint64_t bits = ~(w < words.size() ? words[w] : 0);
+      if ((w + 1) * 64 > limit)
+        bits &= (uint64_t(1) << (limit % 64)) - 1;
+      while (bits)
+      {
+        fn(w * 64 + __builtin_ctzll(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  // Calls fn(index) for every set bit
+  template <typename Fn>
+  void forEachSet(Fn &&fn) const
+  {
+    for (size_t w = 0; w < words.size(); w++)
+    {
+      uint64_t bits = words[w];
+      while (bits)
+      {
+        fn(w * 64 + __builtin_ctzll(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+};
+
+#endif
@@ -1,5 +1,11 @@
 #include "Collabrative.h"
 #include "Utils.h"
+#include "Metrics.h"
+#include "MemoryAccounting.h"
+#include "Trace.h"
+#include "Arena.h"
+#include "DenseSimilarity.h"
+#include "NeighborSpill.h"
 #include <algorithm>
 #include <cmath>
 #include <thread>
@@ -16,11 +22,15 @@ uint64_t Collaborative::createPairKey(int id1, int id2) const
 // Implements least-frequently-used cache eviction policy
 void Collaborative::evictCache() const
 {
+  Metrics::increment(Metrics::COLLAB_CACHE_EVICTIONS);
+
   // Create vector of pairs (key, access count)
+  // Pairs shared from the previous version and not read since count as 0
   std::vector<std::pair<uint64_t, int>> cacheStats;
-  for (const auto &[key, count] : cacheAccessCount)
+  for (const auto &[key, _] : similarityCache)
   {
-    cacheStats.push_back({key, count});
+    auto it = cacheAccessCount.find(key);
+    cacheStats.push_back({key, it != cacheAccessCount.end() ? it->second : 0});
   }
 
   // Sort by access count (least accessed first)
@@ -28,14 +38,36 @@ void Collaborative::evictCache() const
             [](const auto &a, const auto &b)
             { return a.second < b.second; });
 
-  // Remove least accessed entries until we're under the limit
-  size_t numToRemove = similarityCache.size() - MAX_CACHE_SIZE / 2; // Remove half
+  // Remove least accessed entries until all caches are down to half the budget
+  size_t entryBytes = std::max<size_t>(1, cacheBytes() / std::max<size_t>(1, similarityCache.size()));
+  size_t keep = cacheCharge.evictionTarget() / entryBytes;
+  size_t numToRemove = similarityCache.size() > keep ? similarityCache.size() - keep : 0;
   for (size_t i = 0; i < numToRemove && i < cacheStats.size(); i++)
   {
     uint64_t key = cacheStats[i].first;
     similarityCache.erase(key);
     cacheAccessCount.erase(key);
   }
+  // Erasing leaves the bucket arrays at their peak size. The shared map
+  // cannot shrink its shards, but an emptied one can drop them
+  if (similarityCache.empty())
+    similarityCache.clear();
+  cacheAccessCount.rehash(0);
+  cacheCharge.set(cacheBytes());
+}
+
+size_t Collaborative::cacheBytes() const
+{
+  return similarityCache.heapBytes() + MemoryAccounting::nodeBytes(cacheAccessCount);
+}
+
+void Collaborative::enforceCacheBudget() const
+{
+  cacheCharge.set(cacheBytes());
+  if (cacheCharge.overBudget())
+  {
+    evictCache();
+  }
 }
 
 // Calculates cosine similarity between two users based on their movie ratings
@@ -106,6 +138,14 @@ float Collaborative::calculateSimilarity(int user1Id, int user2Id) const
 // Pre-computes similarities between all users using multiple threads
 void Collaborative::preComputeSimilarities(int numThreads)
 {
+  TRACE_SPAN("Collaborative::preComputeSimilarities");
+  if (similarityKernel == DENSE ||
+      (similarityKernel == AUTO && DenseSimilarity::suitable(graph)))
+  {
+    preComputeDense(numThreads);
+    return;
+  }
+
   const auto &users = graph.getUserItems();
 
   // Create a list of all user pairs to compute
@@ -121,9 +161,237 @@ void Collaborative::preComputeSimilarities(int numThreads)
     }
   }
 
+  computePairSimilarities(userPairs, numThreads);
+}
+
+void Collaborative::preComputeDense(int numThreads)
+{
+  auto lists = DenseSimilarity::topKNeighbors(graph, NEIGHBORS_PER_USER, numThreads);
+
+  // Only the top-K pairs are kept, rescored in double precision so they
+  // match the sparse path and later incremental updates exactly
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  for (const auto &[userId, neighbors] : lists)
+  {
+    for (const auto &[otherId, _] : neighbors)
+    {
+      uint64_t key = createPairKey(userId, otherId);
+      if (similarityCache.count(key))
+        continue;
+      similarityCache.set(key, calculateSimilarity(userId, otherId));
+      cacheAccessCount[key] = 1;
+    }
+  }
+
+  rebuildNeighborLists();
+  rebuildUserNorms();
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
+
+  enforceCacheBudget();
+}
+
+size_t Collaborative::preComputeSimilaritiesApprox(const MinHashLsh::Options &options, int numThreads)
+{
+  TRACE_SPAN("Collaborative::preComputeSimilaritiesApprox");
+  auto candidates = MinHashLsh(options).candidatePairs(graph, numThreads);
+  computePairSimilarities(candidates, numThreads);
+  return candidates.size();
+}
+
+bool Collaborative::preComputeSimilaritiesExternal(const ExternalOptions &options, int numThreads)
+{
+  TRACE_SPAN("Collaborative::preComputeSimilaritiesExternal");
+  numThreads = std::max(1, numThreads);
+
+  // Rows read the norms of every other user
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    rebuildUserNorms();
+  }
+
+  std::vector<int> users;
+  if (graph.getUserOrder().empty())
+  {
+    for (const auto &[userId, _] : graph.getUserItems())
+    {
+      users.push_back(userId);
+    }
+    std::sort(users.begin(), users.end());
+  }
+  else
+  {
+    users = graph.getUserOrder();
+  }
+
+  auto byScore = [](const auto &a, const auto &b)
+  { return a.second > b.second || (a.second == b.second && a.first < b.first); };
+
+  NeighborSpill spill(options.spillDirectory, options.memoryBudget);
+  size_t tileUsers = std::max<size_t>(1, options.tileUsers);
+
+  // Candidate tile: the ratings of tileUsers users, inverted into item ->
+  // (position in tile, rating), with their norms
+  std::unordered_map<int, std::vector<std::pair<uint32_t, float>>> postings;
+  std::vector<double> columnNorms;
+  std::vector<std::vector<std::pair<int, float>>> rows;
+  for (size_t columnBegin = 0; columnBegin < users.size(); columnBegin += tileUsers)
+  {
+    size_t columnEnd = std::min(columnBegin + tileUsers, users.size());
+    postings.clear();
+    columnNorms.clear();
+    for (size_t c = columnBegin; c < columnEnd; c++)
+    {
+      auto normIt = userNorms.find(users[c]);
+      columnNorms.push_back(normIt != userNorms.end() ? normIt->second : 0.0);
+      auto userIt = graph.getUserItems().find(users[c]);
+      if (userIt == graph.getUserItems().end())
+        continue;
+      for (const auto &[movieId, rating] : userIt->second)
+      {
+        postings[movieId].push_back({static_cast<uint32_t>(c - columnBegin), rating});
+      }
+    }
+
+    // Each query tile's partial rows cover only this tile's candidates;
+    // their top K are spilled and the merge combines them per user
+    for (size_t tileBegin = 0; tileBegin < users.size(); tileBegin += tileUsers)
+    {
+      size_t tileEnd = std::min(tileBegin + tileUsers, users.size());
+      rows.assign(tileEnd - tileBegin, {});
+
+      auto processRows = [&](size_t start)
+      {
+        TRACE_THREAD_NAME("Collaborative worker");
+        std::vector<double> dots(columnEnd - columnBegin, 0.0);
+        std::vector<uint32_t> touched;
+        for (size_t i = tileBegin + start; i < tileEnd; i += numThreads)
+        {
+          int userId = users[i];
+          auto userIt = graph.getUserItems().find(userId);
+          if (userIt == graph.getUserItems().end())
+            continue;
+
+          // Accumulated in the user's item order, as computeUserRow does,
+          // so the similarities match the in-memory paths exactly
+          double norm = 0.0;
+          touched.clear();
+          for (const auto &[movieId, rating] : userIt->second)
+          {
+            norm += rating * rating;
+            auto postingIt = postings.find(movieId);
+            if (postingIt == postings.end())
+              continue;
+            for (const auto &[position, otherRating] : postingIt->second)
+            {
+              if (users[columnBegin + position] == userId)
+                continue;
+              if (dots[position] == 0.0)
+                touched.push_back(position);
+              dots[position] += rating * otherRating;
+            }
+          }
+
+          auto &row = rows[i - tileBegin];
+          for (uint32_t position : touched)
+          {
+            double dot = dots[position];
+            dots[position] = 0.0;
+            double otherNorm = columnNorms[position];
+            if (norm > 0.0 && otherNorm > 0.0)
+            {
+              float similarity = static_cast<float>(dot / (std::sqrt(norm) * std::sqrt(otherNorm)));
+              if (similarity > 0)
+                row.push_back({users[columnBegin + position], similarity});
+            }
+          }
+          size_t keep = std::min(row.size(), NEIGHBORS_PER_USER);
+          std::partial_sort(row.begin(), row.begin() + keep, row.end(), byScore);
+          row.resize(keep);
+        }
+      };
+
+      std::vector<std::thread> threads;
+      for (int t = 1; t < numThreads; t++)
+      {
+        threads.emplace_back(processRows, static_cast<size_t>(t));
+      }
+      processRows(0);
+      for (auto &thread : threads)
+      {
+        thread.join();
+      }
+
+      for (size_t i = tileBegin; i < tileEnd; i++)
+      {
+        if (!rows[i - tileBegin].empty() && !spill.add(users[i], rows[i - tileBegin]))
+          return false;
+      }
+    }
+  }
+  std::vector<std::vector<std::pair<int, float>>>().swap(rows);
+  decltype(postings)().swap(postings);
+
+  // Merged lists go straight into a new neighbor map, swapped in only once
+  // every run was read back
+  NeighborMap lists;
+  bool merged = spill.merge(NEIGHBORS_PER_USER, [&](int userId, std::vector<std::pair<int, float>> &neighbors)
+                            { lists.set(userId, std::move(neighbors)); });
+  if (!merged)
+    return false;
+
+  storeNeighborLists(std::move(lists));
+  return true;
+}
+
+bool Collaborative::preComputeSimilaritiesSharded(const ShardedPrecompute::Options &options)
+{
+  TRACE_SPAN("Collaborative::preComputeSimilaritiesSharded");
+  NeighborMap lists;
+  bool merged = ShardedPrecompute::run(graph, options, NEIGHBORS_PER_USER,
+                                       [&](int userId, std::vector<std::pair<int, float>> &neighbors)
+                                       { lists.set(userId, std::move(neighbors)); });
+  if (!merged)
+    return false;
+
+  storeNeighborLists(std::move(lists));
+  return true;
+}
+
+void Collaborative::storeNeighborLists(NeighborMap lists)
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  for (const auto &[userId, neighbors] : lists)
+  {
+    for (const auto &[otherId, similarity] : neighbors)
+    {
+      uint64_t key = createPairKey(userId, otherId);
+      if (similarityCache.count(key))
+        continue;
+      similarityCache.set(key, similarity);
+      cacheAccessCount[key] = 1;
+    }
+  }
+
+  // Exact top-K lists are symmetric in their pairs, so they are already
+  // what rebuilding from the cache would produce
+  neighborLists = std::move(lists);
+  neighborListsBuilt = true;
+  packNeighborLists();
+  rebuildUserNorms();
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
+
+  enforceCacheBudget();
+}
+
+void Collaborative::computePairSimilarities(const std::vector<std::pair<int, int>> &userPairs, int numThreads)
+{
+  numThreads = std::max(1, numThreads);
+
   // Function to process a chunk of pairs
   auto processPairs = [this](const std::vector<std::pair<int, int>> &pairs, size_t start, size_t end)
   {
+    TRACE_THREAD_NAME("Collaborative worker");
+    TRACE_SPAN("Collaborative::preCompute chunk");
     for (size_t i = start; i < end && i < pairs.size(); i++)
     {
       const auto &[user1Id, user2Id] = pairs[i];
@@ -132,8 +400,8 @@ void Collaborative::preComputeSimilarities(int numThreads)
       if (similarity > 0)
       {
         uint64_t key = createPairKey(user1Id, user2Id);
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        similarityCache[key] = similarity;
+        TRACE_LOCK(lock, cacheMutex, "Collaborative::cacheMutex wait");
+        similarityCache.set(key, similarity);
         cacheAccessCount[key] = 1;
       }
     }
@@ -159,192 +427,566 @@ void Collaborative::preComputeSimilarities(int numThreads)
     thread.join();
   }
 
+  std::lock_guard<std::mutex> lock(cacheMutex);
+
+  // Capture the top-K lists and norms while every scored pair is still cached
+  rebuildNeighborLists();
+  rebuildUserNorms();
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
+
   // Evict cache if necessary
-  if (similarityCache.size() > MAX_CACHE_SIZE)
+  enforceCacheBudget();
+}
+
+void Collaborative::rebuildNeighborLists()
+{
+  std::unordered_map<int, std::vector<std::pair<int, float>>> lists;
+  for (const auto &[key, similarity] : similarityCache)
   {
-    evictCache();
+    int id1 = static_cast<int>(key >> 32);
+    int id2 = static_cast<int>(key & 0xFFFFFFFF);
+    lists[id1].push_back({id2, similarity});
+    lists[id2].push_back({id1, similarity});
   }
+
+  auto byScore = [](const auto &a, const auto &b)
+  { return a.second > b.second || (a.second == b.second && a.first < b.first); };
+  neighborLists.clear();
+  for (auto &[userId, list] : lists)
+  {
+    size_t keep = std::min(list.size(), NEIGHBORS_PER_USER);
+    std::partial_sort(list.begin(), list.begin() + keep, list.end(), byScore);
+    list.resize(keep);
+    list.shrink_to_fit();
+    neighborLists.set(userId, std::move(list));
+  }
+  neighborListsBuilt = true;
+  packNeighborLists();
 }
 
-// Retrieves cached similarity between two users
-float Collaborative::getCachedSimilarity(int userId1, int userId2) const
+void Collaborative::setNeighborPrecision(NeighborPrecision precision)
 {
-  if (userId1 == userId2)
-    return 1.0f;
-
-  uint64_t key = createPairKey(userId1, userId2);
   std::lock_guard<std::mutex> lock(cacheMutex);
+  unpackNeighborLists();
+  neighborPrecision = precision;
+  packNeighborLists();
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
+}
 
-  auto it = similarityCache.find(key);
-  if (it != similarityCache.end())
+void Collaborative::packNeighborLists()
+{
+  if (neighborPrecision == FLOAT32 || !neighborListsBuilt)
+    return;
+  QuantizedNeighbors::Lists lists;
+  for (const auto &[userId, list] : neighborLists)
+    lists.emplace(userId, list);
+  packedNeighbors = CopyOnWrite<QuantizedNeighbors>(QuantizedNeighbors::build(
+      lists, neighborPrecision == INT8 ? QuantizedNeighbors::INT8 : QuantizedNeighbors::INT16));
+  neighborLists.clear();
+}
+
+void Collaborative::unpackNeighborLists()
+{
+  if (packedNeighbors->empty())
+    return;
+  for (auto &[userId, list] : packedNeighbors->expand())
   {
-    cacheAccessCount[key]++;
-    return it->second;
+    if (!neighborLists.count(userId))
+      neighborLists.set(userId, std::move(list));
   }
+  packedNeighbors = CopyOnWrite<QuantizedNeighbors>();
+}
 
-  return 0.0f; // Not found in cache
+void Collaborative::foldNeighborOverlay()
+{
+  if (neighborPrecision == FLOAT32 || neighborLists.empty())
+    return;
+  QuantizedNeighbors::Lists changed;
+  for (const auto &[userId, list] : neighborLists)
+    changed.emplace(userId, list);
+  if (packedNeighbors->empty())
+    packedNeighbors = CopyOnWrite<QuantizedNeighbors>(QuantizedNeighbors::build(
+        changed, neighborPrecision == INT8 ? QuantizedNeighbors::INT8 : QuantizedNeighbors::INT16));
+  else
+    packedNeighbors = CopyOnWrite<QuantizedNeighbors>(packedNeighbors->merge(changed));
+  neighborLists.clear();
+}
+
+std::vector<std::pair<int, float>> Collaborative::neighborsOf(int userId) const
+{
+  auto it = neighborLists.find(userId);
+  if (it != neighborLists.end())
+    return it->second;
+  return packedNeighbors->get(userId);
 }
 
-std::vector<std::pair<int, float>> Collaborative::getInfluentialRecommendations(
-    const std::unordered_set<int> &userMovies, size_t n) const
+void Collaborative::rebuildUserNorms()
 {
+  userNorms.clear();
+  for (const auto &[userId, ratings] : graph.getUserItems())
+  {
+    double norm = 0.0;
+    for (const auto &[_, rating] : ratings)
+      norm += rating * rating;
+    userNorms.set(userId, norm);
+  }
+}
 
+std::vector<std::pair<int, float>> Collaborative::computeUserRow(int userId) const
+{
   const auto &users = graph.getUserItems();
-  const auto &items = graph.getItems();
+  const auto &itemUsers = graph.getItemUsers();
+  auto userIt = users.find(userId);
+  if (userIt == users.end())
+    return {};
 
-  // Get users sorted by PageRank
-  std::vector<std::pair<int, double>> usersByRank;
-  for (const auto &[userId, _] : users)
+  // Sparse dot products with everyone who shares a movie
+  std::unordered_map<int, double> dots;
+  double norm = 0.0;
+  for (const auto &[movieId, rating] : userIt->second)
   {
-    double rank = pageRank.getPageRank(userId);
-    if (rank >= MIN_PAGERANK_SCORE)
+    norm += rating * rating;
+    auto postingIt = itemUsers.find(movieId);
+    if (postingIt == itemUsers.end())
+      continue;
+    for (const auto &[otherId, otherRating] : postingIt->second)
     {
-      usersByRank.push_back({userId, rank});
+      if (otherId != userId)
+        dots[otherId] += rating * otherRating;
     }
   }
 
-  // Sort by PageRank score descending
-  std::sort(usersByRank.begin(), usersByRank.end(),
-            [](const auto &a, const auto &b)
-            { return a.second > b.second; });
+  std::vector<std::pair<int, float>> row;
+  row.reserve(dots.size());
+  for (const auto &[otherId, dot] : dots)
+  {
+    auto normIt = userNorms.find(otherId);
+    double otherNorm = normIt != userNorms.end() ? normIt->second : 0.0;
+    if (norm > 0.0 && otherNorm > 0.0)
+    {
+      float similarity = static_cast<float>(dot / (std::sqrt(norm) * std::sqrt(otherNorm)));
+      if (similarity > 0)
+        row.push_back({otherId, similarity});
+    }
+  }
+  return row;
+}
 
-  // If we don't have enough influential users, return empty
-  if (usersByRank.size() < MIN_INFLUENTIAL_USERS)
+bool Collaborative::updateNeighborEntry(int userId, int otherId, float similarity,
+                                        const std::unordered_map<int, std::vector<int>> &batch)
+{
+  // Most lists a batch visits do not change; leave those shared, and
+  // packed ones packed
+  std::vector<std::pair<int, float>> packed;
+  const std::vector<std::pair<int, float>> *current = &packed;
+  auto changedIt = neighborLists.find(userId);
+  if (changedIt != neighborLists.end())
   {
-    return {};
+    current = &changedIt->second;
   }
+  else
+  {
+    // Exact values, so the checks below see the true floor and folding the
+    // list back in does not quantize its old entries twice. otherId's pair
+    // already has its new value. Pairs the cache has evicted are
+    // recomputed, unless the neighbor is in the batch: the graph already
+    // holds its new ratings, and its own visit must see the old value
+    packed = packedNeighbors->get(userId);
+    for (auto &[neighborId, value] : packed)
+    {
+      if (neighborId == otherId)
+        continue;
+      auto cached = similarityCache.find(createPairKey(userId, neighborId));
+      if (cached != similarityCache.end())
+        value = cached->second;
+      else if (!batch.count(neighborId))
+        value = calculateSimilarity(userId, neighborId);
+    }
+    // Entries that shared a code may no longer be in order
+    std::sort(packed.begin(), packed.end(),
+              [](const auto &a, const auto &b)
+              { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+  }
+
+  if (std::none_of(current->begin(), current->end(),
+                   [otherId](const auto &entry)
+                   { return entry.first == otherId; }))
+  {
+    bool enters = similarity > 0 &&
+                  (current->size() < NEIGHBORS_PER_USER || similarity > current->back().second);
+    if (!enters)
+      return true;
+  }
+
+  if (changedIt == neighborLists.end() && !packed.empty())
+    neighborLists.set(userId, std::move(packed));
+  auto &list = neighborLists.edit(userId);
+  bool wasFull = list.size() >= NEIGHBORS_PER_USER;
+  float previousFloor = list.empty() ? 0.0f : list.back().second;
+
+  auto it = std::find_if(list.begin(), list.end(),
+                         [otherId](const auto &entry)
+                         { return entry.first == otherId; });
+  bool wasMember = it != list.end();
+  if (wasMember)
+    list.erase(it);
+
+  // Users outside a full list score at most its previous floor, so a member
+  // that fell below the floor may have been overtaken by one of them
+  if (wasMember && wasFull && similarity < previousFloor)
+    return false;
+
+  if (similarity > 0 && (list.size() < NEIGHBORS_PER_USER || similarity > list.back().second))
+  {
+    auto pos = std::find_if(list.begin(), list.end(),
+                            [similarity, otherId](const auto &entry)
+                            { return similarity > entry.second ||
+                                     (similarity == entry.second && otherId < entry.first); });
+    list.insert(pos, {otherId, similarity});
+    if (list.size() > NEIGHBORS_PER_USER)
+      list.pop_back();
+  }
+  return true;
+}
+
+void Collaborative::refreshNeighborList(int userId)
+{
+  auto row = computeUserRow(userId);
+  size_t keep = std::min(row.size(), NEIGHBORS_PER_USER);
+  std::partial_sort(row.begin(), row.begin() + keep, row.end(),
+                    [](const auto &a, const auto &b)
+                    { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+  row.resize(keep);
+  neighborLists.set(userId, std::move(row));
+}
+
+void Collaborative::onRatingAdded(int userId, int movieId, float rating)
+{
+  // The rating itself is already in the graph, which the update reads
+  (void)rating;
+  onRatingsChanged({{userId, movieId}});
+}
 
-  // Collect weighted recommendations from influential users
-  std::unordered_map<int, std::pair<float, float>> weightedRecs; // {movieId: {weighted_sum, weight_sum}}
+void Collaborative::onRatingRemoved(int userId, int movieId)
+{
+  onRatingsChanged({{userId, movieId}});
+}
+
+void Collaborative::onRatingsChanged(const std::vector<std::pair<int, int>> &changes)
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  const auto &users = graph.getUserItems();
+  const auto &itemUsers = graph.getItemUsers();
 
-  for (const auto &[userId, rank] : usersByRank)
+  // Group the batch so each user's row is recomputed once
+  std::unordered_map<int, std::vector<int>> moviesByUser;
+  for (const auto &[userId, movieId] : changes)
   {
+    moviesByUser[userId].push_back(movieId);
+  }
+
+  // Update every changed norm first so rows below see consistent values
+  for (const auto &[userId, _] : moviesByUser)
+  {
+    double norm = 0.0;
     auto userIt = users.find(userId);
-    if (userIt == users.end())
-      continue; // Skip if user not found
+    if (userIt != users.end())
+    {
+      for (const auto &[_, r] : userIt->second)
+        norm += r * r;
+    }
+    userNorms.set(userId, norm);
+  }
 
-    const auto &userRatings = userIt->second;
-    float weight = static_cast<float>(rank);
+  std::unordered_set<int> stale;
+  for (const auto &[userId, movieIds] : moviesByUser)
+  {
+    // The norm change moves every similarity of this user, but only users
+    // who share a movie can have a non-zero one: recompute that row exactly
+    auto row = computeUserRow(userId);
+    std::unordered_map<int, float> rowLookup(row.begin(), row.end());
 
-    for (const auto &[movieId, rating] : userRatings)
+    // Users who shared a changed movie, or were neighbors, may have dropped
+    // to zero; visit them too so their cache pairs and lists are cleared
+    for (int movieId : movieIds)
     {
-      // Skip movies that don't exist or user has already rated
-      if (items.find(movieId) == items.end() || userMovies.count(movieId) > 0)
-      {
+      auto postingIt = itemUsers.find(movieId);
+      if (postingIt == itemUsers.end())
         continue;
+      for (const auto &[otherId, _] : postingIt->second)
+      {
+        if (otherId != userId)
+          rowLookup.emplace(otherId, 0.0f);
       }
-      weightedRecs[movieId].first += rating * weight;
-      weightedRecs[movieId].second += weight;
     }
-  }
+    if (neighborListsBuilt)
+    {
+      for (const auto &[otherId, _] : neighborsOf(userId))
+        rowLookup.emplace(otherId, 0.0f);
+    }
 
-  // Convert to recommendations
-  std::vector<std::pair<int, float>> recommendations;
-  for (const auto &[movieId, weights] : weightedRecs)
-  {
-    if (weights.second > 0)
+    for (const auto &[otherId, similarity] : rowLookup)
     {
-      float score = weights.first / weights.second;
-      // Blend with movie quality
-      auto movieIt = items.find(movieId);
-      if (movieIt != items.end())
+      uint64_t key = createPairKey(userId, otherId);
+      if (similarity > 0)
       {
-        score = 0.7f * score + 0.3f * movieIt->second.imdb;
+        auto cached = similarityCache.find(key);
+        if (cached == similarityCache.end() || cached->second != similarity)
+          similarityCache.set(key, similarity);
+        cacheAccessCount.emplace(key, 1);
       }
-      recommendations.push_back({movieId, score});
+      else
+      {
+        similarityCache.erase(key);
+        cacheAccessCount.erase(key);
+      }
+
+      if (neighborListsBuilt && !updateNeighborEntry(otherId, userId, similarity, moviesByUser))
+        stale.insert(otherId);
     }
   }
 
-  // Sort by score
-  std::sort(recommendations.begin(), recommendations.end(),
-            [](const auto &a, const auto &b)
-            { return a.second > b.second; });
+  if (neighborListsBuilt)
+  {
+    for (const auto &[userId, _] : moviesByUser)
+      stale.insert(userId);
+    for (int userId : stale)
+      refreshNeighborList(userId);
+    if (neighborLists.size() > OVERLAY_FRACTION * packedNeighbors->userCount())
+      foldNeighborOverlay();
+  }
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
 
-  // Return top N
-  if (recommendations.size() > n)
+  enforceCacheBudget();
+}
+
+std::vector<std::pair<int, float>> Collaborative::getNeighbors(int userId) const
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return neighborsOf(userId);
+}
+
+// Retrieves cached similarity between two users
+float Collaborative::getCachedSimilarity(int userId1, int userId2) const
+{
+  if (userId1 == userId2)
+    return 1.0f;
+
+  uint64_t key = createPairKey(userId1, userId2);
+  TRACE_LOCK(lock, cacheMutex, "Collaborative::cacheMutex wait");
+
+  auto it = similarityCache.find(key);
+  if (it != similarityCache.end())
   {
-    recommendations.resize(n);
+    cacheAccessCount[key]++;
+    Metrics::increment(Metrics::COLLAB_SIMILARITY_HIT);
+    return it->second;
   }
 
-  return recommendations;
+  Metrics::increment(Metrics::COLLAB_SIMILARITY_MISS);
+  return 0.0f; // Not found in cache
 }
 
-std::vector<std::pair<int, float>> Collaborative::getRecommendations(int userId, size_t n) const
+std::shared_ptr<const Collaborative::PopularityLists> Collaborative::buildPopularityLists() const
 {
+  TRACE_SPAN("Collaborative::buildPopularityLists");
+  Metrics::increment(Metrics::POPULARITY_LIST_BUILDS);
+  auto lists = std::make_shared<PopularityLists>();
   const auto &users = graph.getUserItems();
-  const auto &items = graph.getItems();
-  auto userIt = users.find(userId);
 
-  // Get user's current movies
-  std::unordered_set<int> userMovies;
-  if (userIt != users.end())
+  // Ranks first, so the version recorded is the one the lists use
+  pageRank.getRanks();
+  lists->graphVersion = graph.getVersion();
+  lists->rankVersion = pageRank.getVersion();
+
+  auto byScore = [](const auto &a, const auto &b)
+  { return a.second > b.second || (a.second == b.second && a.first < b.first); };
+
+  // Get users sorted by PageRank
+  std::vector<std::pair<int, double>> usersByRank;
+  for (const auto &[userId, _] : users)
   {
-    for (const auto &[movieId, _] : userIt->second)
+    double rank = pageRank.getPageRank(userId);
+    if (rank >= MIN_PAGERANK_SCORE)
     {
-      if (items.find(movieId) != items.end())
-      { // Only include existing movies
-        userMovies.insert(movieId);
-      }
+      usersByRank.push_back({userId, rank});
     }
   }
 
-  // Handle new users or users with no ratings
-  if (userIt == users.end() || userIt->second.empty())
+  // Only rank by influence with enough influential users
+  if (usersByRank.size() >= MIN_INFLUENTIAL_USERS)
   {
-    auto recommendations = getInfluentialRecommendations(userMovies, n);
-    if (!recommendations.empty())
+    // Collect weighted ratings from influential users
+    std::unordered_map<int, std::pair<float, float>> weightedRecs; // {movieId: {weighted_sum, weight_sum}}
+    for (const auto &[userId, rank] : usersByRank)
     {
-      return recommendations;
+      float weight = static_cast<float>(rank);
+      for (const auto &[movieId, rating] : users.at(userId))
+      {
+        if (graph.getItemIndex(movieId) < 0)
+          continue;
+        weightedRecs[movieId].first += rating * weight;
+        weightedRecs[movieId].second += weight;
+      }
     }
 
-    // Fall back to movie quality
-    recommendations.reserve(items.size());
-    for (const auto &[movieId, item] : items)
+    for (const auto &[movieId, weights] : weightedRecs)
     {
-      if (userMovies.count(movieId) == 0)
+      if (weights.second > 0)
       {
-        recommendations.push_back({movieId, item.imdb});
+        float score = weights.first / weights.second;
+        // Blend with movie quality
+        score = 0.7f * score + 0.3f * graph.getItemAt(graph.getItemIndex(movieId)).imdb;
+        lists->influential.push_back({movieId, score});
       }
     }
+    std::sort(lists->influential.begin(), lists->influential.end(), byScore);
+  }
 
-    std::sort(recommendations.begin(), recommendations.end(),
-              [](const auto &a, const auto &b)
-              { return a.second > b.second; });
+  lists->byQuality.reserve(graph.getItemCount());
+  for (size_t index = 0; index < graph.getItemCount(); index++)
+  {
+    lists->byQuality.push_back({graph.getItemId(index), graph.getItemAt(index).imdb});
+  }
+  std::sort(lists->byQuality.begin(), lists->byQuality.end(), byScore);
+
+  return lists;
+}
+
+std::shared_ptr<const Collaborative::PopularityLists> Collaborative::getPopularityLists() const
+{
+  auto isCurrent = [this](const std::shared_ptr<const PopularityLists> &lists)
+  {
+    return lists && lists->graphVersion == graph.getVersion() &&
+           lists->rankVersion == pageRank.getVersion();
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (isCurrent(popularityLists))
+      return popularityLists;
+  }
 
-    if (recommendations.size() > n)
+  // Built outside the lock; a concurrent builder produces the same lists
+  auto lists = buildPopularityLists();
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  if (!isCurrent(popularityLists))
+    popularityLists = lists;
+  return popularityLists;
+}
+
+void Collaborative::preComputePopularity() const
+{
+  getPopularityLists();
+}
+
+std::vector<std::pair<int, float>> Collaborative::getPopularRecommendations(const Bitset &watched, size_t n) const
+{
+  auto lists = getPopularityLists();
+
+  auto topUnwatched = [&](const std::vector<std::pair<int, float>> &ranked)
+  {
+    std::vector<std::pair<int, float>> recommendations;
+    for (const auto &entry : ranked)
     {
-      recommendations.resize(n);
+      if (recommendations.size() >= n)
+        break;
+      if (!watched.test(graph.getItemIndex(entry.first)))
+        recommendations.push_back(entry);
     }
     return recommendations;
+  };
+
+  auto recommendations = topUnwatched(lists->influential);
+  if (!recommendations.empty())
+  {
+    return recommendations;
   }
 
-  // Calculate weighted scores for all unwatched movies
-  std::unordered_map<int, std::pair<float, float>> weightedScores; // movieId -> {score_sum, weight_sum}
+  // Fall back to movie quality
+  return topUnwatched(lists->byQuality);
+}
+
+std::vector<std::pair<int, float>> Collaborative::getRecommendations(int userId, size_t n) const
+{
+  return recommend(userId, n, graph.getWatchedItems(userId));
+}
 
-  // Find similar users
-  std::vector<std::pair<int, float>> similarUsers;
-  for (const auto &[otherId, _] : users)
+std::vector<std::pair<int, float>> Collaborative::getRecommendations(int userId, size_t n, const ItemFilter &filter) const
+{
+  return recommend(userId, n, filter.excludedItems(graph, graph.getWatchedItems(userId)));
+}
+
+std::vector<std::pair<int, float>> Collaborative::recommend(int userId, size_t n, const Bitset &excluded) const
+{
+  Metrics::increment(Metrics::COLLAB_REQUESTS);
+  Metrics::ScopedTimer timer(Metrics::COLLAB_REQUEST_NS);
+  TRACE_SPAN("Collaborative::getRecommendations");
+  Arena::Scope scratch;
+
+  const auto &users = graph.getUserItems();
+  auto userIt = users.find(userId);
+
+  // Handle new users or users with no ratings
+  if (userIt == users.end() || userIt->second.empty())
   {
-    if (otherId == userId)
-      continue;
+    return getPopularRecommendations(excluded, n);
+  }
 
-    float similarity = getCachedSimilarity(userId, otherId);
-    if (similarity > 0)
+  // Calculate weighted scores for all unwatched movies
+  std::pmr::unordered_map<int, std::pair<float, float>> weightedScores(scratch.resource()); // movieId -> {score_sum, weight_sum}
+
+  // Find similar users: the precomputed top-K list when available,
+  // otherwise a scan of the pair cache
+  std::pmr::vector<std::pair<int, float>> similarUsers(scratch.resource());
+  bool fromNeighborList = false;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (neighborListsBuilt)
+    {
+      auto listIt = neighborLists.find(userId);
+      int list = listIt == neighborLists.end() ? packedNeighbors->find(userId) : -1;
+      if (listIt != neighborLists.end())
+      {
+        similarUsers.assign(listIt->second.begin(), listIt->second.end());
+      }
+      else if (list >= 0)
+      {
+        std::pmr::vector<float> similarities(packedNeighbors->size(list), scratch.resource());
+        packedNeighbors->similarities(list, similarities.data());
+        const int32_t *ids = packedNeighbors->ids(list);
+        for (size_t i = 0; i < similarities.size(); i++)
+          similarUsers.push_back({ids[i], similarities[i]});
+      }
+      fromNeighborList = true;
+    }
+  }
+  if (!fromNeighborList)
+  {
+    for (const auto &[otherId, _] : users)
     {
-      similarUsers.push_back({otherId, similarity});
+      if (otherId == userId)
+        continue;
+
+      float similarity = getCachedSimilarity(userId, otherId);
+      if (similarity > 0)
+      {
+        similarUsers.push_back({otherId, similarity});
+      }
     }
   }
 
+  Metrics::record(Metrics::COLLAB_NEIGHBOR_CANDIDATES, similarUsers.size());
+
   // Sort by similarity
   std::sort(similarUsers.begin(), similarUsers.end(),
             [](const auto &a, const auto &b)
             { return a.second > b.second; });
 
   // Take top K similar users
-  const size_t K = 10;
-  if (similarUsers.size() > K)
+  if (similarUsers.size() > NEIGHBORS_PER_USER)
   {
-    similarUsers.resize(K);
+    similarUsers.resize(NEIGHBORS_PER_USER);
   }
 
   // Get recommendations from similar users
@@ -358,7 +1000,8 @@ std::vector<std::pair<int, float>> Collaborative::getRecommendations(int userId,
 
     for (const auto &[movieId, rating] : otherIt->second)
     {
-      if (items.find(movieId) == items.end() || userMovies.count(movieId) > 0)
+      int index = graph.getItemIndex(movieId);
+      if (index < 0 || excluded.test(index))
       {
         continue;
       }
@@ -368,18 +1011,14 @@ std::vector<std::pair<int, float>> Collaborative::getRecommendations(int userId,
   }
 
   // Convert weighted scores to recommendations
-  std::vector<std::pair<int, float>> recommendations;
+  std::pmr::vector<std::pair<int, float>> recommendations(scratch.resource());
   for (const auto &[movieId, weights] : weightedScores)
   {
     if (weights.second > 0)
     {
       float score = weights.first / weights.second;
       // Blend with movie quality
-      auto movieIt = items.find(movieId);
-      if (movieIt != items.end())
-      {
-        score = 0.8f * score + 0.2f * movieIt->second.imdb;
-      }
+      score = 0.8f * score + 0.2f * graph.getItemAt(graph.getItemIndex(movieId)).imdb;
       recommendations.push_back({movieId, score});
     }
   }
@@ -394,5 +1033,93 @@ std::vector<std::pair<int, float>> Collaborative::getRecommendations(int userId,
     recommendations.resize(n);
   }
 
-  return recommendations;
+  return {recommendations.begin(), recommendations.end()};
+}
+
+ModelSnapshot::NeighborLists Collaborative::getNeighborLists() const
+{
+  ModelSnapshot::NeighborLists lists;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (neighborListsBuilt)
+    {
+      if (!packedNeighbors->empty())
+        lists = packedNeighbors->expand();
+      for (const auto &[userId, list] : neighborLists)
+        lists[userId] = list;
+      return lists;
+    }
+    for (const auto &[key, similarity] : similarityCache)
+    {
+      int id1 = static_cast<int>(key >> 32);
+      int id2 = static_cast<int>(key & 0xFFFFFFFF);
+      lists[id1].push_back({id2, similarity});
+      lists[id2].push_back({id1, similarity});
+    }
+  }
+
+  for (auto &[_, list] : lists)
+  {
+    std::sort(list.begin(), list.end(),
+              [](const auto &a, const auto &b)
+              { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+  }
+  return lists;
+}
+
+Collaborative::Collaborative(const BipartiteGraph &bg, const PageRank &pr, const Collaborative &previous)
+    : graph(bg), pageRank(pr)
+{
+  // Access counts start over with this instance's reads
+  std::lock_guard<std::mutex> lock(previous.cacheMutex);
+  similarityCache = previous.similarityCache;
+  neighborLists = previous.neighborLists;
+  neighborListsBuilt = previous.neighborListsBuilt;
+  neighborPrecision = previous.neighborPrecision;
+  packedNeighbors = previous.packedNeighbors;
+  userNorms = previous.userNorms;
+  modelVersion.store(previous.getModelVersion(), std::memory_order_relaxed);
+  previous.cacheCharge.transferTo(cacheCharge);
+}
+
+bool Collaborative::loadSimilarities(const ModelSnapshot &snapshot)
+{
+  if (!snapshot.matches(graph))
+  {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  similarityCache.clear();
+  cacheAccessCount.clear();
+  snapshot.forEachUserList([this](int id, const ModelSnapshot::NeighborEntry *neighbors, size_t count)
+                      {
+    for (size_t i = 0; i < count; i++)
+    {
+      uint64_t key = createPairKey(id, neighbors[i].id);
+      similarityCache.set(key, neighbors[i].similarity);
+      cacheAccessCount[key] = 1;
+    } });
+
+  rebuildNeighborLists();
+  rebuildUserNorms();
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
+
+  enforceCacheBudget();
+  return true;
+}
+
+void Collaborative::reportMemory(MemoryAccounting::Report &report) const
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  report.add("collaborative.similarity_cache", cacheBytes());
+  report.add("collaborative.neighbor_lists", neighborLists.heapBytes() + packedNeighbors->bytes());
+  report.add("collaborative.user_norms", userNorms.heapBytes());
+  size_t popularityBytes = 0;
+  if (popularityLists)
+  {
+    popularityBytes = MemoryAccounting::heapBytes(popularityLists->influential) +
+                      MemoryAccounting::heapBytes(popularityLists->byQuality);
+  }
+  report.add("collaborative.popularity_lists", popularityBytes);
 }
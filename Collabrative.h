@@ -4,28 +4,63 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory_resource>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include "BipartiteGraph.h"
+#include "CopyOnWrite.h"
+#include "ItemFilter.h"
+#include "MinHashLsh.h"
+#include "MemoryAccounting.h"
+#include "ModelSnapshot.h"
 #include "PageRank.h"
+#include "QuantizedNeighbors.h"
+#include "ShardedPrecompute.h"
 
 class Collaborative
 {
+public:
+  // How preComputeSimilarities scores all user pairs: sparse co-rating
+  // accumulation, or the dense kernel (DenseSimilarity). AUTO picks dense
+  // whenever the catalog is small enough
+  enum SimilarityKernel
+  {
+    AUTO,
+    SPARSE,
+    DENSE
+  };
+
+  // How the top-K neighbor lists are held: as float lists, or packed into
+  // 16- or 8-bit codes (QuantizedNeighbors)
+  enum NeighborPrecision
+  {
+    FLOAT32,
+    INT16,
+    INT8
+  };
+
 private:
   const BipartiteGraph &graph;
   const PageRank &pageRank;
 
-  // Cache for storing similarity scores between user pairs
-  mutable std::unordered_map<uint64_t, float> similarityCache;
+  // Cache for storing similarity scores between user pairs. Shared with
+  // instances copied from this one until either side writes a pair
+  mutable SharedMap<uint64_t, float> similarityCache;
 
-  // Tracks how many times each cached similarity has been accessed
+  // Tracks how many times each cached similarity has been accessed by this
+  // instance; pairs without a count rank as never accessed
   mutable std::unordered_map<uint64_t, int> cacheAccessCount;
+  mutable MemoryAccounting::Charge cacheCharge{MemoryAccounting::COLLAB_SIMILARITY_CACHE};
 
   // Mutex to ensure thread-safe access to cache structures
   mutable std::mutex cacheMutex;
 
-  // Maximum number of user pairs to keep in similarity cache
-  const size_t MAX_CACHE_SIZE = 10000;
+  // Bumped each time the similarities or neighbor lists are recomputed,
+  // loaded or updated
+  std::atomic<uint64_t> modelVersion{0};
 
   // Minimum number of influential users needed for PageRank-based recommendations
   const size_t MIN_INFLUENTIAL_USERS = 5;
@@ -33,29 +68,199 @@ private:
   // Minimum PageRank score to be considered influential
   const double MIN_PAGERANK_SCORE = 0.01;
 
+  // Number of most similar users kept per user and used for recommendations
+  static constexpr size_t NEIGHBORS_PER_USER = 10;
+
+  // Top-K most similar users per user, most similar first. Built by
+  // preComputeSimilarities before cache eviction, so it stays exact even
+  // when the pair cache has been trimmed. Guarded by cacheMutex
+  using NeighborMap = SharedMap<int, std::vector<std::pair<int, float>>>;
+  NeighborMap neighborLists;
+  bool neighborListsBuilt = false;
+
+  // With a quantized precision, built lists live here and neighborLists
+  // only holds the float lists of users changed since, which take
+  // precedence. Those are folded in once they exceed OVERLAY_FRACTION of
+  // the packed users, or replaced by the next full rebuild. Guarded by
+  // cacheMutex
+  static constexpr double OVERLAY_FRACTION = 0.125;
+  NeighborPrecision neighborPrecision = FLOAT32;
+  CopyOnWrite<QuantizedNeighbors> packedNeighbors;
+
+  // Packs neighborLists, which must hold every list
+  void packNeighborLists();
+  void unpackNeighborLists();
+  // Re-encodes only the changed users' lists into the packed ones
+  void foldNeighborOverlay();
+  // The user's current list, changed or packed
+  std::vector<std::pair<int, float>> neighborsOf(int userId) const;
+
+  // Squared rating norm per user, kept for incremental updates
+  SharedMap<int, double> userNorms;
+
   // Helper methods
   uint64_t createPairKey(int id1, int id2) const;
   void evictCache() const;
+  // Resident bytes of the pair cache and its access counts, charged to
+  // the COLLAB_SIMILARITY_CACHE budget
+  size_t cacheBytes() const;
+  // Updates the charge and evicts if all caches together are over budget.
+  // Caller holds cacheMutex
+  void enforceCacheBudget() const;
+
+  SimilarityKernel similarityKernel = AUTO;
 
-  // New helper method for getting recommendations from influential users
-  std::vector<std::pair<int, float>> getInfluentialRecommendations(
-      const std::unordered_set<int> &userMovies, size_t n) const;
+  // Dense path of preComputeSimilarities: top-K lists straight from the
+  // blocked kernel, without scoring every pair into the cache
+  void preComputeDense(int numThreads);
+
+  // Installs externally computed exact top-K lists as the neighbor lists,
+  // adds their pairs to the cache and rebuilds the norms
+  void storeNeighborLists(NeighborMap lists);
+
+  // Scores the given pairs in parallel into the cache, then rebuilds the
+  // top-K lists and norms from it
+  void computePairSimilarities(const std::vector<std::pair<int, int>> &userPairs, int numThreads);
+
+  // Rebuilds the top-K lists from every pair currently in the cache
+  void rebuildNeighborLists();
+  void rebuildUserNorms();
+
+  // Exact similarity of a user to every user sharing at least one movie,
+  // accumulated over the item posting lists
+  std::vector<std::pair<int, float>> computeUserRow(int userId) const;
+
+  // Sets other's similarity in user's top-K list. Returns false if the list
+  // may now be missing a better neighbor and must be recomputed. batch
+  // holds the users whose ratings the current update changed
+  bool updateNeighborEntry(int userId, int otherId, float similarity,
+                           const std::unordered_map<int, std::vector<int>> &batch);
+  void refreshNeighborList(int userId);
+
+  // Every movie ranked for users without history: by the ratings of
+  // high-PageRank users (empty if there are too few of them) and by movie
+  // quality. Built once per graph and PageRank version and served as-is;
+  // cold-start requests only skip the few items they exclude. Guarded by
+  // cacheMutex
+  struct PopularityLists
+  {
+    uint64_t graphVersion;
+    uint64_t rankVersion;
+    std::vector<std::pair<int, float>> influential;
+    std::vector<std::pair<int, float>> byQuality;
+  };
+  mutable std::shared_ptr<const PopularityLists> popularityLists;
+
+  std::shared_ptr<const PopularityLists> getPopularityLists() const;
+  std::shared_ptr<const PopularityLists> buildPopularityLists() const;
+
+  // Recommendations among the items not in excluded
+  std::vector<std::pair<int, float>> recommend(int userId, size_t n, const Bitset &excluded) const;
 
 public:
   explicit Collaborative(const BipartiteGraph &bg, const PageRank &pr)
       : graph(bg), pageRank(pr) {}
 
+  // Starts from another instance's similarities (e.g. the previous model
+  // version) over a new graph; bring it up to date by passing the ratings
+  // that differ to onRatingsChanged. The caches, lists and norms are
+  // shared, and only the parts the update writes are copied
+  Collaborative(const BipartiteGraph &bg, const PageRank &pr, const Collaborative &previous);
+
+  const PageRank &getPageRank() const { return pageRank; }
+
+  // Changes whenever the neighbors recommendations are drawn from may have
+  uint64_t getModelVersion() const { return modelVersion.load(std::memory_order_acquire); }
+
   // Calculates similarity between two users using cosine similarity
   float calculateSimilarity(int user1Id, int user2Id) const;
 
   // Pre-computes similarities between all user pairs in parallel
   void preComputeSimilarities(int numThreads = std::thread::hardware_concurrency());
 
+  void setSimilarityKernel(SimilarityKernel kernel) { similarityKernel = kernel; }
+
+  // Applies to lists already built and every later rebuild
+  void setNeighborPrecision(NeighborPrecision precision);
+
+  // Approximate alternative for large user counts: exact cosine is computed
+  // only for the candidate pairs MinHash LSH buckets together, so neighbor
+  // lists may miss true neighbors whose rated-item sets overlap little.
+  // Returns the number of pairs scored
+  size_t preComputeSimilaritiesApprox(const MinHashLsh::Options &options,
+                                      int numThreads = std::thread::hardware_concurrency());
+
+  struct ExternalOptions
+  {
+    // Where sorted run files go; they are removed before returning
+    std::string spillDirectory = "/tmp";
+    // Bytes of neighbor entries buffered before a run is written, and the
+    // read buffer shared by all runs during the merge
+    size_t memoryBudget = 64u << 20;
+    // Users per tile, both the users scored together and the candidate
+    // neighbors they are scored against
+    size_t tileUsers = 1024;
+  };
+
+  // Exact alternative for graphs whose candidate lists do not fit in memory:
+  // users are scored a tile at a time against one tile of candidates at a
+  // time, so only partial rows of tileUsers entries are ever held. Each
+  // partial row's top K is spilled to sorted run files (NeighborSpill), and
+  // the merge combines a user's partial lists into the neighbor lists
+  // directly. Returns false, leaving the model unchanged, if the run files
+  // could not be written or read
+  bool preComputeSimilaritiesExternal(const ExternalOptions &options,
+                                      int numThreads = std::thread::hardware_concurrency());
+
+  // Same exact lists, with the rows scored by separate worker processes
+  // over a shared mapping of the graph (ShardedPrecompute). Returns false,
+  // leaving the model unchanged, if a worker or file operation failed
+  bool preComputeSimilaritiesSharded(const ShardedPrecompute::Options &options);
+
   // Retrieves cached similarity between two users
   float getCachedSimilarity(int userId1, int userId2) const;
 
   // Get top N recommendations for a user
   std::vector<std::pair<int, float>> getRecommendations(int userId, size_t n = 5) const;
+
+  // Only items passing the filter are considered
+  std::vector<std::pair<int, float>> getRecommendations(int userId, size_t n, const ItemFilter &filter) const;
+
+  // Top N unwatched movies from the precomputed popularity lists: what
+  // influential users rate highly, or failing that the best-rated movies.
+  // Independent of the user's similarities, so cheap enough for fallbacks
+  std::vector<std::pair<int, float>> getPopularRecommendations(const Bitset &watched, size_t n) const;
+
+  // Builds the popularity lists now rather than on the first cold-start
+  // request
+  void preComputePopularity() const;
+
+  // Incrementally folds a new or changed rating into the model. The caller
+  // applies it to the graph first (BipartiteGraph::addRating). Only users
+  // who rated the same movies are touched
+  void onRatingAdded(int userId, int movieId, float rating);
+
+  // Same for a rating already removed with BipartiteGraph::removeRating
+  void onRatingRemoved(int userId, int movieId);
+
+  // Batched form of the above: (userId, movieId) pairs already applied to
+  // the graph. Each affected user's row is recomputed once per batch
+  void onRatingsChanged(const std::vector<std::pair<int, int>> &changes);
+
+  // The user's precomputed nearest neighbors, most similar first
+  std::vector<std::pair<int, float>> getNeighbors(int userId) const;
+
+  // Per-user neighbor lists (the top-K lists once built, otherwise the
+  // cached similarities grouped per user), most similar first
+  ModelSnapshot::NeighborLists getNeighborLists() const;
+
+  // Fills the similarity cache from a snapshot instead of recomputing it.
+  // Returns false, leaving the cache untouched, if the snapshot was built
+  // from a different graph
+  bool loadSimilarities(const ModelSnapshot &snapshot);
+
+  // Pair cache, neighbor lists, norms and popularity lists
+  void reportMemory(MemoryAccounting::Report &report) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "CompressedAdjacency.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+  inline int byteLength(uint32_t value)
+  {
+    if (value < (1u << 8))
+      return 1;
+    if (value < (1u << 16))
+      return 2;
+    if (value < (1u << 24))
+      return 3;
+    return 4;
+  }
+}
+
+uint8_t CompressedAdjacency::quantizeRating(float rating)
+{
+  float q = std::round(rating / RATING_STEP);
+  return static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, q)));
+}
+
+void CompressedAdjacency::Direction::addRow(int key, std::vector<std::pair<int, float>> row)
+{
+  std::sort(row.begin(), row.end(),
+            [](const auto &a, const auto &b)
+            { return a.first < b.first; });
+
+  rowIndex[key] = static_cast<uint32_t>(byteOffsets.size());
+  keys.push_back(key);
+  byteOffsets.push_back(encoded.size());
+  edgeOffsets.push_back(edgeOffsets.back() + row.size());
+  edges += row.size();
+
+  // Control bytes for the whole row come first, then the value bytes
+  size_t controlStart = encoded.size();
+  size_t controlBytes = (row.size() + 3) / 4;
+  encoded.resize(encoded.size() + controlBytes, 0);
+
+  uint32_t previous = 0;
+  for (size_t i = 0; i < row.size(); i++)
+  {
+    uint32_t id = static_cast<uint32_t>(row[i].first);
+    uint32_t delta = id - previous;
+    previous = id;
+
+    int len = byteLength(delta);
+    encoded[controlStart + i / 4] |= static_cast<uint8_t>((len - 1) << ((i % 4) * 2));
+    for (int b = 0; b < len; b++)
+    {
+      encoded.push_back(static_cast<uint8_t>(delta >> (8 * b)));
+    }
+    ratings.push_back(quantizeRating(row[i].second));
+  }
+}
+
+CompressedAdjacency::Cursor CompressedAdjacency::Direction::cursor(int key) const
+{
+  auto it = rowIndex.find(key);
+  if (it == rowIndex.end())
+    return Cursor();
+
+  uint32_t row = it->second;
+  const uint8_t *control = encoded.data() + byteOffsets[row];
+  const uint8_t *data = control + (count(row) + 3) / 4;
+  return Cursor(control, data, ratings.data() + edgeOffsets[row], count(row));
+}
+
+size_t CompressedAdjacency::Direction::degree(int key) const
+{
+  auto it = rowIndex.find(key);
+  return it != rowIndex.end() ? count(it->second) : 0;
+}
+
+void CompressedAdjacency::Direction::finish()
+{
+  std::sort(keys.begin(), keys.end());
+  keys.shrink_to_fit();
+  byteOffsets.shrink_to_fit();
+  edgeOffsets.shrink_to_fit();
+  encoded.shrink_to_fit();
+  ratings.shrink_to_fit();
+}
+
+size_t CompressedAdjacency::Direction::bytes() const
+{
+  return encoded.capacity() + ratings.capacity() + keys.capacity() * sizeof(int) +
+         byteOffsets.capacity() * sizeof(uint64_t) +
+         edgeOffsets.capacity() * sizeof(uint64_t) +
+         rowIndex.size() * (sizeof(std::pair<const int, uint32_t>) + 2 * sizeof(void *));
+}
+
+CompressedAdjacency CompressedAdjacency::fromGraph(const BipartiteGraph &graph)
+{
+  CompressedAdjacency adjacency;
+  for (const auto &[userId, ratings] : graph.getUserItems())
+  {
+    adjacency.users.addRow(userId, ratings);
+  }
+  for (const auto &[itemId, ratings] : graph.getItemUsers())
+  {
+    adjacency.items.addRow(itemId, ratings);
+  }
+  adjacency.users.finish();
+  adjacency.items.finish();
+  return adjacency;
+}
+
+void CompressedAdjacency::Builder::add(int userId, int itemId, float rating)
+{
+  edges.push_back({userId, itemId, quantizeRating(rating)});
+}
+
+CompressedAdjacency CompressedAdjacency::Builder::build()
+{
+  TRACE_SPAN("CompressedAdjacency::Builder::build");
+  CompressedAdjacency adjacency;
+
+  // One direction at a time: sort by its key, then encode each run. The
+  // stable sort keeps repeated edges in insertion order, so the last wins
+  auto encode = [&](Direction &direction, auto key, auto neighbor)
+  {
+    std::stable_sort(edges.begin(), edges.end(), [&](const Edge &a, const Edge &b)
+                     { return key(a) < key(b) || (key(a) == key(b) && neighbor(a) < neighbor(b)); });
+    std::vector<std::pair<int, float>> row;
+    for (size_t begin = 0; begin < edges.size();)
+    {
+      size_t end = begin;
+      row.clear();
+      for (; end < edges.size() && key(edges[end]) == key(edges[begin]); end++)
+      {
+        float rating = dequantizeRating(edges[end].rating);
+        if (!row.empty() && row.back().first == neighbor(edges[end]))
+          row.back().second = rating;
+        else
+          row.push_back({neighbor(edges[end]), rating});
+      }
+      direction.addRow(key(edges[begin]), row);
+      begin = end;
+    }
+    direction.finish();
+  };
+  auto user = [](const Edge &edge)
+  { return edge.userId; };
+  auto item = [](const Edge &edge)
+  { return edge.itemId; };
+  encode(adjacency.users, user, item);
+  encode(adjacency.items, item, user);
+
+  edges.clear();
+  edges.shrink_to_fit();
+  return adjacency;
+}
+
+CompressedAdjacency CompressedAdjacency::loadRatings(const std::string &path)
+{
+  std::ifstream file(path);
+  std::string line;
+  Builder builder;
+
+  // Skip header
+  if (!std::getline(file, line))
+    return CompressedAdjacency();
+
+  while (std::getline(file, line))
+  {
+    std::istringstream ss(line);
+    int userId, movieId;
+    float rating;
+    char comma1, comma2;
+    if (ss >> userId >> comma1 >> movieId >> comma2 >> rating && comma1 == ',' && comma2 == ',')
+      builder.add(userId, movieId, rating);
+  }
+  return builder.build();
+}
+
+// Decodes the next group of up to four deltas from one control byte
+void CompressedAdjacency::Cursor::refill()
+{
+  uint8_t key = *control++;
+  uint32_t group = std::min<uint32_t>(4, remaining);
+  for (uint32_t i = 0; i < group; i++)
+  {
+    int len = ((key >> (i * 2)) & 3) + 1;
+    uint32_t delta = 0;
+    for (int b = 0; b < len; b++)
+    {
+      delta |= static_cast<uint32_t>(data[b]) << (8 * b);
+    }
+    data += len;
+    previous += delta;
+    buffer[i] = previous;
+  }
+  buffered = group;
+  bufferPos = 0;
+}
+
+bool CompressedAdjacency::Cursor::next(int &id, float &rating)
+{
+  if (bufferPos == buffered)
+  {
+    if (remaining == 0)
+      return false;
+    refill();
+    remaining -= buffered;
+  }
+  id = static_cast<int>(buffer[bufferPos++]);
+  rating = dequantizeRating(*ratings++);
+  return true;
+}
@@ -0,0 +1,133 @@
+#ifndef COMPRESSEDADJACENCY_H
+#define COMPRESSEDADJACENCY_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "BipartiteGraph.h"
+
+// Read-only compressed copy of the graph's rating lists.
+//
+// Each row (a user's items, or an item's users) is sorted by neighbor id and
+// stored as Stream VByte encoded deltas: one control byte holds the 1-4 byte
+// lengths of four values, followed by the value bytes. Keeping control and
+// data bytes in separate runs is what lets the format be decoded with byte
+// shuffles; the decoder below is the portable scalar version. Ratings are
+// quantized to one byte in RATING_STEP increments, which is lossless for
+// ratings given to one decimal place.
+//
+// A typical edge costs 1-2 bytes of id plus 1 byte of rating, against 8 bytes
+// (twice, plus container overhead) in BipartiteGraph. A Builder fed straight
+// from a ratings file never materializes the uncompressed graph, and
+// ShardedPrecompute computes user neighbors from the compressed rows.
+class CompressedAdjacency
+{
+public:
+  static constexpr float RATING_STEP = 0.1f;
+
+  static uint8_t quantizeRating(float rating);
+  static float dequantizeRating(uint8_t q) { return q * RATING_STEP; }
+
+  // Decodes one row in order; obtained from begin()
+  class Cursor
+  {
+  private:
+    const uint8_t *control = nullptr;
+    const uint8_t *data = nullptr;
+    const uint8_t *ratings = nullptr;
+    uint32_t remaining = 0;
+    uint32_t previous = 0;
+    uint32_t buffered = 0;
+    uint32_t bufferPos = 0;
+    uint32_t buffer[4];
+
+    void refill();
+
+  public:
+    Cursor() = default;
+    Cursor(const uint8_t *control, const uint8_t *data, const uint8_t *ratings, uint32_t count)
+        : control(control), data(data), ratings(ratings), remaining(count) {}
+
+    bool next(int &id, float &rating);
+  };
+
+  // Collects edges in any order and encodes them. Holds 12 bytes per edge
+  // until build(); a repeated (user, item) edge keeps its last rating
+  class Builder
+  {
+  private:
+    struct Edge
+    {
+      int32_t userId;
+      int32_t itemId;
+      uint8_t rating;
+    };
+    std::vector<Edge> edges;
+
+  public:
+    void add(int userId, int itemId, float rating);
+    size_t size() const { return edges.size(); }
+
+    // Encodes the collected edges and empties the builder
+    CompressedAdjacency build();
+  };
+
+  CompressedAdjacency() = default;
+
+  // Encodes both directions of the graph
+  static CompressedAdjacency fromGraph(const BipartiteGraph &graph);
+
+  // Reads a userId,movieId,rating[,...] CSV with a header line, as
+  // loadRatings does, without building a BipartiteGraph. Unparsable lines
+  // are skipped; returns an empty adjacency if the file cannot be read
+  static CompressedAdjacency loadRatings(const std::string &path);
+
+  // Rows keyed by user id (items they rated) or item id (users who rated it)
+  Cursor userItems(int userId) const { return users.cursor(userId); }
+  Cursor itemUsers(int itemId) const { return items.cursor(itemId); }
+
+  size_t userDegree(int userId) const { return users.degree(userId); }
+  size_t itemDegree(int itemId) const { return items.degree(itemId); }
+
+  size_t edgeCount() const { return users.edges; }
+
+  // Row keys in ascending order
+  const std::vector<int> &getUserIds() const { return users.keys; }
+  const std::vector<int> &getItemIds() const { return items.keys; }
+
+  // Bytes held by the encoded lists and their indexes
+  size_t bytes() const { return users.bytes() + items.bytes(); }
+
+private:
+  struct Direction
+  {
+    std::unordered_map<int, uint32_t> rowIndex;
+    // Every row's key, ascending once finish() has run
+    std::vector<int> keys;
+    // Per row: byte offset of its control run and first edge; the extra
+    // trailing edge offset gives every row's count as a difference
+    std::vector<uint64_t> byteOffsets;
+    std::vector<uint64_t> edgeOffsets{0};
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> ratings;
+    size_t edges = 0;
+
+    uint32_t count(uint32_t row) const
+    {
+      return static_cast<uint32_t>(edgeOffsets[row + 1] - edgeOffsets[row]);
+    }
+
+    void addRow(int key, std::vector<std::pair<int, float>> row);
+    // Sorts keys and releases spare capacity once every row is added
+    void finish();
+    Cursor cursor(int key) const;
+    size_t degree(int key) const;
+    size_t bytes() const;
+  };
+
+  Direction users;
+  Direction items;
+};
+
+#endif
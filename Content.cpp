@@ -1,5 +1,9 @@
 #include "Content.h"
 #include "Utils.h"
+#include "Metrics.h"
+#include "MemoryAccounting.h"
+#include "Trace.h"
+#include "Arena.h"
 #include <algorithm>
 #include <cmath>
 #include <thread>
@@ -14,11 +18,15 @@ uint64_t Content::createPairKey(int id1, int id2) const
 
 void Content::evictCache() const
 {
+  Metrics::increment(Metrics::CONTENT_CACHE_EVICTIONS);
+
   // Create vector of pairs (key, access count)
   std::vector<std::pair<uint64_t, int>> cacheStats;
-  for (const auto &[key, count] : cacheAccessCount)
+  // Pairs shared from the previous version and not read since count as 0
+  for (const auto &[key, _] : *similarityCache)
   {
-    cacheStats.push_back({key, count});
+    auto it = cacheAccessCount.find(key);
+    cacheStats.push_back({key, it != cacheAccessCount.end() ? it->second : 0});
   }
 
   // Sort by access count (least accessed first)
@@ -26,14 +34,35 @@ void Content::evictCache() const
             [](const auto &a, const auto &b)
             { return a.second < b.second; });
 
-  // Remove least accessed entries until we're under the limit
-  size_t numToRemove = similarityCache.size() - MAX_CACHE_SIZE / 2; // Remove half
+  // Remove least accessed entries until all caches are down to half the budget
+  auto &cache = similarityCache.edit();
+  size_t entryBytes = std::max<size_t>(1, cacheBytes() / std::max<size_t>(1, cache.size()));
+  size_t keep = cacheCharge.evictionTarget() / entryBytes;
+  size_t numToRemove = cache.size() > keep ? cache.size() - keep : 0;
   for (size_t i = 0; i < numToRemove && i < cacheStats.size(); i++)
   {
     uint64_t key = cacheStats[i].first;
-    similarityCache.erase(key);
+    cache.erase(key);
     cacheAccessCount.erase(key);
   }
+  // Erasing leaves the bucket arrays at their peak size
+  cache.rehash(0);
+  cacheAccessCount.rehash(0);
+  cacheCharge.set(cacheBytes());
+}
+
+size_t Content::cacheBytes() const
+{
+  return MemoryAccounting::nodeBytes(*similarityCache) + MemoryAccounting::nodeBytes(cacheAccessCount);
+}
+
+void Content::enforceCacheBudget() const
+{
+  cacheCharge.set(cacheBytes());
+  if (cacheCharge.overBudget())
+  {
+    evictCache();
+  }
 }
 
 float Content::calculateSimilarity(int item1Id, int item2Id) const
@@ -102,6 +131,7 @@ float Content::calculateSimilarity(int item1Id, int item2Id) const
 
 void Content::preComputeSimilarities(int numThreads)
 {
+  TRACE_SPAN("Content::preComputeSimilarities");
   const auto &items = graph.getItems();
 
   // Create a list of all item pairs to compute
@@ -120,6 +150,8 @@ void Content::preComputeSimilarities(int numThreads)
   // Function to process a chunk of pairs
   auto processPairs = [this](const std::vector<std::pair<int, int>> &pairs, size_t start, size_t end)
   {
+    TRACE_THREAD_NAME("Content worker");
+    TRACE_SPAN("Content::preCompute chunk");
     for (size_t i = start; i < end && i < pairs.size(); i++)
     {
       const auto &[item1Id, item2Id] = pairs[i];
@@ -128,8 +160,8 @@ void Content::preComputeSimilarities(int numThreads)
       if (similarity > 0)
       {
         uint64_t key = createPairKey(item1Id, item2Id);
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        similarityCache[key] = similarity;
+        TRACE_LOCK(lock, cacheMutex, "Content::cacheMutex wait");
+        similarityCache.edit()[key] = similarity;
         cacheAccessCount[key] = 1;
       }
     }
@@ -155,11 +187,42 @@ void Content::preComputeSimilarities(int numThreads)
     thread.join();
   }
 
-  // Evict cache if necessary
-  if (similarityCache.size() > MAX_CACHE_SIZE)
+  // Keep every item's best neighbors before eviction drops pairs
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  rebuildItemNeighbors();
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
+
+  enforceCacheBudget();
+}
+
+void Content::rebuildItemNeighbors()
+{
+  TRACE_SPAN("Content::rebuildItemNeighbors");
+  ModelSnapshot::NeighborLists lists;
+  for (const auto &[key, similarity] : *similarityCache)
   {
-    evictCache();
+    int id1 = static_cast<int>(key >> 32);
+    int id2 = static_cast<int>(key & 0xFFFFFFFF);
+    lists[id1].push_back({id2, similarity});
+    lists[id2].push_back({id1, similarity});
   }
+
+  auto bySimilarity = [](const auto &a, const auto &b)
+  { return a.second > b.second || (a.second == b.second && a.first < b.first); };
+  for (auto &[_, list] : lists)
+  {
+    size_t keep = std::min(list.size(), NEIGHBORS_PER_ITEM);
+    std::partial_sort(list.begin(), list.begin() + keep, list.end(), bySimilarity);
+    list.resize(keep);
+    list.shrink_to_fit();
+  }
+  itemNeighbors = CopyOnWrite<ModelSnapshot::NeighborLists>(std::move(lists));
+}
+
+ModelSnapshot::NeighborLists Content::getItemNeighbors() const
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return *itemNeighbors;
 }
 
 float Content::getCachedSimilarity(int itemId1, int itemId2) const
@@ -168,15 +231,17 @@ float Content::getCachedSimilarity(int itemId1, int itemId2) const
     return 1.0f;
 
   uint64_t key = createPairKey(itemId1, itemId2);
-  std::lock_guard<std::mutex> lock(cacheMutex);
+  TRACE_LOCK(lock, cacheMutex, "Content::cacheMutex wait");
 
-  auto it = similarityCache.find(key);
-  if (it != similarityCache.end())
+  auto it = similarityCache->find(key);
+  if (it != similarityCache->end())
   {
     cacheAccessCount[key]++;
+    Metrics::increment(Metrics::CONTENT_SIMILARITY_HIT);
     return it->second;
   }
 
+  Metrics::increment(Metrics::CONTENT_SIMILARITY_MISS);
   return 0.0f; // Not found in cache
 }
 
@@ -215,8 +280,56 @@ std::vector<std::pair<int, float>> Content::getSimilarItems(int itemId, size_t n
   return similarities;
 }
 
+std::shared_ptr<const Content::ColdStartList> Content::getColdStartList() const
+{
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (coldStartList && coldStartList->graphVersion == graph.getVersion())
+      return coldStartList;
+  }
+
+  TRACE_SPAN("Content::buildColdStartList");
+  Metrics::increment(Metrics::POPULARITY_LIST_BUILDS);
+  auto list = std::make_shared<ColdStartList>();
+  list->graphVersion = graph.getVersion();
+  list->byQuality.reserve(graph.getItemCount());
+  for (size_t index = 0; index < graph.getItemCount(); index++)
+  {
+    list->byQuality.push_back({graph.getItemId(index), graph.getItemAt(index).imdb});
+  }
+
+  // Sort by IMDB rating
+  std::sort(list->byQuality.begin(), list->byQuality.end(),
+            [](const auto &a, const auto &b)
+            { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  coldStartList = list;
+  return coldStartList;
+}
+
+void Content::preComputePopularity() const
+{
+  getColdStartList();
+}
+
 std::vector<std::pair<int, float>> Content::getRecommendations(int userId, size_t n) const
 {
+  return recommend(userId, n, graph.getWatchedItems(userId));
+}
+
+std::vector<std::pair<int, float>> Content::getRecommendations(int userId, size_t n, const ItemFilter &filter) const
+{
+  return recommend(userId, n, filter.excludedItems(graph, graph.getWatchedItems(userId)));
+}
+
+std::vector<std::pair<int, float>> Content::recommend(int userId, size_t n, const Bitset &excluded) const
+{
+  Metrics::increment(Metrics::CONTENT_REQUESTS);
+  Metrics::ScopedTimer timer(Metrics::CONTENT_REQUEST_NS);
+  TRACE_SPAN("Content::getRecommendations");
+  Arena::Scope scratch;
+
   const auto &users = graph.getUserItems();
   const auto &items = graph.getItems();
   auto userIt = users.find(userId);
@@ -224,34 +337,25 @@ std::vector<std::pair<int, float>> Content::getRecommendations(int userId, size_
   // If user not found or has no ratings, return top rated movies
   if (userIt == users.end() || userIt->second.empty())
   {
+    auto list = getColdStartList();
     std::vector<std::pair<int, float>> recommendations;
-    for (const auto &[movieId, movie] : items)
-    {
-      recommendations.push_back({movieId, movie.imdb});
-    }
-
-    // Sort by IMDB rating
-    std::sort(recommendations.begin(), recommendations.end(),
-              [](const auto &a, const auto &b)
-              { return a.second > b.second; });
-
-    if (recommendations.size() > n)
+    for (const auto &entry : list->byQuality)
     {
-      recommendations.resize(n);
+      if (recommendations.size() >= n)
+        break;
+      if (!excluded.test(graph.getItemIndex(entry.first)))
+        recommendations.push_back(entry);
     }
     return recommendations;
   }
 
   // Count genre preferences and calculate average ratings
-  std::unordered_map<std::string, std::pair<float, int>> genreStats; // genre -> {total_rating, count}
-  std::unordered_set<int> watchedMovies;
-
+  std::pmr::unordered_map<std::string, std::pair<float, int>> genreStats(scratch.resource()); // genre -> {total_rating, count}
   for (const auto &[movieId, rating] : userIt->second)
   {
     auto movieIt = items.find(movieId);
     if (movieIt != items.end())
     {
-      watchedMovies.insert(movieId);
       for (const auto &genre : movieIt->second.genres)
       {
         genreStats[genre].first += rating;
@@ -261,7 +365,7 @@ std::vector<std::pair<int, float>> Content::getRecommendations(int userId, size_
   }
 
   // Calculate average rating per genre
-  std::unordered_map<std::string, float> genrePreferences;
+  std::pmr::unordered_map<std::string, float> genrePreferences(scratch.resource());
   float maxPreference = 0.0f;
   for (const auto &[genre, stats] : genreStats)
   {
@@ -284,11 +388,12 @@ std::vector<std::pair<int, float>> Content::getRecommendations(int userId, size_
   }
 
   // Score all unwatched movies
-  std::vector<std::pair<int, float>> recommendations;
-  for (const auto &[movieId, movie] : items)
-  {
-    if (watchedMovies.count(movieId) > 0)
-      continue;
+  std::pmr::vector<std::pair<int, float>> recommendations(scratch.resource());
+  recommendations.reserve(graph.getItemCount());
+  excluded.forEachClear(graph.getItemCount(), [&](size_t index)
+                       {
+    int movieId = graph.getItemId(index);
+    const auto &movie = graph.getItemAt(index);
 
     // Calculate genre score
     float genreScore = 0.0f;
@@ -312,8 +417,7 @@ std::vector<std::pair<int, float>> Content::getRecommendations(int userId, size_
 
     // Combine genre score with movie quality
     float score = 0.8f * genreScore + 0.2f * (movie.imdb / 10.0f);
-    recommendations.push_back({movieId, score});
-  }
+    recommendations.push_back({movieId, score}); });
 
   // Sort by score
   std::sort(recommendations.begin(), recommendations.end(),
@@ -326,5 +430,80 @@ std::vector<std::pair<int, float>> Content::getRecommendations(int userId, size_
     recommendations.resize(n);
   }
 
-  return recommendations;
+  return {recommendations.begin(), recommendations.end()};
+}
+
+ModelSnapshot::NeighborLists Content::getNeighborLists() const
+{
+  ModelSnapshot::NeighborLists lists;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (const auto &[key, similarity] : *similarityCache)
+    {
+      int id1 = static_cast<int>(key >> 32);
+      int id2 = static_cast<int>(key & 0xFFFFFFFF);
+      lists[id1].push_back({id2, similarity});
+      lists[id2].push_back({id1, similarity});
+    }
+  }
+
+  for (auto &[_, list] : lists)
+  {
+    std::sort(list.begin(), list.end(),
+              [](const auto &a, const auto &b)
+              { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+  }
+  return lists;
+}
+
+Content::Content(const BipartiteGraph &bg, const Content &previous)
+    : graph(bg)
+{
+  // Shares both; access counts start over with this instance's reads
+  std::lock_guard<std::mutex> lock(previous.cacheMutex);
+  similarityCache = previous.similarityCache;
+  itemNeighbors = previous.itemNeighbors;
+  modelVersion.store(previous.getModelVersion(), std::memory_order_relaxed);
+  previous.cacheCharge.transferTo(cacheCharge);
+}
+
+bool Content::loadSimilarities(const ModelSnapshot &snapshot)
+{
+  if (!snapshot.matches(graph))
+  {
+    return false;
+  }
+
+  // The item lists are saved whole, so they are restored as they were
+  // rather than rebuilt from whatever pairs the cache kept
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  similarityCache = CopyOnWrite<std::unordered_map<uint64_t, float>>();
+  cacheAccessCount.clear();
+  auto &cache = similarityCache.edit();
+  ModelSnapshot::NeighborLists lists;
+  snapshot.forEachItemList([&](int id, const ModelSnapshot::NeighborEntry *neighbors, size_t count)
+                      {
+    auto &list = lists[id];
+    list.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      uint64_t key = createPairKey(id, neighbors[i].id);
+      cache[key] = neighbors[i].similarity;
+      cacheAccessCount[key] = 1;
+      list.push_back({neighbors[i].id, neighbors[i].similarity});
+    } });
+  itemNeighbors = CopyOnWrite<ModelSnapshot::NeighborLists>(std::move(lists));
+  modelVersion.fetch_add(1, std::memory_order_acq_rel);
+
+  enforceCacheBudget();
+  return true;
+}
+
+void Content::reportMemory(MemoryAccounting::Report &report) const
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  report.add("content.similarity_cache", cacheBytes());
+  report.add("content.item_neighbors", MemoryAccounting::heapBytes(*itemNeighbors));
+  report.add("content.cold_start_list",
+             coldStartList ? MemoryAccounting::heapBytes(coldStartList->byQuality) : 0);
 }
@@ -4,26 +4,72 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory_resource>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include "BipartiteGraph.h"
+#include "CopyOnWrite.h"
+#include "ItemFilter.h"
+#include "MemoryAccounting.h"
+#include "ModelSnapshot.h"
 
 class Content
 {
 private:
     const BipartiteGraph &graph;
-    mutable std::unordered_map<uint64_t, float> similarityCache;
+    // Shared with instances copied from this one until either side writes;
+    // access counts are per instance
+    mutable CopyOnWrite<std::unordered_map<uint64_t, float>> similarityCache;
     mutable std::unordered_map<uint64_t, int> cacheAccessCount;
+    mutable MemoryAccounting::Charge cacheCharge{MemoryAccounting::CONTENT_SIMILARITY_CACHE};
     mutable std::mutex cacheMutex;
-    static constexpr size_t MAX_CACHE_SIZE = 10000;
+    // Bumped each time the similarities are recomputed or loaded
+    std::atomic<uint64_t> modelVersion{0};
+
+    // Every item by imdb score, served to users without ratings. Built once
+    // per graph version. Guarded by cacheMutex
+    struct ColdStartList
+    {
+        uint64_t graphVersion;
+        std::vector<std::pair<int, float>> byQuality;
+    };
+    mutable std::shared_ptr<const ColdStartList> coldStartList;
+    std::shared_ptr<const ColdStartList> getColdStartList() const;
+
+    // Each item's most similar items, most similar first, taken from the
+    // full pair set of the last precompute or snapshot load, so cache
+    // eviction does not thin them out. Guarded by cacheMutex
+    CopyOnWrite<ModelSnapshot::NeighborLists> itemNeighbors;
+    // Rebuilds itemNeighbors from similarityCache. Caller holds cacheMutex
+    void rebuildItemNeighbors();
 
     // Helper methods
     uint64_t createPairKey(int id1, int id2) const;
     void evictCache() const;
+    // Charged to the CONTENT_SIMILARITY_CACHE budget
+    size_t cacheBytes() const;
+    // Updates the charge and evicts if all caches together are over
+    // budget. Caller holds cacheMutex
+    void enforceCacheBudget() const;
     float getCachedSimilarity(int itemId1, int itemId2) const;
 
+    // Recommendations among the items not in excluded
+    std::vector<std::pair<int, float>> recommend(int userId, size_t n, const Bitset &excluded) const;
+
 public:
+    static constexpr size_t NEIGHBORS_PER_ITEM = 20;
+
     explicit Content(const BipartiteGraph &bg) : graph(bg) {}
 
+    // Starts from another instance's similarities over a new graph, sharing
+    // them rather than copying. Only valid while item attributes are
+    // unchanged between the two graphs
+    Content(const BipartiteGraph &bg, const Content &previous);
+
+    // Changes whenever the similarities or item neighbor lists may have
+    uint64_t getModelVersion() const { return modelVersion.load(std::memory_order_acquire); }
+
     // Calculate similarity between items
     float calculateSimilarity(int item1Id, int item2Id) const;
 
@@ -33,8 +79,31 @@ public:
     // Get recommendations for a user
     std::vector<std::pair<int, float>> getRecommendations(int userId, size_t n = 10) const;
 
+    // Only items passing the filter are considered
+    std::vector<std::pair<int, float>> getRecommendations(int userId, size_t n, const ItemFilter &filter) const;
+
+    // Builds the cold-start list now rather than on the first request from
+    // a user without ratings
+    void preComputePopularity() const;
+
     // Get similar items (for testing)
     std::vector<std::pair<int, float>> getSimilarItems(int itemId, size_t n = 5) const;
+
+    // Cached similarities grouped per item, most similar first
+    ModelSnapshot::NeighborLists getNeighborLists() const;
+
+    // Up to NEIGHBORS_PER_ITEM most similar items per item, most similar
+    // first, as of the last precompute or snapshot load
+    ModelSnapshot::NeighborLists getItemNeighbors() const;
+
+    // Restores the item neighbor lists from a snapshot, and seeds the
+    // similarity cache with their pairs, instead of recomputing them.
+    // Returns false, leaving the cache untouched, if the snapshot was built
+    // from a different graph
+    bool loadSimilarities(const ModelSnapshot &snapshot);
+
+    // Pair cache, item neighbor lists and cold-start list
+    void reportMemory(MemoryAccounting::Report &report) const;
 };
 
 #endif
\ No newline at end of file
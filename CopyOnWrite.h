@@ -0,0 +1,294 @@
+#ifndef COPYONWRITE_H
+#define COPYONWRITE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "MemoryAccounting.h"
+
+// Structures shared between model versions until one of them writes.
+//
+// Copying one of these copies pointers, not data. A write first checks
+// whether the part it touches is shared (the pointer's use count is above
+// one) and if so replaces it with a private copy, so every other holder
+// keeps seeing the old contents. Readers of one instance need no locks, but
+// an instance must not be written while it is being copied or read, which
+// is how ModelStore uses them: a writer copies the published version and
+// edits its private copy.
+
+// One value, copied whole on the first write after it was shared
+template <typename T>
+class CopyOnWrite
+{
+private:
+  std::shared_ptr<T> value;
+
+public:
+  CopyOnWrite() : value(std::make_shared<T>()) {}
+  explicit CopyOnWrite(T initial) : value(std::make_shared<T>(std::move(initial))) {}
+
+  const T &operator*() const { return *value; }
+  const T *operator->() const { return value.get(); }
+
+  // A private, writable copy
+  T &edit()
+  {
+    if (value.use_count() > 1)
+      value = std::make_shared<T>(*value);
+    return *value;
+  }
+
+  // True if both hold the same storage, i.e. neither has written since
+  // one was copied from the other
+  bool sharesWith(const CopyOnWrite &other) const { return value == other.value; }
+};
+
+// Hash map split into shards of about SHARD_LOAD entries, each shared
+// until written. Writing one key copies its shard (and, for values larger
+// than a few words, which are held by pointer, that one value), so an
+// update costs the same however large the map is. The shard count doubles
+// as the map grows; a copy costs one pointer per shard.
+//
+// Iteration visits shards in order, each in its hash map's order, and
+// yields entries with .first and .second like std::unordered_map.
+template <typename K, typename V>
+class SharedMap
+{
+private:
+  static constexpr size_t SHARD_LOAD = 32;
+
+  // Small trivially copyable values are stored inline; anything else is
+  // shared per entry, so copying a shard never copies the values
+  static constexpr bool INLINE = std::is_trivially_copyable_v<V> && sizeof(V) <= 16;
+  using Slot = std::conditional_t<INLINE, V, std::shared_ptr<V>>;
+  using Shard = std::unordered_map<K, Slot>;
+
+  std::vector<std::shared_ptr<Shard>> shards;
+  size_t entries = 0;
+
+  static const V &valueOf(const Slot &slot)
+  {
+    if constexpr (INLINE)
+      return slot;
+    else
+      return *slot;
+  }
+
+  size_t shardOf(const K &key) const
+  {
+    uint64_t hash = std::hash<K>{}(key) * 0x9E3779B97F4A7C15ull;
+    return (hash >> 32) & (shards.size() - 1);
+  }
+
+  Shard &editShard(size_t index)
+  {
+    auto &shard = shards[index];
+    if (!shard)
+      shard = std::make_shared<Shard>();
+    else if (shard.use_count() > 1)
+      shard = std::make_shared<Shard>(*shard);
+    return *shard;
+  }
+
+  // Redistributes the slots over twice as many shards, leaving the old
+  // shards (which other copies may hold) untouched
+  void grow()
+  {
+    std::vector<std::shared_ptr<Shard>> old(shards.size() * 2);
+    old.swap(shards);
+    for (const auto &shard : old)
+    {
+      if (!shard)
+        continue;
+      for (const auto &[key, slot] : *shard)
+        editShard(shardOf(key)).emplace(key, slot);
+    }
+  }
+
+  // The key's slot in a private shard, inserted if absent
+  Slot &slotFor(const K &key)
+  {
+    if (entries + 1 > shards.size() * SHARD_LOAD)
+      grow();
+    auto [it, inserted] = editShard(shardOf(key)).try_emplace(key);
+    if (inserted)
+      entries++;
+    return it->second;
+  }
+
+public:
+  struct Entry
+  {
+    const K &first;
+    const V &second;
+  };
+
+  class const_iterator
+  {
+  private:
+    const std::vector<std::shared_ptr<Shard>> *shards = nullptr;
+    size_t shard = 0;
+    typename Shard::const_iterator it;
+
+    void skipEmpty()
+    {
+      while (shard < shards->size() && (!(*shards)[shard] || it == (*shards)[shard]->end()))
+      {
+        if (++shard < shards->size() && (*shards)[shard])
+          it = (*shards)[shard]->begin();
+      }
+    }
+
+    friend class SharedMap;
+    const_iterator(const std::vector<std::shared_ptr<Shard>> *shards, size_t shard,
+                   typename Shard::const_iterator it)
+        : shards(shards), shard(shard), it(it) {}
+
+  public:
+    // Lets it->second work on the entry returned by value
+    struct Arrow
+    {
+      Entry entry;
+      const Entry *operator->() const { return &entry; }
+    };
+
+    const_iterator() = default;
+
+    Entry operator*() const { return {it->first, valueOf(it->second)}; }
+    Arrow operator->() const { return {**this}; }
+
+    const_iterator &operator++()
+    {
+      ++it;
+      skipEmpty();
+      return *this;
+    }
+
+    bool operator==(const const_iterator &other) const
+    {
+      return shard == other.shard && (shard == shards->size() || it == other.it);
+    }
+    bool operator!=(const const_iterator &other) const { return !(*this == other); }
+  };
+
+  SharedMap() : shards(1) {}
+
+  size_t size() const { return entries; }
+  bool empty() const { return entries == 0; }
+
+  const_iterator begin() const
+  {
+    const_iterator first(&shards, 0, {});
+    if (shards[0])
+      first.it = shards[0]->begin();
+    first.skipEmpty();
+    return first;
+  }
+
+  const_iterator end() const { return const_iterator(&shards, shards.size(), {}); }
+
+  const_iterator find(const K &key) const
+  {
+    size_t index = shardOf(key);
+    const auto &shard = shards[index];
+    if (!shard)
+      return end();
+    auto it = shard->find(key);
+    return it != shard->end() ? const_iterator(&shards, index, it) : end();
+  }
+
+  size_t count(const K &key) const { return find(key) != end() ? 1 : 0; }
+
+  const V &at(const K &key) const
+  {
+    auto it = find(key);
+    if (it == end())
+      throw std::out_of_range("SharedMap::at");
+    return it->second;
+  }
+
+  // The value for key, inserted default-constructed if absent, private to
+  // this map
+  V &edit(const K &key)
+  {
+    Slot &slot = slotFor(key);
+    if constexpr (INLINE)
+    {
+      return slot;
+    }
+    else
+    {
+      if (!slot)
+        slot = std::make_shared<V>();
+      else if (slot.use_count() > 1)
+        slot = std::make_shared<V>(*slot);
+      return *slot;
+    }
+  }
+
+  void set(const K &key, V value)
+  {
+    if constexpr (INLINE)
+      slotFor(key) = value;
+    else
+      slotFor(key) = std::make_shared<V>(std::move(value));
+  }
+
+  bool erase(const K &key)
+  {
+    size_t index = shardOf(key);
+    if (!shards[index] || !shards[index]->count(key))
+      return false;
+    editShard(index).erase(key);
+    entries--;
+    return true;
+  }
+
+  void clear()
+  {
+    shards.assign(1, nullptr);
+    entries = 0;
+  }
+
+  // Same keys with equal values, however either is sharded
+  bool operator==(const SharedMap &other) const
+  {
+    if (entries != other.entries)
+      return false;
+    for (const auto &[key, value] : *this)
+    {
+      auto it = other.find(key);
+      if (it == other.end() || !(it->second == value))
+        return false;
+    }
+    return true;
+  }
+  bool operator!=(const SharedMap &other) const { return !(*this == other); }
+
+  // Shard table, hash nodes and values, counting storage shared with other
+  // copies as if it were this map's alone
+  size_t heapBytes() const
+  {
+    size_t bytes = MemoryAccounting::allocationBytes(shards.capacity() * sizeof(shards[0]));
+    for (const auto &shard : shards)
+    {
+      if (!shard)
+        continue;
+      // make_shared puts the map next to its two reference counts
+      bytes += MemoryAccounting::allocationBytes(sizeof(Shard) + 16) + MemoryAccounting::nodeBytes(*shard);
+      if constexpr (!INLINE)
+      {
+        for (const auto &[_, slot] : *shard)
+          bytes += MemoryAccounting::allocationBytes(sizeof(V) + 16) + MemoryAccounting::heapBytes(*slot);
+      }
+    }
+    return bytes;
+  }
+};
+
+#endif
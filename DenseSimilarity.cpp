@@ -0,0 +1,186 @@
+#include "DenseSimilarity.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+  // Four packed floats; the compiler lowers arithmetic on it to SSE/NEON
+  // instructions on every target we build for
+  typedef float Float4 __attribute__((vector_size(16)));
+
+  float dot(const Float4 *a, const Float4 *b, size_t lanes)
+  {
+    // Two accumulators hide the add latency
+    Float4 even = {0, 0, 0, 0};
+    Float4 odd = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 1 < lanes; i += 2)
+    {
+      even += a[i] * b[i];
+      odd += a[i + 1] * b[i + 1];
+    }
+    if (i < lanes)
+      even += a[i] * b[i];
+    Float4 sum = even + odd;
+    return sum[0] + sum[1] + sum[2] + sum[3];
+  }
+
+  bool ranksBefore(const std::pair<int, float> &a, const std::pair<int, float> &b)
+  {
+    return a.second > b.second || (a.second == b.second && a.first < b.first);
+  }
+
+  // Bounded top-k of one query row, updated once per dot product
+  class TopK
+  {
+  private:
+    size_t k;
+    std::vector<std::pair<int, float>> entries;
+    size_t worst = 0;
+
+  public:
+    explicit TopK(size_t k) : k(k) { entries.reserve(k); }
+
+    void offer(int id, float similarity)
+    {
+      std::pair<int, float> candidate(id, similarity);
+      if (entries.size() < k)
+      {
+        entries.push_back(candidate);
+        if (entries.size() == k)
+          findWorst();
+        return;
+      }
+      if (!ranksBefore(candidate, entries[worst]))
+        return;
+      entries[worst] = candidate;
+      findWorst();
+    }
+
+    std::vector<std::pair<int, float>> take()
+    {
+      std::sort(entries.begin(), entries.end(), ranksBefore);
+      return std::move(entries);
+    }
+
+  private:
+    void findWorst()
+    {
+      worst = 0;
+      for (size_t i = 1; i < entries.size(); i++)
+      {
+        if (ranksBefore(entries[worst], entries[i]))
+          worst = i;
+      }
+    }
+  };
+}
+
+bool DenseSimilarity::suitable(const BipartiteGraph &graph)
+{
+  size_t items = graph.getItemCount();
+  return items > 0 && items <= MAX_ITEMS &&
+         graph.getUserItems().size() <= MAX_CELLS / items;
+}
+
+std::vector<std::pair<int, std::vector<std::pair<int, float>>>> DenseSimilarity::topKNeighbors(
+    const BipartiteGraph &graph, size_t k, int numThreads)
+{
+  TRACE_SPAN("DenseSimilarity::topKNeighbors");
+  // Rows follow the graph's dense user order when it has one
+  std::vector<int> users;
+  if (graph.getUserOrder().empty())
+  {
+    for (const auto &[userId, _] : graph.getUserItems())
+    {
+      users.push_back(userId);
+    }
+    std::sort(users.begin(), users.end());
+  }
+  else
+  {
+    users = graph.getUserOrder();
+  }
+  users.erase(std::remove_if(users.begin(), users.end(), [&](int userId)
+                             { return graph.getUserItems().at(userId).empty(); }),
+              users.end());
+
+  // Row-normalized rating matrix, rows padded to whole Float4 lanes
+  size_t lanes = (graph.getItemCount() + 3) / 4;
+  std::vector<Float4> matrix(users.size() * lanes, Float4{0, 0, 0, 0});
+  for (size_t u = 0; u < users.size(); u++)
+  {
+    const auto &ratings = graph.getUserItems().at(users[u]);
+    double norm = 0.0;
+    for (const auto &[_, rating] : ratings)
+    {
+      norm += rating * rating;
+    }
+    if (norm == 0.0)
+      continue;
+
+    float scale = static_cast<float>(1.0 / std::sqrt(norm));
+    float *row = reinterpret_cast<float *>(&matrix[u * lanes]);
+    for (const auto &[movieId, rating] : ratings)
+    {
+      int index = graph.getItemIndex(movieId);
+      if (index >= 0)
+        row[index] = rating * scale;
+    }
+  }
+
+  std::vector<std::pair<int, std::vector<std::pair<int, float>>>> result(users.size());
+  size_t blocks = (users.size() + TILE_ROWS - 1) / TILE_ROWS;
+  std::atomic<size_t> nextBlock{0};
+
+  auto worker = [&]()
+  {
+    TRACE_THREAD_NAME("DenseSimilarity worker");
+    for (size_t block = nextBlock++; block < blocks; block = nextBlock++)
+    {
+      size_t rowBegin = block * TILE_ROWS;
+      size_t rowEnd = std::min(rowBegin + TILE_ROWS, users.size());
+      std::vector<TopK> tops(rowEnd - rowBegin, TopK(k));
+
+      // One query tile against every column tile; both stay cache-resident
+      // for the TILE_ROWS x TILE_ROWS dot products between them
+      for (size_t colBegin = 0; colBegin < users.size(); colBegin += TILE_ROWS)
+      {
+        size_t colEnd = std::min(colBegin + TILE_ROWS, users.size());
+        for (size_t row = rowBegin; row < rowEnd; row++)
+        {
+          const Float4 *a = &matrix[row * lanes];
+          TopK &top = tops[row - rowBegin];
+          for (size_t col = colBegin; col < colEnd; col++)
+          {
+            if (col == row)
+              continue;
+            float similarity = dot(a, &matrix[col * lanes], lanes);
+            if (similarity > 0)
+              top.offer(users[col], similarity);
+          }
+        }
+      }
+
+      for (size_t row = rowBegin; row < rowEnd; row++)
+      {
+        result[row] = {users[row], tops[row - rowBegin].take()};
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < std::max(1, numThreads); i++)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  return result;
+}
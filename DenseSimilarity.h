@@ -0,0 +1,36 @@
+#ifndef DENSESIMILARITY_H
+#define DENSESIMILARITY_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "BipartiteGraph.h"
+
+// All-pairs user cosine similarity as a dense matrix product, for catalogs
+// small enough that a user's ratings fit in one short dense row.
+//
+// Ratings are laid out as a users x items float matrix with each row scaled
+// to unit length, so cos(u, v) is the dot product of rows u and v. Rows are
+// processed in tiles: a block of TILE_ROWS "query" rows is multiplied
+// against each block of TILE_ROWS rows in turn, keeping both blocks in
+// cache, and every dot product is folded straight into its query row's
+// top-k so the U x U result never exists in memory. Threads take query
+// blocks from a shared counter.
+namespace DenseSimilarity
+{
+  // Above either limit the sparse path is used
+  constexpr size_t MAX_ITEMS = 1024;
+  constexpr size_t MAX_CELLS = size_t(64) << 20;
+  constexpr size_t TILE_ROWS = 64;
+
+  // Whether the graph is small enough along the item axis (and in total)
+  // for the dense kernel
+  bool suitable(const BipartiteGraph &graph);
+
+  // For every user with ratings, up to k other users with positive
+  // similarity, most similar first. Similarities are single precision
+  std::vector<std::pair<int, std::vector<std::pair<int, float>>>> topKNeighbors(
+      const BipartiteGraph &graph, size_t k, int numThreads);
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "Epoch.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+  // Pinned epoch of one thread, or 0 while it is outside any guard
+  struct ReaderSlot
+  {
+    std::atomic<uint64_t> pinned{0};
+    int depth = 0; // guard nesting, touched only by the owning thread
+  };
+
+  struct Retired
+  {
+    uint64_t epoch;
+    std::function<void()> reclaim;
+  };
+
+  struct Registry
+  {
+    // Starts at 1 so 0 can mean "not pinned"
+    std::atomic<uint64_t> epoch{1};
+
+    std::mutex mutex;
+    std::vector<ReaderSlot *> live;
+    std::vector<Retired> retired;
+  };
+
+  // Never destroyed so thread_local destructors running during shutdown can
+  // still unregister their slot
+  Registry &registry()
+  {
+    static Registry *instance = new Registry();
+    return *instance;
+  }
+
+  struct SlotHolder
+  {
+    std::unique_ptr<ReaderSlot> slot;
+
+    SlotHolder() : slot(new ReaderSlot())
+    {
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.live.push_back(slot.get());
+    }
+
+    ~SlotHolder()
+    {
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.live.erase(std::remove(reg.live.begin(), reg.live.end(), slot.get()), reg.live.end());
+    }
+  };
+
+  ReaderSlot &localSlot()
+  {
+    thread_local SlotHolder holder;
+    return *holder.slot;
+  }
+}
+
+Epoch::Guard::Guard()
+{
+  ReaderSlot &slot = localSlot();
+  if (slot.depth++ == 0)
+  {
+    // seq_cst orders the pin before any pointer load inside the guard, so a
+    // writer that advanced the epoch past ours has already swapped pointers
+    slot.pinned.store(registry().epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+  }
+}
+
+Epoch::Guard::~Guard()
+{
+  ReaderSlot &slot = localSlot();
+  if (--slot.depth == 0)
+  {
+    slot.pinned.store(0, std::memory_order_release);
+  }
+}
+
+void Epoch::retire(std::function<void()> reclaim)
+{
+  auto &reg = registry();
+  // Readers pinned at or before this epoch may still see the object;
+  // anyone pinning later loads the already-swapped pointer
+  uint64_t epoch = reg.epoch.fetch_add(1, std::memory_order_seq_cst);
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  reg.retired.push_back({epoch, std::move(reclaim)});
+}
+
+size_t Epoch::collect()
+{
+  auto &reg = registry();
+  std::vector<std::function<void()>> ready;
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    uint64_t oldestPinned = UINT64_MAX;
+    for (const ReaderSlot *slot : reg.live)
+    {
+      uint64_t pinned = slot->pinned.load(std::memory_order_seq_cst);
+      if (pinned != 0)
+        oldestPinned = std::min(oldestPinned, pinned);
+    }
+
+    auto keep = std::partition(reg.retired.begin(), reg.retired.end(),
+                               [&](const Retired &r)
+                               { return r.epoch >= oldestPinned; });
+    for (auto it = keep; it != reg.retired.end(); ++it)
+    {
+      ready.push_back(std::move(it->reclaim));
+    }
+    reg.retired.erase(keep, reg.retired.end());
+  }
+
+  // Reclaim outside the lock; destructors may be expensive
+  for (auto &reclaim : ready)
+  {
+    reclaim();
+  }
+  return ready.size();
+}
+
+size_t Epoch::pendingCount()
+{
+  auto &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  return reg.retired.size();
+}
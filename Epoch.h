@@ -0,0 +1,81 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Epoch-based reclamation for data published through atomic pointers.
+//
+// A reader pins the current global epoch in its own thread slot for the
+// duration of a Guard (one store, no locks) and may dereference any
+// published pointer until the guard ends. A writer that swaps a pointer
+// retires the old object instead of deleting it; the object is freed once
+// every thread pinned at the time of the swap has unpinned.
+class Epoch
+{
+public:
+  class Guard
+  {
+  public:
+    Guard();
+    ~Guard();
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+  };
+
+  // Defers reclaim until no reader can still hold the retired object.
+  // Must be called after the object has been unpublished
+  static void retire(std::function<void()> reclaim);
+
+  // Runs every retired reclaim that is now safe; returns how many ran
+  static size_t collect();
+
+  // Retired objects still waiting for readers to move on
+  static size_t pendingCount();
+};
+
+// A value replaced wholesale by writers and read without locks.
+//
+// Readers call get() under an Epoch::Guard and see either the old or the
+// new version, never a partial one. Writers build the next version off to
+// the side and publish() it; the previous version is reclaimed through
+// Epoch once the last reader using it finishes. Concurrent publishers must
+// be serialized by the caller.
+template <typename T>
+class Versioned
+{
+private:
+  std::atomic<const T *> current{nullptr};
+  std::atomic<uint64_t> version{0};
+
+public:
+  Versioned() = default;
+  explicit Versioned(std::unique_ptr<T> initial) { publish(std::move(initial)); }
+  Versioned(const Versioned &) = delete;
+  Versioned &operator=(const Versioned &) = delete;
+
+  // No reader may be active when the owner is destroyed
+  ~Versioned() { delete current.load(); }
+
+  const T *get() const { return current.load(std::memory_order_seq_cst); }
+
+  uint64_t getVersion() const { return version.load(std::memory_order_acquire); }
+
+  // Swaps in the next version and returns its number
+  uint64_t publish(std::unique_ptr<T> next)
+  {
+    const T *previous = current.exchange(next.release(), std::memory_order_seq_cst);
+    uint64_t published = version.fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (previous)
+    {
+      Epoch::retire([previous]()
+                    { delete previous; });
+    }
+    Epoch::collect();
+    return published;
+  }
+};
+
+#endif
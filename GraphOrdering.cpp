@@ -0,0 +1,158 @@
+#include "GraphOrdering.h"
+#include "Trace.h"
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+  size_t degree(const BipartiteGraph::Adjacency &adjacency, int id)
+  {
+    auto it = adjacency.find(id);
+    return it != adjacency.end() ? it->second.size() : 0;
+  }
+
+  // Most connected first, ties by id so the order is reproducible
+  void sortByDegree(std::vector<int> &ids,
+                    const BipartiteGraph::Adjacency &adjacency,
+                    bool ascending)
+  {
+    std::sort(ids.begin(), ids.end(), [&](int a, int b)
+              {
+      size_t da = degree(adjacency, a);
+      size_t db = degree(adjacency, b);
+      if (da != db)
+        return ascending ? da < db : da > db;
+      return a < b; });
+  }
+
+  // Breadth-first over the bipartite graph, users and items alternating by
+  // level. With byDegree, each node's neighbors are queued in ascending
+  // degree order (Cuthill-McKee)
+  GraphOrdering::Ordering traverse(const BipartiteGraph &graph, const std::vector<int> &starts, bool byDegree)
+  {
+    const auto &userItems = graph.getUserItems();
+    const auto &itemUsers = graph.getItemUsers();
+    GraphOrdering::Ordering ordering;
+    std::unordered_set<int> seenUsers;
+    std::unordered_set<int> seenItems;
+    std::deque<std::pair<bool, int>> queue;
+    std::vector<int> neighbors;
+
+    for (int start : starts)
+    {
+      if (!seenUsers.insert(start).second)
+        continue;
+      queue.push_back({true, start});
+
+      while (!queue.empty())
+      {
+        auto [isUser, id] = queue.front();
+        queue.pop_front();
+        (isUser ? ordering.users : ordering.items).push_back(id);
+
+        neighbors.clear();
+        const auto &adjacency = isUser ? userItems : itemUsers;
+        auto &seen = isUser ? seenItems : seenUsers;
+        auto it = adjacency.find(id);
+        if (it == adjacency.end())
+          continue;
+        for (const auto &[otherId, _] : it->second)
+        {
+          // Raters replaced by addUser can linger in item lists
+          if (!isUser && !userItems.count(otherId))
+            continue;
+          if (seen.insert(otherId).second)
+            neighbors.push_back(otherId);
+        }
+        if (byDegree)
+          sortByDegree(neighbors, isUser ? itemUsers : userItems, true);
+        for (int otherId : neighbors)
+        {
+          queue.push_back({!isUser, otherId});
+        }
+      }
+    }
+
+    // Items nobody rated keep their relative order at the end
+    for (size_t i = 0; i < graph.getItemCount(); i++)
+    {
+      if (!seenItems.count(graph.getItemId(i)))
+        ordering.items.push_back(graph.getItemId(i));
+    }
+    return ordering;
+  }
+}
+
+GraphOrdering::Ordering GraphOrdering::compute(const BipartiteGraph &graph, Strategy strategy)
+{
+  TRACE_SPAN("GraphOrdering::compute");
+  const auto &userItems = graph.getUserItems();
+  std::vector<int> users;
+  users.reserve(userItems.size());
+  for (const auto &[userId, _] : userItems)
+  {
+    users.push_back(userId);
+  }
+
+  if (strategy == DEGREE)
+  {
+    Ordering ordering;
+    ordering.users = users;
+    sortByDegree(ordering.users, userItems, false);
+    for (size_t i = 0; i < graph.getItemCount(); i++)
+    {
+      ordering.items.push_back(graph.getItemId(i));
+    }
+    sortByDegree(ordering.items, graph.getItemUsers(), false);
+    return ordering;
+  }
+
+  // BFS starts each component at its most active user; Cuthill-McKee at a
+  // least active one, which tends to lie on the component's periphery
+  sortByDegree(users, userItems, strategy == RCM);
+  Ordering ordering = traverse(graph, users, strategy == RCM);
+  if (strategy == RCM)
+  {
+    std::reverse(ordering.users.begin(), ordering.users.end());
+    std::reverse(ordering.items.begin(), ordering.items.end());
+  }
+  return ordering;
+}
+
+double GraphOrdering::averageRaterGap(const BipartiteGraph &graph, const std::vector<int> &userOrder)
+{
+  std::unordered_map<int, size_t> position;
+  for (size_t i = 0; i < userOrder.size(); i++)
+  {
+    position[userOrder[i]] = i;
+  }
+
+  double totalGap = 0.0;
+  size_t gaps = 0;
+  std::vector<size_t> positions;
+  for (const auto &[_, raters] : graph.getItemUsers())
+  {
+    positions.clear();
+    for (const auto &[userId, __] : raters)
+    {
+      auto it = position.find(userId);
+      if (it != position.end())
+        positions.push_back(it->second);
+    }
+    std::sort(positions.begin(), positions.end());
+    for (size_t i = 1; i < positions.size(); i++)
+    {
+      totalGap += static_cast<double>(positions[i] - positions[i - 1]);
+      gaps++;
+    }
+  }
+  return gaps > 0 ? totalGap / gaps : 0.0;
+}
+
+bool GraphOrdering::reorder(BipartiteGraph &graph, Strategy strategy)
+{
+  Ordering ordering = compute(graph, strategy);
+  return graph.applyOrdering(ordering.users, ordering.items);
+}
@@ -0,0 +1,47 @@
+#ifndef GRAPHORDERING_H
+#define GRAPHORDERING_H
+
+#include <vector>
+#include "BipartiteGraph.h"
+
+// Locality-improving orders for the dense user and item positions of a
+// frozen graph, applied with BipartiteGraph::applyOrdering.
+//
+// Input order scatters the raters of an item (and the items of a user)
+// across memory. Placing users who share items next to each other keeps
+// the rows a PageRank sweep or similarity tile touches together in cache.
+//
+//   DEGREE  most active users and most rated items first; cheap, groups the
+//           heavy rows but does nothing for who-rates-what
+//   BFS     breadth-first over the user-item graph from the most active
+//           user, so each user lands near the items it rated and the other
+//           raters of those items
+//   RCM     reverse Cuthill-McKee: BFS from a low-degree user, neighbors in
+//           ascending degree order, reversed; minimizes the bandwidth of the
+//           co-rating structure
+namespace GraphOrdering
+{
+  enum Strategy
+  {
+    DEGREE,
+    BFS,
+    RCM
+  };
+
+  struct Ordering
+  {
+    std::vector<int> users;
+    std::vector<int> items;
+  };
+
+  Ordering compute(const BipartiteGraph &graph, Strategy strategy);
+
+  // Average distance, in user positions, between consecutive raters of an
+  // item once sorted by position. Lower means better locality
+  double averageRaterGap(const BipartiteGraph &graph, const std::vector<int> &userOrder);
+
+  // Shorthand for compute followed by applyOrdering
+  bool reorder(BipartiteGraph &graph, Strategy strategy);
+}
+
+#endif
@@ -1,19 +1,58 @@
 #include "Hybrid.h"
+#include "Trace.h"
+#include "Arena.h"
 #include <algorithm>
 #include <cmath>
+#include <chrono>
+#include <unordered_map>
+
+namespace
+{
+  // now + budget, saturating instead of overflowing for huge budgets
+  std::chrono::steady_clock::time_point deadlineAfter(std::chrono::nanoseconds budget)
+  {
+    auto now = std::chrono::steady_clock::now();
+    auto latest = std::chrono::steady_clock::time_point::max();
+    return budget >= latest - now ? latest : now + budget;
+  }
+}
 
 uint64_t Hybrid::createKey(int userId, int movieId) const
 {
   return (static_cast<uint64_t>(userId) << 32) | movieId;
 }
 
+ResultCache::Version Hybrid::currentVersion() const
+{
+  // Ranks are computed lazily; force them first so a result computed right
+  // after they appear is not stamped with the pre-compute version
+  pageRank.getRanks();
+  return {graph.getVersion(), pageRank.getVersion(), collaborative.getModelVersion(),
+          content.getModelVersion()};
+}
+
 double Hybrid::calculateHybridScore(int userId, int movieId) const
+{
+  return calculateHybridScore(userId, movieId, nullptr, nullptr);
+}
+
+double Hybrid::calculateHybridScore(int userId, int movieId,
+                                    Metrics::StageTimer *collabStage,
+                                    Metrics::StageTimer *contentStage) const
 {
   uint64_t cacheKey = createKey(userId, movieId);
 
   // Check cache first
   {
-    std::lock_guard<std::mutex> lock(cacheMutex);
+    TRACE_LOCK(lock, cacheMutex, "Hybrid::cacheMutex wait");
+    ResultCache::Version version = currentVersion();
+    if (!(scoreCacheVersion == version))
+    {
+      // Scores from an older graph or model are stale
+      hybridScoreCache.clear();
+      scoreCacheCharge.set(MemoryAccounting::nodeBytes(hybridScoreCache));
+      scoreCacheVersion = version;
+    }
     auto it = hybridScoreCache.find(cacheKey);
     if (it != hybridScoreCache.end())
     {
@@ -22,27 +61,38 @@ double Hybrid::calculateHybridScore(int userId, int movieId) const
   }
 
   // Get collaborative and content scores
+  auto stageStart = std::chrono::steady_clock::now();
   double collabScore = 0.0;
-  auto collabRecs = collaborative.getRecommendations(userId);
-  for (const auto &[recMovieId, score] : collabRecs)
   {
-    if (recMovieId == movieId)
+    TRACE_SPAN("Hybrid collaborative stage");
+    auto collabRecs = collaborative.getRecommendations(userId);
+    for (const auto &[recMovieId, score] : collabRecs)
     {
-      collabScore = score;
-      break;
+      if (recMovieId == movieId)
+      {
+        collabScore = score;
+        break;
+      }
     }
   }
 
+  auto collabEnd = std::chrono::steady_clock::now();
+  if (collabStage)
+    collabStage->add(collabEnd - stageStart);
+
   double contentScore = 0.0;
   const auto &userRatings = graph.getUserItems().at(userId);
   double ratingWeight = 0.0;
 
   // For each movie the user has rated, get its similarity to the target movie
-  for (const auto &[ratedMovieId, rating] : userRatings)
   {
-    float similarity = content.calculateSimilarity(ratedMovieId, movieId);
-    contentScore += similarity * rating;
-    ratingWeight += rating;
+    TRACE_SPAN("Hybrid content stage");
+    for (const auto &[ratedMovieId, rating] : userRatings)
+    {
+      float similarity = content.calculateSimilarity(ratedMovieId, movieId);
+      contentScore += similarity * rating;
+      ratingWeight += rating;
+    }
   }
 
   if (ratingWeight > 0)
@@ -50,6 +100,9 @@ double Hybrid::calculateHybridScore(int userId, int movieId) const
     contentScore /= ratingWeight; // Normalize by total rating weight
   }
 
+  if (contentStage)
+    contentStage->add(std::chrono::steady_clock::now() - collabEnd);
+
   // Get user's PageRank score
   double userRank = pageRank.getPageRank(userId);
 
@@ -69,37 +122,320 @@ double Hybrid::calculateHybridScore(int userId, int movieId) const
 
   // Cache the result
   {
-    std::lock_guard<std::mutex> lock(cacheMutex);
+    TRACE_LOCK(lock, cacheMutex, "Hybrid::cacheMutex wait");
+    scoreCacheCharge.set(MemoryAccounting::nodeBytes(hybridScoreCache));
+    if (scoreCacheCharge.overBudget())
+    {
+      hybridScoreCache.clear();
+      hybridScoreCache.rehash(0);
+    }
     hybridScoreCache[cacheKey] = hybridScore;
   }
 
   return hybridScore;
 }
 
-std::vector<std::pair<int, double>> Hybrid::getRecommendations(int userId, size_t n) const
+std::shared_ptr<const Hybrid::CandidateIndex> Hybrid::getCandidateIndex() const
 {
-  std::vector<std::pair<int, double>> recommendations;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (candidateIndex && candidateIndex->graphVersion == graph.getVersion() &&
+        candidateIndex->contentVersion == content.getModelVersion())
+      return candidateIndex;
+  }
+
+  TRACE_SPAN("Hybrid::buildCandidateIndex");
+  auto index = std::make_shared<CandidateIndex>();
+  index->graphVersion = graph.getVersion();
+  index->contentVersion = content.getModelVersion();
+  const auto &itemUsers = graph.getItemUsers();
+  auto ratingCount = [&](int movieId)
+  {
+    auto it = itemUsers.find(movieId);
+    return it != itemUsers.end() ? it->second.size() : 0;
+  };
+
+  for (const auto &[movieId, _] : graph.getItems())
+    index->popular.push_back(movieId);
+  std::sort(index->popular.begin(), index->popular.end(),
+            [&](int a, int b)
+            {
+              size_t ca = ratingCount(a), cb = ratingCount(b);
+              return ca > cb || (ca == cb && a < b);
+            });
+
   const auto &items = graph.getItems();
-  const auto &userRatings = graph.getUserItems().at(userId);
+  for (int movieId : index->popular)
+  {
+    for (const auto &genre : items.at(movieId).genres)
+      index->popularByGenre[genre].push_back(movieId);
+  }
 
-  // Create set of watched movies
-  std::unordered_set<int> watchedMovies;
-  for (const auto &[movieId, _] : userRatings)
+  // Content's precomputed per-item top lists; nothing is computed here,
+  // and pairs its cache has since evicted are still found
+  for (const auto &[movieId, neighbors] : content.getItemNeighbors())
   {
-    watchedMovies.insert(movieId);
+    auto &list = index->similarItems[movieId];
+    size_t keep = std::min(neighbors.size(), candidateOptions.similarPerRatedItem);
+    for (size_t i = 0; i < keep; i++)
+      list.push_back(neighbors[i].first);
   }
 
-  // Get scores for unwatched movies
-  for (const auto &[movieId, _] : items)
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  candidateIndex = index;
+  return candidateIndex;
+}
+
+Hybrid::CandidateOptions Hybrid::CandidateOptions::scaledTo(size_t itemCount) const
+{
+  CandidateOptions scaled = *this;
+  if (scaled.maxCandidates == 0)
+    scaled.maxCandidates = std::max(MIN_CANDIDATES, itemCount / 4);
+  if (scaled.neighborItems == 0)
+    scaled.neighborItems = scaled.maxCandidates / 2;
+  if (scaled.similarItems == 0)
+    scaled.similarItems = scaled.maxCandidates / 3;
+  if (scaled.genrePopular == 0)
+    scaled.genrePopular = scaled.maxCandidates / 3;
+  return scaled;
+}
+
+void Hybrid::collectCandidates(int userId, const Bitset &excluded,
+                               std::pmr::vector<int> &out,
+                               Clock::time_point deadline) const
+{
+  size_t itemCount = graph.getItemCount();
+  CandidateOptions options = candidateOptions.scaledTo(itemCount);
+
+  // Small catalogs: every unwatched item is a candidate. The sources still
+  // run, without quotas, so the items they rank come first and a deadline
+  // cut in scoring keeps them; the rest follow in catalog order
+  bool exhaustive = itemCount - excluded.count() <= options.maxCandidates;
+  if (exhaustive)
   {
-    if (watchedMovies.count(movieId) == 0)
+    options.maxCandidates = options.neighborItems = options.similarItems = options.genrePopular = itemCount;
+  }
+
+  auto *resource = out.get_allocator().resource();
+  const auto &userItems = graph.getUserItems();
+  const auto &userRatings = userItems.at(userId);
+  auto indexPtr = getCandidateIndex();
+  const CandidateIndex &index = *indexPtr;
+
+  Bitset seen(itemCount);
+  auto add = [&](int movieId)
+  {
+    int dense = graph.getItemIndex(movieId);
+    if (dense < 0 || excluded.test(dense) || seen.test(dense) ||
+        out.size() >= options.maxCandidates)
+      return false;
+    seen.set(dense);
+    out.push_back(movieId);
+    return true;
+  };
+
+  // Highest accumulated score first, up to quota
+  auto addTop = [&](std::pmr::unordered_map<int, double> &scores, size_t quota)
+  {
+    std::pmr::vector<std::pair<int, double>> ranked(scores.begin(), scores.end(), resource);
+    std::sort(ranked.begin(), ranked.end(),
+              [](const auto &a, const auto &b)
+              { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+    size_t added = 0;
+    for (const auto &[movieId, _] : ranked)
+    {
+      if (added >= quota)
+        break;
+      added += add(movieId);
+    }
+  };
+
+  // Neighbor ratings, weighted by similarity
+  {
+    std::pmr::unordered_map<int, double> scores(resource);
+    for (const auto &[neighborId, similarity] : collaborative.getNeighbors(userId))
+    {
+      auto it = userItems.find(neighborId);
+      if (it == userItems.end())
+        continue;
+      for (const auto &[movieId, rating] : it->second)
+        scores[movieId] += similarity * rating;
+    }
+    addTop(scores, options.neighborItems);
+  }
+  if (Clock::now() >= deadline)
+    return;
+
+  // Content neighbors of the user's rated items, weighted by rating
+  {
+    std::pmr::unordered_map<int, double> scores(resource);
+    for (const auto &[ratedId, rating] : userRatings)
     {
-      double score = calculateHybridScore(userId, movieId);
+      auto it = index.similarItems.find(ratedId);
+      if (it == index.similarItems.end())
+        continue;
+      for (int movieId : it->second)
+        scores[movieId] += rating;
+    }
+    addTop(scores, options.similarItems);
+  }
+  if (Clock::now() >= deadline)
+    return;
+
+  // Popular items in the user's favorite genres
+  {
+    std::pmr::unordered_map<std::string, double> genreWeights(resource);
+    const auto &items = graph.getItems();
+    for (const auto &[ratedId, rating] : userRatings)
+    {
+      auto it = items.find(ratedId);
+      if (it == items.end())
+        continue;
+      for (const auto &genre : it->second.genres)
+        genreWeights[genre] += rating;
+    }
+    std::pmr::vector<std::pair<std::string, double>> genres(genreWeights.begin(), genreWeights.end(), resource);
+    std::sort(genres.begin(), genres.end(),
+              [](const auto &a, const auto &b)
+              { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+    if (genres.size() > options.favoriteGenres)
+      genres.resize(options.favoriteGenres);
+
+    size_t perGenre = genres.empty() ? 0 : options.genrePopular / genres.size();
+    for (const auto &[genre, _] : genres)
+    {
+      auto it = index.popularByGenre.find(genre);
+      if (it == index.popularByGenre.end())
+        continue;
+      size_t added = 0;
+      for (size_t i = 0; i < it->second.size() && added < perGenre; i++)
+        added += add(it->second[i]);
+    }
+  }
+  if (Clock::now() >= deadline)
+    return;
+
+  if (exhaustive)
+  {
+    excluded.forEachClear(itemCount, [&](size_t index)
+                         { add(graph.getItemId(index)); });
+    return;
+  }
+
+  // Users with little history may not fill the budget from their own signals
+  for (size_t i = 0; i < index.popular.size() && out.size() < options.maxCandidates; i++)
+  {
+    add(index.popular[i]);
+  }
+}
+
+std::vector<int> Hybrid::getCandidates(int userId) const
+{
+  Arena::Scope scratch;
+  std::pmr::vector<int> candidates(scratch.resource());
+  collectCandidates(userId, graph.getWatchedItems(userId), candidates);
+  return {candidates.begin(), candidates.end()};
+}
+
+std::vector<std::pair<int, double>> Hybrid::getRecommendations(int userId, size_t n) const
+{
+  return recommend(userId, n, Clock::time_point::max(), nullptr).recommendations;
+}
+
+Hybrid::Result Hybrid::getRecommendations(int userId, size_t n, std::chrono::nanoseconds budget) const
+{
+  return recommend(userId, n, deadlineAfter(budget), nullptr);
+}
+
+std::vector<std::pair<int, double>> Hybrid::getRecommendations(int userId, size_t n, const ItemFilter &filter) const
+{
+  return recommend(userId, n, Clock::time_point::max(), &filter).recommendations;
+}
+
+Hybrid::Result Hybrid::getRecommendations(int userId, size_t n, std::chrono::nanoseconds budget,
+                                          const ItemFilter &filter) const
+{
+  return recommend(userId, n, deadlineAfter(budget), &filter);
+}
+
+Hybrid::Result Hybrid::recommend(int userId, size_t n, Clock::time_point deadline,
+                                 const ItemFilter *filter) const
+{
+  Metrics::increment(Metrics::HYBRID_REQUESTS);
+  Metrics::ScopedTimer timer(Metrics::HYBRID_REQUEST_NS);
+  TRACE_SPAN("Hybrid::getRecommendations");
+  Result result;
+
+  // Hybrid scoring needs the user's ratings; unknown users are an error
+  graph.getUserItems().at(userId);
+
+  ResultCache::Key cacheKey{userId, n, filter ? *filter : ItemFilter()};
+  ResultCache::Version version = currentVersion();
+  if (resultCacheEnabled && resultCache.lookup(cacheKey, version, result.recommendations))
+  {
+    return result;
+  }
+
+  Arena::Scope scratch;
+  std::pmr::vector<std::pair<int, double>> recommendations(scratch.resource());
+
+  // Filtered-out items are excluded exactly like watched ones, so they are
+  // never generated as candidates nor scored
+  Bitset filtered;
+  const Bitset *excluded = &graph.getWatchedItems(userId);
+  if (filter && !filter->empty())
+  {
+    filtered = filter->excludedItems(graph, *excluded);
+    excluded = &filtered;
+  }
+
+  // Candidates stop early enough to leave time for the final sort and copy
+  Clock::time_point cutoff = deadline;
+  if (deadline != Clock::time_point::max())
+    cutoff -= DEADLINE_RESERVE;
+
+  // Stage one: cheap candidate generation
+  std::pmr::vector<int> candidates(scratch.resource());
+  {
+    TRACE_SPAN("Hybrid candidate stage");
+    collectCandidates(userId, *excluded, candidates, cutoff);
+  }
+
+  // Stage two: full hybrid scoring of the candidates only, in source
+  // priority order so a cut-off keeps the strongest candidates
+  recommendations.reserve(candidates.size());
+  {
+    Metrics::StageTimer collabStage(Metrics::HYBRID_COLLAB_STAGE_NS);
+    Metrics::StageTimer contentStage(Metrics::HYBRID_CONTENT_STAGE_NS);
+    for (int movieId : candidates)
+    {
+      if (Clock::now() >= cutoff)
+      {
+        result.quality = Result::PARTIAL;
+        break;
+      }
+      double score = calculateHybridScore(userId, movieId, &collabStage, &contentStage);
       recommendations.push_back({movieId, score});
     }
   }
+  Metrics::record(Metrics::HYBRID_CANDIDATES, recommendations.size());
+
+  if (result.quality == Result::PARTIAL && recommendations.empty())
+  {
+    Metrics::increment(Metrics::HYBRID_POPULARITY_FALLBACKS);
+    result.quality = Result::POPULARITY;
+    for (const auto &[movieId, score] : collaborative.getPopularRecommendations(*excluded, n))
+    {
+      result.recommendations.push_back({movieId, score});
+    }
+    return result;
+  }
+  if (result.quality == Result::PARTIAL)
+    Metrics::increment(Metrics::HYBRID_DEGRADED);
 
   // Sort by score and get top N
+  Metrics::ScopedTimer rankingStage(Metrics::HYBRID_RANKING_STAGE_NS);
+  TRACE_SPAN("Hybrid ranking stage");
   std::sort(recommendations.begin(), recommendations.end(),
             [](const auto &a, const auto &b)
             { return a.second > b.second; });
@@ -109,5 +445,25 @@ std::vector<std::pair<int, double>> Hybrid::getRecommendations(int userId, size_
     recommendations.resize(n);
   }
 
-  return recommendations;
+  result.recommendations.assign(recommendations.begin(), recommendations.end());
+
+  // Degraded rankings are not worth repeating
+  if (resultCacheEnabled && !result.degraded())
+    resultCache.insert(cacheKey, version, result.recommendations);
+  return result;
+}
+
+void Hybrid::reportMemory(MemoryAccounting::Report &report) const
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  report.add("hybrid.score_cache", MemoryAccounting::nodeBytes(hybridScoreCache));
+  report.add("hybrid.result_cache", resultCache.bytes());
+  size_t indexBytes = 0;
+  if (candidateIndex)
+  {
+    indexBytes = MemoryAccounting::heapBytes(candidateIndex->similarItems) +
+                 MemoryAccounting::heapBytes(candidateIndex->popularByGenre) +
+                 MemoryAccounting::heapBytes(candidateIndex->popular);
+  }
+  report.add("hybrid.candidate_index", indexBytes);
 }
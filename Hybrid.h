@@ -4,35 +4,170 @@
 #include "BipartiteGraph.h"
 #include "Collabrative.h"
 #include "Content.h"
+#include "ItemFilter.h"
 #include "PageRank.h"
+#include "Metrics.h"
+#include "ResultCache.h"
 #include <unordered_map>
 #include <vector>
+#include <chrono>
+#include <memory_resource>
+#include <memory>
 #include <mutex>
+#include <string>
 
 class Hybrid
 {
+public:
+  // Stage-one candidate generation. Each source contributes up to its quota
+  // of unwatched items, duplicates are dropped, and only the merged set is
+  // scored with the full hybrid formula. Catalogs with no more than
+  // maxCandidates unwatched items are scored exhaustively.
+  //
+  // A limit of 0 scales with the catalog: maxCandidates is a quarter of the
+  // items but at least MIN_CANDIDATES, the neighbor quota half of it and
+  // the other two quotas a third each.
+  struct CandidateOptions
+  {
+    static constexpr size_t MIN_CANDIDATES = 100;
+
+    size_t maxCandidates = 0;
+    // Items rated by the user's nearest collaborative neighbors
+    size_t neighborItems = 0;
+    // Content neighbors of the items the user rated highest
+    size_t similarItems = 0;
+    // Read once, when the lookup tables are built
+    size_t similarPerRatedItem = 10;
+    // Most-rated items in the user's favorite genres
+    size_t genrePopular = 0;
+    size_t favoriteGenres = 3;
+
+    // These options with every 0 limit resolved for a catalog of itemCount
+    CandidateOptions scaledTo(size_t itemCount) const;
+  };
+
+  // Recommendations served under a time budget
+  struct Result
+  {
+    enum Quality
+    {
+      FULL,       // every candidate was scored
+      PARTIAL,    // best of the candidates scored before the deadline
+      POPULARITY  // nothing was scored in time; precomputed popularity list
+    };
+
+    std::vector<std::pair<int, double>> recommendations;
+    Quality quality = FULL;
+
+    bool degraded() const { return quality != FULL; }
+  };
+
 private:
+  using Clock = std::chrono::steady_clock;
+
+  // Held back from a request's time budget for ranking the scored candidates
+  static constexpr std::chrono::microseconds DEADLINE_RESERVE{100};
+
   const BipartiteGraph &graph;
   Collaborative &collaborative;
   Content &content;
-  PageRank pageRank;
+  const PageRank &pageRank;
 
-  // Cache for hybrid scores
+  // Cache for hybrid scores, valid for one graph, PageRank and model
+  // version and cleared when any changes or the score caches together
+  // outgrow the HYBRID_SCORE_CACHE budget
   mutable std::unordered_map<uint64_t, double> hybridScoreCache;
+  mutable MemoryAccounting::Charge scoreCacheCharge{MemoryAccounting::HYBRID_SCORE_CACHE};
+  mutable ResultCache::Version scoreCacheVersion{0, 0, 0, 0};
   mutable std::mutex cacheMutex;
 
+  // Final top-N lists of full (non-degraded) requests
+  mutable ResultCache resultCache;
+  bool resultCacheEnabled = true;
+
+  ResultCache::Version currentVersion() const;
+
+  CandidateOptions candidateOptions;
+
+  // Cheap lookup tables for candidate generation, built on first use from
+  // the graph and content similarities as they are then
+  struct CandidateIndex
+  {
+    uint64_t graphVersion;
+    uint64_t contentVersion;
+    // Item -> content neighbors, most similar first
+    std::unordered_map<int, std::vector<int>> similarItems;
+    // Genre -> items, most rated first
+    std::unordered_map<std::string, std::vector<int>> popularByGenre;
+    // All items, most rated first; backfill for users with little history
+    std::vector<int> popular;
+  };
+  // Rebuilt when the graph or content model version changes. Guarded by
+  // cacheMutex
+  mutable std::shared_ptr<const CandidateIndex> candidateIndex;
+
   // Helper methods
   uint64_t createKey(int userId, int movieId) const;
+  std::shared_ptr<const CandidateIndex> getCandidateIndex() const;
+
+  // Appends deduplicated candidates not in excluded (the user's watched
+  // items, plus anything filtered out) to out. Stops
+  // adding sources once the deadline has passed
+  void collectCandidates(int userId, const Bitset &excluded,
+                         std::pmr::vector<int> &out,
+                         Clock::time_point deadline = Clock::time_point::max()) const;
+
+  // filter may be null
+  Result recommend(int userId, size_t n, Clock::time_point deadline,
+                   const ItemFilter *filter) const;
+
+  // Scores a movie, charging collaborative and content time to the given
+  // per-request stage timers (either may be null)
+  double calculateHybridScore(int userId, int movieId,
+                              Metrics::StageTimer *collabStage,
+                              Metrics::StageTimer *contentStage) const;
 
 public:
+  Hybrid(const BipartiteGraph &bg, Collaborative &collab, Content &cont, const PageRank &pr)
+      : graph(bg), collaborative(collab), content(cont), pageRank(pr)
+  {
+  }
+
+  // Shares the PageRank model the collaborative engine was built with
   Hybrid(const BipartiteGraph &bg, Collaborative &collab, Content &cont)
-      : graph(bg), collaborative(collab), content(cont), pageRank(bg)
+      : Hybrid(bg, collab, cont, collab.getPageRank())
   {
   }
 
+  void setCandidateOptions(const CandidateOptions &options) { candidateOptions = options; }
+
+  // The items stage one would hand to the scorer for this user
+  std::vector<int> getCandidates(int userId) const;
+
+  // Cached top-N lists, for sizing and tests
+  const ResultCache &getResultCache() const { return resultCache; }
+
+  // When disabled every request is computed in full, e.g. to benchmark
+  // the scoring path rather than cache hits
+  void setResultCacheEnabled(bool enabled) { resultCacheEnabled = enabled; }
+
+  // Score cache, result cache and candidate index; the engines it combines
+  // report their own
+  void reportMemory(MemoryAccounting::Report &report) const;
+
   // Get weighted hybrid recommendations for a user
   std::vector<std::pair<int, double>> getRecommendations(int userId, size_t n = 10) const;
 
+  // Same, but returns by the time budget has elapsed: candidate generation
+  // and scoring stop early and the best ranking so far is returned, or the
+  // popularity list when nothing could be scored in time
+  Result getRecommendations(int userId, size_t n, std::chrono::nanoseconds budget) const;
+
+  // Only items passing the filter are generated as candidates and scored
+  std::vector<std::pair<int, double>> getRecommendations(int userId, size_t n, const ItemFilter &filter) const;
+  Result getRecommendations(int userId, size_t n, std::chrono::nanoseconds budget,
+                            const ItemFilter &filter) const;
+
   // Calculate hybrid score incorporating PageRank
   double calculateHybridScore(int userId, int movieId) const;
 
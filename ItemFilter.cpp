@@ -0,0 +1,176 @@
+#include "ItemFilter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Items whose bucketed value lies in [lo, hi]. Buckets entirely inside
+  // the range are taken whole; buckets straddling a bound check each of
+  // their items' exact values
+  template <typename T, typename BucketItems, typename Bounds, typename Value>
+  Bitset itemsInRange(int bucketCount, T lo, T hi, BucketItems bucketItems,
+                      Bounds bucketBounds, Value exactValue)
+  {
+    Bitset matches;
+    for (int b = 0; b < bucketCount; b++)
+    {
+      auto [bucketLo, bucketHi] = bucketBounds(b);
+      if (bucketHi < lo || bucketLo > hi)
+        continue;
+
+      const Bitset &items = bucketItems(b);
+      if (bucketLo >= lo && bucketHi <= hi)
+      {
+        matches |= items;
+        continue;
+      }
+      items.forEachSet([&](size_t index)
+                       {
+        T value = exactValue(index);
+        if (value >= lo && value <= hi)
+          matches.set(index); });
+    }
+    return matches;
+  }
+}
+
+ItemFilter &ItemFilter::ratingAtMost(int rating)
+{
+  maxRating = std::min(maxRating, rating);
+  return *this;
+}
+
+ItemFilter &ItemFilter::lengthAtLeast(int minutes)
+{
+  minLength = std::max(minLength, minutes);
+  return *this;
+}
+
+ItemFilter &ItemFilter::lengthAtMost(int minutes)
+{
+  maxLength = std::min(maxLength, minutes);
+  return *this;
+}
+
+ItemFilter &ItemFilter::imdbAtLeast(float score)
+{
+  minImdb = std::max(minImdb, score);
+  return *this;
+}
+
+ItemFilter &ItemFilter::imdbAtMost(float score)
+{
+  maxImdb = std::min(maxImdb, score);
+  return *this;
+}
+
+ItemFilter &ItemFilter::genre(const std::string &name)
+{
+  genres.push_back(name);
+  return *this;
+}
+
+bool ItemFilter::empty() const
+{
+  return maxRating == INT_MAX && minLength == INT_MIN && maxLength == INT_MAX &&
+         std::isinf(minImdb) && std::isinf(maxImdb) && genres.empty();
+}
+
+bool ItemFilter::operator==(const ItemFilter &other) const
+{
+  return maxRating == other.maxRating && minLength == other.minLength &&
+         maxLength == other.maxLength && minImdb == other.minImdb &&
+         maxImdb == other.maxImdb && genres == other.genres;
+}
+
+uint64_t ItemFilter::hash() const
+{
+  // FNV-1a over the constraint values
+  uint64_t h = 1469598103934665603ull;
+  auto mix = [&h](const void *data, size_t size)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+      h ^= bytes[i];
+      h *= 1099511628211ull;
+    }
+  };
+  mix(&maxRating, sizeof(maxRating));
+  mix(&minLength, sizeof(minLength));
+  mix(&maxLength, sizeof(maxLength));
+  mix(&minImdb, sizeof(minImdb));
+  mix(&maxImdb, sizeof(maxImdb));
+  for (const auto &name : genres)
+  {
+    mix(name.data(), name.size() + 1);
+  }
+  return h;
+}
+
+Bitset ItemFilter::excludedItems(const BipartiteGraph &graph, const Bitset &watched) const
+{
+  const AttributeIndex &index = graph.getAttributeIndex();
+  size_t itemCount = graph.getItemCount();
+
+  // Not (A and B and ...) is (not A) or (not B) or ...
+  Bitset excluded = watched;
+
+  if (maxRating != INT_MAX)
+  {
+    Bitset allowed;
+    for (const auto &[rating, items] : index.getRatingItems())
+    {
+      if (rating <= maxRating)
+        allowed |= items;
+    }
+    excluded.orNot(allowed, itemCount);
+  }
+
+  if (minLength != INT_MIN || maxLength != INT_MAX)
+  {
+    constexpr int W = AttributeIndex::LENGTH_BUCKET_MINUTES;
+    constexpr int LAST = AttributeIndex::LENGTH_BUCKETS - 1;
+    Bitset allowed = itemsInRange<int>(
+        AttributeIndex::LENGTH_BUCKETS, minLength, maxLength,
+        [&](int b) -> const Bitset &
+        { return index.getLengthBucketItems(b); },
+        [&](int b)
+        { return std::pair<int, int>(b == 0 ? INT_MIN : b * W,
+                                     b == LAST ? INT_MAX : (b + 1) * W - 1); },
+        [&](size_t i)
+        { return graph.getItemAt(i).length; });
+    excluded.orNot(allowed, itemCount);
+  }
+
+  if (!std::isinf(minImdb) || !std::isinf(maxImdb))
+  {
+    constexpr float W = AttributeIndex::IMDB_BUCKET_WIDTH;
+    constexpr int LAST = AttributeIndex::IMDB_BUCKETS - 1;
+    const float INF = std::numeric_limits<float>::infinity();
+    // Bucket b holds [b * W, (b + 1) * W); the upper bound below is the
+    // largest float in it
+    Bitset allowed = itemsInRange<float>(
+        AttributeIndex::IMDB_BUCKETS, minImdb, maxImdb,
+        [&](int b) -> const Bitset &
+        { return index.getImdbBucketItems(b); },
+        [&](int b)
+        { return std::pair<float, float>(b == 0 ? -INF : b * W,
+                                         b == LAST ? INF : std::nextafter((b + 1) * W, -INF)); },
+        [&](size_t i)
+        { return graph.getItemAt(i).imdb; });
+    excluded.orNot(allowed, itemCount);
+  }
+
+  if (!genres.empty())
+  {
+    Bitset allowed;
+    for (const auto &name : genres)
+    {
+      allowed |= index.getGenreItems(name);
+    }
+    excluded.orNot(allowed, itemCount);
+  }
+
+  return excluded;
+}
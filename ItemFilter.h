@@ -0,0 +1,53 @@
+#ifndef ITEMFILTER_H
+#define ITEMFILTER_H
+
+#include <climits>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "BipartiteGraph.h"
+#include "Bitset.h"
+
+// Attribute constraints on recommended items, e.g.
+//
+//   ItemFilter().ratingAtMost(2).lengthAtMost(119).genre("Comedy")
+//
+// Constraints of different kinds are ANDed; repeated genre() calls accept
+// any of the listed genres. The filter is compiled against the graph's
+// attribute bitmaps into an exclusion set that the engines use in place of
+// the watched-items bitset, so excluded items are never scored.
+class ItemFilter
+{
+private:
+  int maxRating = INT_MAX;
+  int minLength = INT_MIN;
+  int maxLength = INT_MAX;
+  float minImdb = -std::numeric_limits<float>::infinity();
+  float maxImdb = std::numeric_limits<float>::infinity();
+  std::vector<std::string> genres;
+
+public:
+  // Age rating (G, PG, PG-13, R = 0..3) no higher than rating
+  ItemFilter &ratingAtMost(int rating);
+  // Length in minutes, inclusive
+  ItemFilter &lengthAtLeast(int minutes);
+  ItemFilter &lengthAtMost(int minutes);
+  ItemFilter &imdbAtLeast(float score);
+  ItemFilter &imdbAtMost(float score);
+  ItemFilter &genre(const std::string &name);
+
+  bool empty() const;
+
+  bool operator==(const ItemFilter &other) const;
+  uint64_t hash() const;
+
+  // Heap bytes held by the genre list, for cache accounting
+  size_t heapBytes() const { return MemoryAccounting::heapBytes(genres); }
+
+  // Items to skip for a request: the watched items plus every item that
+  // fails the filter
+  Bitset excludedItems(const BipartiteGraph &graph, const Bitset &watched) const;
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "LoadGenerator.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  uint64_t elapsedNs(Clock::time_point from, Clock::time_point to)
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+  }
+
+  // Nearest-rank percentile of sorted values
+  uint64_t percentile(const std::vector<uint64_t> &sorted, double p)
+  {
+    if (sorted.empty())
+      return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+  }
+}
+
+LoadGenerator::ZipfSampler::ZipfSampler(size_t count, double exponent)
+{
+  cdf.reserve(count);
+  double total = 0.0;
+  for (size_t rank = 0; rank < count; rank++)
+  {
+    total += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+    cdf.push_back(total);
+  }
+  for (double &value : cdf)
+  {
+    value /= total;
+  }
+}
+
+size_t LoadGenerator::ZipfSampler::operator()(std::mt19937_64 &rng) const
+{
+  double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+  size_t rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+  return std::min(rank, cdf.size() - 1);
+}
+
+LoadGenerator::LoadGenerator(const BipartiteGraph &bg, const Collaborative &collab,
+                             const Content &content, const Hybrid &hybrid)
+    : graph(bg), collaborative(collab), content(content), hybrid(hybrid)
+{
+}
+
+bool LoadGenerator::issue(Target target, int userId, size_t n) const
+{
+  if (!graph.getUserItems().count(userId))
+    return false;
+
+  switch (target)
+  {
+  case COLLABORATIVE:
+    collaborative.getRecommendations(userId, n);
+    break;
+  case CONTENT:
+    content.getRecommendations(userId, n);
+    break;
+  default:
+    hybrid.getRecommendations(userId, n);
+    break;
+  }
+  return true;
+}
+
+LoadGenerator::Report LoadGenerator::run(const Options &options) const
+{
+  int threadCount = std::max(1, options.threads);
+
+  // Popularity ranks are assigned to users in a seeded random order so the
+  // hot users are not simply the lowest ids
+  std::vector<int> users;
+  for (const auto &[userId, _] : graph.getUserItems())
+  {
+    users.push_back(userId);
+  }
+  std::sort(users.begin(), users.end());
+  std::mt19937_64 shuffleRng(options.seed);
+  std::shuffle(users.begin(), users.end(), shuffleRng);
+
+  Report report;
+  if (users.empty() && options.trace.empty())
+    return report;
+  ZipfSampler zipf(std::max<size_t>(users.size(), 1), options.zipfExponent);
+
+  std::atomic<size_t> traceCursor{0};
+  std::atomic<size_t> errors{0};
+  std::vector<std::vector<uint64_t>> latencies(threadCount);
+  std::vector<std::thread> clients;
+
+  Metrics::Snapshot before = Metrics::snapshot();
+  auto start = Clock::now();
+  for (int t = 0; t < threadCount; t++)
+  {
+    size_t share = options.requests / threadCount + (static_cast<size_t>(t) < options.requests % threadCount);
+    clients.emplace_back([&, t, share]()
+                         {
+      std::mt19937_64 rng(options.seed + 1 + t);
+      std::vector<uint64_t> &local = latencies[t];
+      local.reserve(share);
+
+      for (size_t k = 0; k < share; k++)
+      {
+        int userId = options.trace.empty()
+                         ? users[zipf(rng)]
+                         : options.trace[traceCursor.fetch_add(1, std::memory_order_relaxed) % options.trace.size()];
+
+        Clock::time_point issued;
+        if (options.mode == OPEN_LOOP)
+        {
+          // Threads interleave on one global schedule of qps requests/s
+          double at = static_cast<double>(k * threadCount + t) / std::max(options.qps, 1e-9);
+          issued = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(at));
+          std::this_thread::sleep_until(issued);
+        }
+        else
+        {
+          issued = Clock::now();
+        }
+
+        if (!issue(options.target, userId, options.n))
+          errors.fetch_add(1, std::memory_order_relaxed);
+        local.push_back(elapsedNs(issued, Clock::now()));
+      } });
+  }
+  for (auto &client : clients)
+  {
+    client.join();
+  }
+  auto end = Clock::now();
+  Metrics::Snapshot after = Metrics::snapshot();
+  report.resultCacheHits = after.counter(Metrics::RESULT_CACHE_HIT) - before.counter(Metrics::RESULT_CACHE_HIT);
+  report.resultCacheMisses = after.counter(Metrics::RESULT_CACHE_MISS) - before.counter(Metrics::RESULT_CACHE_MISS);
+
+  std::vector<uint64_t> all;
+  for (auto &local : latencies)
+  {
+    all.insert(all.end(), local.begin(), local.end());
+  }
+  std::sort(all.begin(), all.end());
+
+  report.requests = all.size();
+  report.errors = errors.load();
+  report.seconds = elapsedNs(start, end) / 1e9;
+  report.throughput = report.seconds > 0 ? report.requests / report.seconds : 0.0;
+  if (!all.empty())
+  {
+    double sum = 0.0;
+    for (uint64_t ns : all)
+    {
+      sum += static_cast<double>(ns);
+    }
+    report.meanNs = sum / all.size();
+    report.p50Ns = percentile(all, 0.50);
+    report.p90Ns = percentile(all, 0.90);
+    report.p99Ns = percentile(all, 0.99);
+    report.p999Ns = percentile(all, 0.999);
+    report.maxNs = all.back();
+  }
+  return report;
+}
+
+std::vector<int> LoadGenerator::loadTrace(const std::string &path)
+{
+  std::vector<int> trace;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream ss(line);
+    int userId;
+    if (ss >> userId)
+      trace.push_back(userId);
+  }
+  return trace;
+}
+
+void LoadGenerator::buildSyntheticGraph(BipartiteGraph &bg, int userCount, int movieCount,
+                                        int ratingsPerUser, uint64_t seed)
+{
+  static const std::vector<std::string> GENRES = {"Action", "Adventure", "Comedy", "Drama", "Horror",
+                                                  "Romance", "Sci-Fi", "Thriller", "Family", "Fantasy"};
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<size_t> genreDist(0, GENRES.size() - 1);
+  for (int i = 1; i <= movieCount; i++)
+  {
+    size_t first = genreDist(rng);
+    size_t second = (first + 1 + genreDist(rng) % (GENRES.size() - 1)) % GENRES.size();
+    bg.addItem(i, {GENRES[first], GENRES[second]}, 80 + i % 80, 5.0f + i % 5, 2000 + i % 25);
+  }
+
+  std::vector<int> movieIds(movieCount);
+  for (int i = 0; i < movieCount; i++)
+  {
+    movieIds[i] = i + 1;
+  }
+  std::uniform_real_distribution<float> ratingDist(1.0f, 5.0f);
+  size_t count = static_cast<size_t>(std::clamp(ratingsPerUser, 0, movieCount));
+  for (int u = 1; u <= userCount; u++)
+  {
+    // Partial Fisher-Yates: the first count ids are a uniform sample
+    std::vector<std::pair<int, float>> ratings;
+    for (size_t i = 0; i < count; i++)
+    {
+      std::swap(movieIds[i], movieIds[std::uniform_int_distribution<size_t>(i, movieIds.size() - 1)(rng)]);
+      ratings.push_back({movieIds[i], ratingDist(rng)});
+    }
+    bg.addUser(u, ratings);
+  }
+}
+
+double LoadGenerator::Report::resultCacheHitRate() const
+{
+  uint64_t lookups = resultCacheHits + resultCacheMisses;
+  return lookups > 0 ? static_cast<double>(resultCacheHits) / lookups : 0.0;
+}
+
+std::string LoadGenerator::Report::toText() const
+{
+  std::ostringstream out;
+  out << "requests    " << requests << " (" << errors << " errors)\n"
+      << "duration    " << seconds << " s\n"
+      << "throughput  " << throughput << " req/s\n"
+      << "latency     mean=" << meanNs / 1000.0 << "us"
+      << " p50=" << p50Ns / 1000.0 << "us"
+      << " p90=" << p90Ns / 1000.0 << "us"
+      << " p99=" << p99Ns / 1000.0 << "us"
+      << " p99.9=" << p999Ns / 1000.0 << "us"
+      << " max=" << maxNs / 1000.0 << "us\n"
+      << "result cache " << resultCacheHits << " hits, " << resultCacheMisses << " misses ("
+      << resultCacheHitRate() * 100.0 << "% hit rate)\n";
+  return out.str();
+}
@@ -0,0 +1,113 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "BipartiteGraph.h"
+#include "Collabrative.h"
+#include "Content.h"
+#include "Hybrid.h"
+
+// Drives the engines from several client threads and reports latency
+// percentiles and throughput.
+//
+// Closed loop: each thread issues its next request as soon as the previous
+// one returns, so throughput is whatever the engines sustain. Open loop:
+// requests are scheduled at a fixed total rate regardless of how long they
+// take, and latency is measured from each request's scheduled start rather
+// than its actual start, so queueing behind a slow request is counted
+// (no coordinated omission).
+class LoadGenerator
+{
+public:
+  enum Mode
+  {
+    CLOSED_LOOP,
+    OPEN_LOOP
+  };
+
+  enum Target
+  {
+    HYBRID,
+    COLLABORATIVE,
+    CONTENT
+  };
+
+  struct Options
+  {
+    Mode mode = CLOSED_LOOP;
+    Target target = HYBRID;
+    int threads = 4;
+    // Total across all threads
+    size_t requests = 1000;
+    // Total across all threads; open loop only
+    double qps = 100.0;
+    size_t n = 10;
+    // Skew of the user popularity distribution; 0 is uniform
+    double zipfExponent = 1.0;
+    uint64_t seed = 42;
+    // When set, user ids are replayed from it in order instead of sampled
+    std::vector<int> trace;
+  };
+
+  struct Report
+  {
+    size_t requests = 0;
+    // Requests for users the graph does not have
+    size_t errors = 0;
+    double seconds = 0.0;
+    double throughput = 0.0;
+    double meanNs = 0.0;
+    uint64_t p50Ns = 0;
+    uint64_t p90Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t p999Ns = 0;
+    uint64_t maxNs = 0;
+    // Hybrid result cache lookups during the run; a high hit rate means
+    // the percentiles mostly measure cache hits
+    uint64_t resultCacheHits = 0;
+    uint64_t resultCacheMisses = 0;
+
+    double resultCacheHitRate() const;
+    std::string toText() const;
+  };
+
+  // Samples ranks 0..count-1 with probability proportional to
+  // 1 / (rank + 1)^exponent
+  class ZipfSampler
+  {
+  private:
+    std::vector<double> cdf;
+
+  public:
+    ZipfSampler(size_t count, double exponent);
+    size_t operator()(std::mt19937_64 &rng) const;
+  };
+
+  LoadGenerator(const BipartiteGraph &bg, const Collaborative &collab,
+                const Content &content, const Hybrid &hybrid);
+
+  Report run(const Options &options) const;
+
+  // One user id per line; blank and unparsable lines are skipped
+  static std::vector<int> loadTrace(const std::string &path);
+
+  // Seeded random catalog of movies 1..movieCount (two genres each) and
+  // users 1..userCount with ratingsPerUser ratings each, for runs without
+  // a dataset
+  static void buildSyntheticGraph(BipartiteGraph &bg, int userCount, int movieCount,
+                                  int ratingsPerUser, uint64_t seed);
+
+private:
+  const BipartiteGraph &graph;
+  const Collaborative &collaborative;
+  const Content &content;
+  const Hybrid &hybrid;
+
+  // Returns false for a user the graph does not have
+  bool issue(Target target, int userId, size_t n) const;
+};
+
+#endif
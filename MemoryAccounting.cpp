@@ -0,0 +1,105 @@
+#include "MemoryAccounting.h"
+#include <atomic>
+#include <sstream>
+
+namespace
+{
+  // Roughly the footprint of the entry-count limits these replaced: 10000
+  // similarity pairs, 100000 hybrid scores, 4096 top-N lists
+  std::atomic<size_t> budgets[MemoryAccounting::BUDGET_COUNT] = {
+      {1u << 20},
+      {1u << 20},
+      {4u << 20},
+      {2u << 20}};
+
+  std::atomic<size_t> usage[MemoryAccounting::BUDGET_COUNT] = {};
+}
+
+size_t MemoryAccounting::Report::total() const
+{
+  size_t sum = 0;
+  for (const auto &[_, bytes] : entries)
+    sum += bytes;
+  return sum;
+}
+
+std::string MemoryAccounting::Report::toText() const
+{
+  std::ostringstream out;
+  for (const auto &[name, bytes] : entries)
+  {
+    out << name << " " << bytes << "\n";
+  }
+  out << "total " << total() << "\n";
+  return out.str();
+}
+
+void MemoryAccounting::setBudget(Budget budget, size_t bytes)
+{
+  budgets[budget].store(bytes, std::memory_order_relaxed);
+}
+
+size_t MemoryAccounting::getBudget(Budget budget)
+{
+  return budgets[budget].load(std::memory_order_relaxed);
+}
+
+size_t MemoryAccounting::getUsage(Budget budget)
+{
+  return usage[budget].load(std::memory_order_relaxed);
+}
+
+void MemoryAccounting::Charge::set(size_t bytes)
+{
+  if (retired.load(std::memory_order_relaxed))
+    return;
+  size_t previous = charged.exchange(bytes, std::memory_order_relaxed);
+  // Unsigned arithmetic wraps, so a shrinking charge subtracts
+  usage[budget].fetch_add(bytes - previous, std::memory_order_relaxed);
+}
+
+void MemoryAccounting::Charge::adjust(std::ptrdiff_t delta)
+{
+  if (retired.load(std::memory_order_relaxed))
+    return;
+  charged.fetch_add(static_cast<size_t>(delta), std::memory_order_relaxed);
+  usage[budget].fetch_add(static_cast<size_t>(delta), std::memory_order_relaxed);
+}
+
+bool MemoryAccounting::Charge::overBudget() const
+{
+  return getUsage(budget) > getBudget(budget);
+}
+
+size_t MemoryAccounting::Charge::evictionTarget() const
+{
+  size_t half = getBudget(budget) / 2;
+  size_t total = getUsage(budget), own = bytes();
+  size_t others = total > own ? total - own : 0;
+  return half > others ? half - others : 0;
+}
+
+void MemoryAccounting::Charge::transferTo(Charge &successor)
+{
+  retired.store(true, std::memory_order_relaxed);
+  size_t bytes = charged.exchange(0, std::memory_order_relaxed);
+  usage[budget].fetch_sub(bytes, std::memory_order_relaxed);
+  successor.adjust(static_cast<std::ptrdiff_t>(bytes));
+}
+
+const char *MemoryAccounting::budgetName(Budget budget)
+{
+  switch (budget)
+  {
+  case COLLAB_SIMILARITY_CACHE:
+    return "collab_similarity_cache";
+  case CONTENT_SIMILARITY_CACHE:
+    return "content_similarity_cache";
+  case HYBRID_SCORE_CACHE:
+    return "hybrid_score_cache";
+  case RESULT_CACHE:
+    return "result_cache";
+  default:
+    return "unknown";
+  }
+}
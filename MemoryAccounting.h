@@ -0,0 +1,170 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Bitset.h"
+
+// Resident-size accounting for the engines, and the byte budgets their
+// caches are sized by.
+//
+// Sizes are estimates computed from container shapes rather than measured:
+// each heap block is charged what glibc malloc hands out for it, and each
+// hash map its bucket array plus one allocation per node (libstdc++ keeps no
+// cached hash for integer keys). They track real RSS closely enough to size
+// caches and to compare structures, without an allocator hook.
+//
+// Every engine exposes reportMemory(Report &), adding one line per major
+// structure; ModelVersion::reportMemory collects a whole model.
+namespace MemoryAccounting
+{
+  // glibc malloc: 8-byte chunk header, 16-byte granularity, 32-byte minimum
+  inline size_t allocationBytes(size_t requested)
+  {
+    return requested == 0 ? 0 : std::max<size_t>(32, (requested + 8 + 15) & ~size_t(15));
+  }
+
+  // Heap bytes owned by a value, not counting the value itself
+  inline size_t heapBytes(const Bitset &bits);
+  inline size_t heapBytes(const std::string &text);
+  template <typename T>
+  size_t heapBytes(const T &value);
+  template <typename A, typename B>
+  size_t heapBytes(const std::pair<A, B> &pair);
+  template <typename T>
+  size_t heapBytes(const std::vector<T> &vector);
+  template <typename K, typename V, typename H, typename E>
+  size_t heapBytes(const std::unordered_map<K, V, H, E> &map);
+
+  // Buckets and nodes of a hash map, without what its values own
+  template <typename Map>
+  size_t nodeBytes(const Map &map)
+  {
+    size_t node = sizeof(void *) + sizeof(typename Map::value_type);
+    return allocationBytes(map.bucket_count() * sizeof(void *)) + map.size() * allocationBytes(node);
+  }
+
+  template <typename T>
+  size_t heapBytes(const T &)
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "no heapBytes overload for this type");
+    return 0;
+  }
+
+  inline size_t heapBytes(const std::string &text)
+  {
+    // Short strings live inside the object
+    return text.capacity() > 15 ? allocationBytes(text.capacity() + 1) : 0;
+  }
+
+  inline size_t heapBytes(const Bitset &bits)
+  {
+    return heapBytes(bits.getWords());
+  }
+
+  template <typename A, typename B>
+  size_t heapBytes(const std::pair<A, B> &pair)
+  {
+    return heapBytes(pair.first) + heapBytes(pair.second);
+  }
+
+  template <typename T>
+  size_t heapBytes(const std::vector<T> &vector)
+  {
+    size_t bytes = allocationBytes(vector.capacity() * sizeof(T));
+    if constexpr (!std::is_trivially_copyable_v<T>)
+    {
+      for (const auto &element : vector)
+        bytes += heapBytes(element);
+    }
+    return bytes;
+  }
+
+  template <typename K, typename V, typename H, typename E>
+  size_t heapBytes(const std::unordered_map<K, V, H, E> &map)
+  {
+    size_t bytes = nodeBytes(map);
+    if constexpr (!std::is_trivially_copyable_v<K> || !std::is_trivially_copyable_v<V>)
+    {
+      for (const auto &[key, value] : map)
+        bytes += heapBytes(key) + heapBytes(value);
+    }
+    return bytes;
+  }
+
+  // Named byte counts, in the order they were added
+  struct Report
+  {
+    std::vector<std::pair<std::string, size_t>> entries;
+
+    void add(const std::string &name, size_t bytes) { entries.push_back({name, bytes}); }
+    size_t total() const;
+
+    // One "name bytes" line per entry, then the total
+    std::string toText() const;
+  };
+
+  // Process-wide byte budgets of the bounded caches. Every cache instance
+  // of a kind charges its bytes to one shared counter (see Charge), so k
+  // engines or model versions together stay within the budget rather than
+  // k times it. Once the sum is over, the cache that is growing evicts (the
+  // similarity caches until the sum is down to half, LRU lists entry by
+  // entry) or, for the hybrid score cache, clears. Changes apply from the
+  // next insertion
+  enum Budget
+  {
+    COLLAB_SIMILARITY_CACHE,
+    CONTENT_SIMILARITY_CACHE,
+    HYBRID_SCORE_CACHE,
+    RESULT_CACHE,
+    BUDGET_COUNT
+  };
+
+  void setBudget(Budget budget, size_t bytes);
+  size_t getBudget(Budget budget);
+  const char *budgetName(Budget budget);
+
+  // Bytes currently charged to the budget by every live cache
+  size_t getUsage(Budget budget);
+
+  // One cache instance's share of a budget's usage, released when the
+  // cache is destroyed
+  class Charge
+  {
+  public:
+    explicit Charge(Budget budget) : budget(budget) {}
+    ~Charge() { set(0); }
+
+    Charge(const Charge &) = delete;
+    Charge &operator=(const Charge &) = delete;
+
+    // Replaces, or changes, this cache's charge
+    void set(size_t bytes);
+    void adjust(std::ptrdiff_t delta);
+    size_t bytes() const { return charged.load(std::memory_order_relaxed); }
+
+    // True if all caches charged to the budget together exceed it
+    bool overBudget() const;
+    // Bytes this cache may keep for the sum to come back to half the
+    // budget; 0 if the other caches alone are at or over that
+    size_t evictionTarget() const;
+
+    // Hands the charge to a successor that shares this cache's storage
+    // (the next model version), so shared bytes are charged once. This
+    // charge is 0 from then on and ignores further updates
+    void transferTo(Charge &successor);
+
+  private:
+    Budget budget;
+    std::atomic<size_t> charged{0};
+    std::atomic<bool> retired{false};
+  };
+}
+
+#endif
@@ -0,0 +1,394 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace
+{
+  // Only the owning thread writes to a slot, so a relaxed load + store is
+  // enough and avoids a locked read-modify-write on the hot path
+  inline void addRelaxed(std::atomic<uint64_t> &a, uint64_t n)
+  {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  struct Registry
+  {
+    std::mutex mutex;
+    std::vector<Metrics::ThreadSlot *> live;
+    Metrics::ThreadSlot retired;
+    std::array<std::atomic<double>, Metrics::GAUGE_COUNT> gauges{};
+  };
+
+  // Never destroyed so thread_local destructors running during shutdown can
+  // still fold their slot into it
+  Registry &registry()
+  {
+    static Registry *instance = new Registry();
+    return *instance;
+  }
+
+  void mergeSlot(Metrics::ThreadSlot &into, const Metrics::ThreadSlot &from)
+  {
+    for (int c = 0; c < Metrics::COUNTER_COUNT; c++)
+    {
+      addRelaxed(into.counters[c], from.counters[c].load(std::memory_order_relaxed));
+    }
+    for (int h = 0; h < Metrics::HISTOGRAM_COUNT; h++)
+    {
+      auto &dst = into.histograms[h];
+      const auto &src = from.histograms[h];
+      if (src.count.load(std::memory_order_relaxed) == 0)
+        continue;
+      for (int b = 0; b < Metrics::BUCKET_COUNT; b++)
+      {
+        uint64_t n = src.buckets[b].load(std::memory_order_relaxed);
+        if (n > 0)
+          addRelaxed(dst.buckets[b], n);
+      }
+      addRelaxed(dst.count, src.count.load(std::memory_order_relaxed));
+      addRelaxed(dst.sum, src.sum.load(std::memory_order_relaxed));
+      dst.min.store(std::min(dst.min.load(std::memory_order_relaxed),
+                             src.min.load(std::memory_order_relaxed)),
+                    std::memory_order_relaxed);
+      dst.max.store(std::max(dst.max.load(std::memory_order_relaxed),
+                             src.max.load(std::memory_order_relaxed)),
+                    std::memory_order_relaxed);
+    }
+  }
+
+  struct SlotHolder
+  {
+    std::unique_ptr<Metrics::ThreadSlot> slot;
+
+    SlotHolder() : slot(new Metrics::ThreadSlot())
+    {
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.live.push_back(slot.get());
+    }
+
+    ~SlotHolder()
+    {
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      mergeSlot(reg.retired, *slot);
+      reg.live.erase(std::remove(reg.live.begin(), reg.live.end(), slot.get()), reg.live.end());
+    }
+  };
+
+  uint64_t percentile(const std::array<uint64_t, Metrics::BUCKET_COUNT> &buckets,
+                      uint64_t count, double q, uint64_t maxValue)
+  {
+    if (count == 0)
+      return 0;
+    uint64_t target = static_cast<uint64_t>(q * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < Metrics::BUCKET_COUNT; b++)
+    {
+      seen += buckets[b];
+      if (seen >= target)
+      {
+        // Report the bucket midpoint, clamped to the largest observed value
+        uint64_t lower = Metrics::bucketLowerBound(b);
+        uint64_t upper = Metrics::bucketUpperBound(b);
+        return std::min(lower + (upper - lower) / 2, maxValue);
+      }
+    }
+    return maxValue;
+  }
+}
+
+Metrics::ThreadSlot &Metrics::localSlot()
+{
+  thread_local SlotHolder holder;
+  return *holder.slot;
+}
+
+void Metrics::increment(Counter c, uint64_t n)
+{
+  addRelaxed(localSlot().counters[c], n);
+}
+
+void Metrics::record(Histogram h, uint64_t value)
+{
+  auto &data = localSlot().histograms[h];
+  addRelaxed(data.buckets[bucketIndex(value)], 1);
+  addRelaxed(data.count, 1);
+  addRelaxed(data.sum, value);
+  if (value < data.min.load(std::memory_order_relaxed))
+    data.min.store(value, std::memory_order_relaxed);
+  if (value > data.max.load(std::memory_order_relaxed))
+    data.max.store(value, std::memory_order_relaxed);
+}
+
+void Metrics::setGauge(Gauge g, double value)
+{
+  registry().gauges[g].store(value, std::memory_order_relaxed);
+}
+
+int Metrics::bucketIndex(uint64_t value)
+{
+  if (value < static_cast<uint64_t>(SUB_BUCKETS))
+    return static_cast<int>(value);
+
+  int msb = 63 - __builtin_clzll(value);
+  int sub = static_cast<int>((value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+  return SUB_BUCKETS + (msb - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+uint64_t Metrics::bucketLowerBound(int bucket)
+{
+  if (bucket < SUB_BUCKETS)
+    return static_cast<uint64_t>(bucket);
+
+  int msb = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+  int sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+  return static_cast<uint64_t>(SUB_BUCKETS + sub) << (msb - SUB_BUCKET_BITS);
+}
+
+uint64_t Metrics::bucketUpperBound(int bucket)
+{
+  if (bucket < SUB_BUCKETS)
+    return static_cast<uint64_t>(bucket);
+
+  int msb = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+  return bucketLowerBound(bucket) + ((uint64_t(1) << (msb - SUB_BUCKET_BITS)) - 1);
+}
+
+Metrics::Snapshot Metrics::snapshot()
+{
+  auto &reg = registry();
+
+  std::array<uint64_t, COUNTER_COUNT> counters{};
+  std::vector<std::array<uint64_t, BUCKET_COUNT>> buckets(HISTOGRAM_COUNT);
+  std::array<uint64_t, HISTOGRAM_COUNT> counts{}, sums{}, maxes{};
+  std::array<uint64_t, HISTOGRAM_COUNT> mins;
+  mins.fill(UINT64_MAX);
+  for (auto &b : buckets)
+    b.fill(0);
+
+  auto accumulate = [&](const ThreadSlot &slot)
+  {
+    for (int c = 0; c < COUNTER_COUNT; c++)
+    {
+      counters[c] += slot.counters[c].load(std::memory_order_relaxed);
+    }
+    for (int h = 0; h < HISTOGRAM_COUNT; h++)
+    {
+      const auto &data = slot.histograms[h];
+      if (data.count.load(std::memory_order_relaxed) == 0)
+        continue;
+      for (int b = 0; b < BUCKET_COUNT; b++)
+      {
+        buckets[h][b] += data.buckets[b].load(std::memory_order_relaxed);
+      }
+      counts[h] += data.count.load(std::memory_order_relaxed);
+      sums[h] += data.sum.load(std::memory_order_relaxed);
+      mins[h] = std::min(mins[h], data.min.load(std::memory_order_relaxed));
+      maxes[h] = std::max(maxes[h], data.max.load(std::memory_order_relaxed));
+    }
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    accumulate(reg.retired);
+    for (const auto *slot : reg.live)
+    {
+      accumulate(*slot);
+    }
+  }
+
+  Snapshot snap;
+  for (int c = 0; c < COUNTER_COUNT; c++)
+  {
+    snap.counters.push_back({counterName(static_cast<Counter>(c)), counters[c]});
+  }
+  for (int g = 0; g < GAUGE_COUNT; g++)
+  {
+    snap.gauges.push_back({gaugeName(static_cast<Gauge>(g)),
+                           reg.gauges[g].load(std::memory_order_relaxed)});
+  }
+  for (int h = 0; h < HISTOGRAM_COUNT; h++)
+  {
+    HistogramSummary summary;
+    summary.name = histogramName(static_cast<Histogram>(h));
+    // Bucket totals are the source of truth: a concurrent writer may have
+    // bumped a bucket but not yet the count
+    uint64_t total = 0;
+    for (uint64_t n : buckets[h])
+      total += n;
+    summary.count = total;
+    if (total > 0)
+    {
+      summary.sum = sums[h];
+      summary.min = mins[h];
+      summary.max = maxes[h];
+      summary.mean = static_cast<double>(sums[h]) / total;
+      summary.p50 = percentile(buckets[h], total, 0.50, maxes[h]);
+      summary.p90 = percentile(buckets[h], total, 0.90, maxes[h]);
+      summary.p99 = percentile(buckets[h], total, 0.99, maxes[h]);
+      summary.p999 = percentile(buckets[h], total, 0.999, maxes[h]);
+    }
+    snap.histograms.push_back(summary);
+  }
+  return snap;
+}
+
+std::string Metrics::Snapshot::toText() const
+{
+  std::ostringstream out;
+  out << "counters:" << std::endl;
+  for (const auto &[name, value] : counters)
+  {
+    out << "  " << std::setw(28) << std::left << name << value << std::endl;
+  }
+  out << "gauges:" << std::endl;
+  for (const auto &[name, value] : gauges)
+  {
+    out << "  " << std::setw(28) << std::left << name << value << std::endl;
+  }
+  out << "histograms:" << std::endl;
+  for (const auto &h : histograms)
+  {
+    out << "  " << std::setw(28) << std::left << h.name
+        << "count=" << h.count
+        << " mean=" << h.mean
+        << " min=" << h.min
+        << " p50=" << h.p50
+        << " p90=" << h.p90
+        << " p99=" << h.p99
+        << " p999=" << h.p999
+        << " max=" << h.max << std::endl;
+  }
+  return out.str();
+}
+
+std::string Metrics::Snapshot::toJson() const
+{
+  std::ostringstream out;
+  out << "{\"counters\":{";
+  for (size_t i = 0; i < counters.size(); i++)
+  {
+    out << (i ? "," : "") << "\"" << counters[i].first << "\":" << counters[i].second;
+  }
+  out << "},\"gauges\":{";
+  for (size_t i = 0; i < gauges.size(); i++)
+  {
+    out << (i ? "," : "") << "\"" << gauges[i].first << "\":" << gauges[i].second;
+  }
+  out << "},\"histograms\":{";
+  for (size_t i = 0; i < histograms.size(); i++)
+  {
+    const auto &h = histograms[i];
+    out << (i ? "," : "") << "\"" << h.name << "\":{"
+        << "\"count\":" << h.count
+        << ",\"sum\":" << h.sum
+        << ",\"mean\":" << h.mean
+        << ",\"min\":" << h.min
+        << ",\"p50\":" << h.p50
+        << ",\"p90\":" << h.p90
+        << ",\"p99\":" << h.p99
+        << ",\"p999\":" << h.p999
+        << ",\"max\":" << h.max << "}";
+  }
+  out << "}}";
+  return out.str();
+}
+
+const char *Metrics::counterName(Counter c)
+{
+  switch (c)
+  {
+  case COLLAB_SIMILARITY_HIT:
+    return "collab_similarity_hit";
+  case COLLAB_SIMILARITY_MISS:
+    return "collab_similarity_miss";
+  case COLLAB_CACHE_EVICTIONS:
+    return "collab_cache_evictions";
+  case CONTENT_SIMILARITY_HIT:
+    return "content_similarity_hit";
+  case CONTENT_SIMILARITY_MISS:
+    return "content_similarity_miss";
+  case CONTENT_CACHE_EVICTIONS:
+    return "content_cache_evictions";
+  case PAGERANK_RUNS:
+    return "pagerank_runs";
+  case COLLAB_REQUESTS:
+    return "collab_requests";
+  case CONTENT_REQUESTS:
+    return "content_requests";
+  case HYBRID_REQUESTS:
+    return "hybrid_requests";
+  case RATING_EVENTS_APPLIED:
+    return "rating_events_applied";
+  case RATING_LOG_FAILURES:
+    return "rating_log_failures";
+  case HYBRID_DEGRADED:
+    return "hybrid_degraded";
+  case HYBRID_POPULARITY_FALLBACKS:
+    return "hybrid_popularity_fallbacks";
+  case POPULARITY_LIST_BUILDS:
+    return "popularity_list_builds";
+  case RESULT_CACHE_HIT:
+    return "result_cache_hit";
+  case RESULT_CACHE_MISS:
+    return "result_cache_miss";
+  case SERVER_REQUESTS:
+    return "server_requests";
+  case SERVER_OVERLOADED:
+    return "server_overloaded";
+  case SIMILARITY_SPILL_RUNS:
+    return "similarity_spill_runs";
+  default:
+    return "unknown";
+  }
+}
+
+const char *Metrics::histogramName(Histogram h)
+{
+  switch (h)
+  {
+  case PAGERANK_NS:
+    return "pagerank_ns";
+  case COLLAB_REQUEST_NS:
+    return "collab_request_ns";
+  case CONTENT_REQUEST_NS:
+    return "content_request_ns";
+  case HYBRID_REQUEST_NS:
+    return "hybrid_request_ns";
+  case HYBRID_COLLAB_STAGE_NS:
+    return "hybrid_collab_stage_ns";
+  case HYBRID_CONTENT_STAGE_NS:
+    return "hybrid_content_stage_ns";
+  case HYBRID_RANKING_STAGE_NS:
+    return "hybrid_ranking_stage_ns";
+  case COLLAB_NEIGHBOR_CANDIDATES:
+    return "collab_neighbor_candidates";
+  case HYBRID_CANDIDATES:
+    return "hybrid_candidates";
+  case RATING_BATCH_SIZE:
+    return "rating_batch_size";
+  case SERVER_BATCH_SIZE:
+    return "server_batch_size";
+  case SERVER_QUEUE_NS:
+    return "server_queue_ns";
+  default:
+    return "unknown";
+  }
+}
+
+const char *Metrics::gaugeName(Gauge g)
+{
+  switch (g)
+  {
+  case PAGERANK_ITERATIONS:
+    return "pagerank_iterations";
+  case PAGERANK_RESIDUAL:
+    return "pagerank_residual";
+  default:
+    return "unknown";
+  }
+}
@@ -0,0 +1,177 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lightweight process-wide metrics registry.
+//
+// Every thread writes into its own slot of counters and histograms, so the
+// hot path is a thread_local lookup plus an uncontended relaxed store (no
+// locks, no shared cache lines). Slots are merged only when a snapshot is
+// taken. When a thread exits its values are folded into a retired slot so
+// short-lived worker threads (preComputeSimilarities) are not lost.
+class Metrics
+{
+public:
+  enum Counter
+  {
+    COLLAB_SIMILARITY_HIT,
+    COLLAB_SIMILARITY_MISS,
+    COLLAB_CACHE_EVICTIONS,
+    CONTENT_SIMILARITY_HIT,
+    CONTENT_SIMILARITY_MISS,
+    CONTENT_CACHE_EVICTIONS,
+    PAGERANK_RUNS,
+    COLLAB_REQUESTS,
+    CONTENT_REQUESTS,
+    HYBRID_REQUESTS,
+    RATING_EVENTS_APPLIED,
+    RATING_LOG_FAILURES,
+    HYBRID_DEGRADED,
+    HYBRID_POPULARITY_FALLBACKS,
+    POPULARITY_LIST_BUILDS,
+    RESULT_CACHE_HIT,
+    RESULT_CACHE_MISS,
+    SERVER_REQUESTS,
+    SERVER_OVERLOADED,
+    SIMILARITY_SPILL_RUNS,
+    COUNTER_COUNT
+  };
+
+  enum Histogram
+  {
+    PAGERANK_NS,
+    COLLAB_REQUEST_NS,
+    CONTENT_REQUEST_NS,
+    HYBRID_REQUEST_NS,
+    HYBRID_COLLAB_STAGE_NS,
+    HYBRID_CONTENT_STAGE_NS,
+    HYBRID_RANKING_STAGE_NS,
+    COLLAB_NEIGHBOR_CANDIDATES,
+    HYBRID_CANDIDATES,
+    RATING_BATCH_SIZE,
+    SERVER_BATCH_SIZE,
+    SERVER_QUEUE_NS,
+    HISTOGRAM_COUNT
+  };
+
+  enum Gauge
+  {
+    PAGERANK_ITERATIONS,
+    PAGERANK_RESIDUAL,
+    GAUGE_COUNT
+  };
+
+  // Log-linear buckets: values below 2^SUB_BUCKET_BITS are exact, larger
+  // values keep SUB_BUCKET_BITS of precision (~6% relative error).
+  static constexpr int SUB_BUCKET_BITS = 4;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr int BUCKET_COUNT = SUB_BUCKETS + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+  struct HistogramSummary
+  {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+    double mean = 0.0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+  };
+
+  struct Snapshot
+  {
+    std::vector<std::pair<std::string, uint64_t>> counters;
+    std::vector<std::pair<std::string, double>> gauges;
+    std::vector<HistogramSummary> histograms;
+
+    uint64_t counter(Counter c) const { return counters[c].second; }
+    double gauge(Gauge g) const { return gauges[g].second; }
+    const HistogramSummary &histogram(Histogram h) const { return histograms[h]; }
+
+    std::string toText() const;
+    std::string toJson() const;
+  };
+
+  // Hot-path recording
+  static void increment(Counter c, uint64_t n = 1);
+  static void record(Histogram h, uint64_t value);
+  static void setGauge(Gauge g, double value);
+
+  // Merge all thread slots into a point-in-time view
+  static Snapshot snapshot();
+
+  static const char *counterName(Counter c);
+  static const char *histogramName(Histogram h);
+  static const char *gaugeName(Gauge g);
+
+  static int bucketIndex(uint64_t value);
+  static uint64_t bucketLowerBound(int bucket);
+  static uint64_t bucketUpperBound(int bucket);
+
+  // Records the lifetime of the scope into a histogram in nanoseconds
+  class ScopedTimer
+  {
+  private:
+    Histogram histogram;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    explicit ScopedTimer(Histogram h)
+        : histogram(h), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { Metrics::record(histogram, elapsedNs()); }
+
+    uint64_t elapsedNs() const
+    {
+      return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count());
+    }
+  };
+
+  // Accumulates time over several disjoint intervals (e.g. one stage spread
+  // across a scoring loop) and records the total once
+  class StageTimer
+  {
+  private:
+    Histogram histogram;
+    uint64_t totalNs = 0;
+
+  public:
+    explicit StageTimer(Histogram h) : histogram(h) {}
+    ~StageTimer() { Metrics::record(histogram, totalNs); }
+
+    void add(std::chrono::steady_clock::duration d)
+    {
+      totalNs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    }
+  };
+
+  struct HistogramData
+  {
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> min{UINT64_MAX};
+    std::atomic<uint64_t> max{0};
+  };
+
+  struct ThreadSlot
+  {
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    std::array<HistogramData, HISTOGRAM_COUNT> histograms;
+  };
+
+private:
+  static ThreadSlot &localSlot();
+};
+
+#endif
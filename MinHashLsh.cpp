@@ -0,0 +1,146 @@
+#include "MinHashLsh.h"
+#include "Trace.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+  // splitmix64 finalizer: a cheap, well-mixed 64-bit permutation
+  uint64_t mix64(uint64_t x)
+  {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+  }
+}
+
+std::vector<uint64_t> MinHashLsh::signature(const std::vector<std::pair<int, float>> &ratings) const
+{
+  size_t hashCount = static_cast<size_t>(options.bands) * options.rowsPerBand;
+  std::vector<uint64_t> result(hashCount, UINT64_MAX);
+  for (size_t h = 0; h < hashCount; h++)
+  {
+    // One independent permutation of item ids per signature row
+    uint64_t salt = mix64(options.seed * 0x100000001B3ull + h);
+    uint64_t &minimum = result[h];
+    for (const auto &[movieId, _] : ratings)
+    {
+      minimum = std::min(minimum, mix64(static_cast<uint32_t>(movieId) ^ salt));
+    }
+  }
+  return result;
+}
+
+std::vector<std::pair<int, int>> MinHashLsh::candidatePairs(const BipartiteGraph &graph, int numThreads) const
+{
+  TRACE_SPAN("MinHashLsh::candidatePairs");
+  std::vector<int> users;
+  for (const auto &[userId, ratings] : graph.getUserItems())
+  {
+    if (!ratings.empty())
+      users.push_back(userId);
+  }
+  std::sort(users.begin(), users.end());
+
+  // Signatures, one row of hashCount values per user
+  size_t hashCount = static_cast<size_t>(options.bands) * options.rowsPerBand;
+  std::vector<uint64_t> signatures(users.size() * hashCount);
+  auto sign = [&](size_t start, size_t end)
+  {
+    for (size_t u = start; u < end; u++)
+    {
+      auto row = signature(graph.getUserItems().at(users[u]));
+      std::copy(row.begin(), row.end(), signatures.begin() + u * hashCount);
+    }
+  };
+  numThreads = std::max(1, numThreads);
+  size_t perThread = (users.size() + numThreads - 1) / numThreads;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; i++)
+  {
+    size_t start = i * perThread;
+    size_t end = std::min(start + perThread, users.size());
+    if (start < end)
+      threads.emplace_back(sign, start, end);
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  // Bucket users by each band's rows and pair up bucket members
+  std::vector<uint64_t> pairKeys;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+  for (int band = 0; band < options.bands; band++)
+  {
+    buckets.clear();
+    size_t offset = static_cast<size_t>(band) * options.rowsPerBand;
+    for (size_t u = 0; u < users.size(); u++)
+    {
+      uint64_t key = static_cast<uint64_t>(band);
+      for (int r = 0; r < options.rowsPerBand; r++)
+      {
+        key = mix64(key ^ signatures[u * hashCount + offset + r]);
+      }
+      buckets[key].push_back(static_cast<uint32_t>(u));
+    }
+
+    for (const auto &[_, members] : buckets)
+    {
+      for (size_t i = 0; i < members.size(); i++)
+      {
+        size_t last = std::min(members.size(), i + 1 + options.maxBucketSize);
+        for (size_t j = i + 1; j < last; j++)
+        {
+          // Members are in ascending user order, so users[i] < users[j]
+          pairKeys.push_back((static_cast<uint64_t>(members[i]) << 32) | members[j]);
+        }
+      }
+    }
+  }
+
+  std::sort(pairKeys.begin(), pairKeys.end());
+  pairKeys.erase(std::unique(pairKeys.begin(), pairKeys.end()), pairKeys.end());
+
+  std::vector<std::pair<int, int>> pairs;
+  pairs.reserve(pairKeys.size());
+  for (uint64_t key : pairKeys)
+  {
+    pairs.push_back({users[key >> 32], users[key & 0xFFFFFFFF]});
+  }
+  return pairs;
+}
+
+double MinHashLsh::recallAtK(const ModelSnapshot::NeighborLists &exact,
+                             const ModelSnapshot::NeighborLists &approx, size_t k)
+{
+  double total = 0.0;
+  size_t users = 0;
+  for (const auto &[userId, neighbors] : exact)
+  {
+    size_t expected = std::min(k, neighbors.size());
+    if (expected == 0)
+      continue;
+
+    std::unordered_set<int> found;
+    auto it = approx.find(userId);
+    if (it != approx.end())
+    {
+      for (size_t i = 0; i < std::min(k, it->second.size()); i++)
+      {
+        found.insert(it->second[i].first);
+      }
+    }
+
+    size_t hits = 0;
+    for (size_t i = 0; i < expected; i++)
+    {
+      hits += found.count(neighbors[i].first);
+    }
+    total += static_cast<double>(hits) / expected;
+    users++;
+  }
+  return users > 0 ? total / users : 1.0;
+}
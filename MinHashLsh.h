@@ -0,0 +1,59 @@
+#ifndef MINHASHLSH_H
+#define MINHASHLSH_H
+
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "BipartiteGraph.h"
+#include "ModelSnapshot.h"
+
+// Candidate user pairs for approximate neighbor search.
+//
+// Each user's rated-item set is summarized by a MinHash signature of
+// bands * rowsPerBand values; two users agree on any one value with
+// probability equal to the Jaccard similarity J of their item sets. The
+// signature is cut into bands, and users whose rows agree on a whole band
+// land in the same bucket of that band's table. A pair becomes a candidate
+// if it shares a bucket in any band, which happens with probability
+//
+//   1 - (1 - J^rowsPerBand)^bands
+//
+// More rows per band make buckets more selective (fewer candidates, lower
+// recall); more bands give similar pairs more chances to meet (higher
+// recall, more signature work).
+class MinHashLsh
+{
+public:
+  struct Options
+  {
+    int bands = 16;
+    int rowsPerBand = 4;
+    uint64_t seed = 1;
+    // Buckets larger than this (very common item sets) only pair each user
+    // with its next maxBucketSize neighbors in the bucket, so one hot
+    // bucket cannot turn the search back into all-pairs
+    size_t maxBucketSize = 256;
+  };
+
+  explicit MinHashLsh(Options options) : options(options) {}
+
+  // Signature of one item set
+  std::vector<uint64_t> signature(const std::vector<std::pair<int, float>> &ratings) const;
+
+  // Distinct candidate pairs (smaller id first) over every user with at
+  // least one rating
+  std::vector<std::pair<int, int>> candidatePairs(
+      const BipartiteGraph &graph,
+      int numThreads = std::thread::hardware_concurrency()) const;
+
+  // Fraction of each user's exact top-k neighbors present in the
+  // approximate top-k, averaged over users that have any exact neighbors
+  static double recallAtK(const ModelSnapshot::NeighborLists &exact,
+                          const ModelSnapshot::NeighborLists &approx, size_t k);
+
+private:
+  Options options;
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "ModelSnapshot.h"
+#include "PageRank.h"
+#include "Collabrative.h"
+#include "Content.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  const char SNAPSHOT_MAGIC[8] = {'R', 'E', 'C', 'S', 'N', 'A', 'P', '\0'};
+
+  // Flattens neighbor lists into an index plus one contiguous entry run,
+  // sorted by id so snapshots of the same model are byte-identical
+  void flattenLists(const ModelSnapshot::NeighborLists &lists,
+                    std::vector<ModelSnapshot::ListIndex> &index,
+                    std::vector<ModelSnapshot::NeighborEntry> &entries)
+  {
+    std::vector<int> ids;
+    ids.reserve(lists.size());
+    for (const auto &[id, _] : lists)
+      ids.push_back(id);
+    std::sort(ids.begin(), ids.end());
+
+    for (int id : ids)
+    {
+      const auto &list = lists.at(id);
+      index.push_back({id, static_cast<uint32_t>(list.size()), entries.size()});
+      for (const auto &[neighborId, similarity] : list)
+      {
+        entries.push_back({neighborId, similarity});
+      }
+    }
+  }
+}
+
+ModelSnapshot::~ModelSnapshot()
+{
+  close();
+}
+
+bool ModelSnapshot::save(const std::string &path, const BipartiteGraph &graph,
+                         const PageRank &pageRank, const Collaborative &collaborative,
+                         const Content &content)
+{
+  std::vector<RankEntry> rankEntries;
+  for (const auto &[userId, rank] : pageRank.getRanks())
+  {
+    rankEntries.push_back({userId, 0, rank});
+  }
+  std::sort(rankEntries.begin(), rankEntries.end(),
+            [](const auto &a, const auto &b)
+            { return a.userId < b.userId; });
+
+  std::vector<ListIndex> userIndex, itemIndex;
+  std::vector<NeighborEntry> entries;
+  flattenLists(collaborative.getNeighborLists(), userIndex, entries);
+  // Item list offsets continue after the user entries in the same run
+  flattenLists(content.getItemNeighbors(), itemIndex, entries);
+
+  Header header{};
+  std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.version = FORMAT_VERSION;
+  header.headerSize = sizeof(Header);
+  header.fingerprint = graph.fingerprint();
+  header.rankCount = rankEntries.size();
+  header.userListCount = userIndex.size();
+  header.itemListCount = itemIndex.size();
+  header.entryCount = entries.size();
+  header.fileSize = sizeof(Header) +
+                    rankEntries.size() * sizeof(RankEntry) +
+                    (userIndex.size() + itemIndex.size()) * sizeof(ListIndex) +
+                    entries.size() * sizeof(NeighborEntry);
+
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file)
+      return false;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(rankEntries.data()), rankEntries.size() * sizeof(RankEntry));
+    file.write(reinterpret_cast<const char *>(userIndex.data()), userIndex.size() * sizeof(ListIndex));
+    file.write(reinterpret_cast<const char *>(itemIndex.data()), itemIndex.size() * sizeof(ListIndex));
+    file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(NeighborEntry));
+    if (!file)
+    {
+      std::remove(tmpPath.c_str());
+      return false;
+    }
+  }
+  return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+bool ModelSnapshot::open(const std::string &path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+
+  // Each section is checked against what is left of the file by division,
+  // so counts from a corrupt header cannot overflow the size arithmetic
+  size_t remaining = size - sizeof(Header);
+  auto section = [&](uint64_t count, size_t elementSize)
+  {
+    if (count > remaining / elementSize)
+      return false;
+    remaining -= count * elementSize;
+    return true;
+  };
+
+  const Header *h = static_cast<const Header *>(addr);
+  bool valid = std::memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 &&
+               h->version == FORMAT_VERSION &&
+               h->headerSize == sizeof(Header) &&
+               h->fileSize == size &&
+               section(h->rankCount, sizeof(RankEntry)) &&
+               section(h->userListCount, sizeof(ListIndex)) &&
+               section(h->itemListCount, sizeof(ListIndex)) &&
+               section(h->entryCount, sizeof(NeighborEntry)) &&
+               remaining == 0;
+  if (!valid)
+  {
+    munmap(addr, size);
+    return false;
+  }
+
+  mapping = addr;
+  mappingSize = size;
+  header = h;
+
+  const char *base = static_cast<const char *>(addr) + sizeof(Header);
+  rankEntries = reinterpret_cast<const RankEntry *>(base);
+  base += h->rankCount * sizeof(RankEntry);
+  userIndex = reinterpret_cast<const ListIndex *>(base);
+  base += h->userListCount * sizeof(ListIndex);
+  itemIndex = reinterpret_cast<const ListIndex *>(base);
+  base += h->itemListCount * sizeof(ListIndex);
+  entries = reinterpret_cast<const NeighborEntry *>(base);
+
+  // Every list must stay inside the entry run
+  auto listsInBounds = [&](const ListIndex *index, uint64_t count)
+  {
+    for (uint64_t i = 0; i < count; i++)
+    {
+      if (index[i].offset > h->entryCount || index[i].count > h->entryCount - index[i].offset)
+        return false;
+    }
+    return true;
+  };
+  if (!listsInBounds(userIndex, h->userListCount) || !listsInBounds(itemIndex, h->itemListCount))
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void ModelSnapshot::close()
+{
+  if (mapping)
+  {
+    munmap(mapping, mappingSize);
+  }
+  mapping = nullptr;
+  mappingSize = 0;
+  header = nullptr;
+  rankEntries = nullptr;
+  userIndex = nullptr;
+  itemIndex = nullptr;
+  entries = nullptr;
+}
+
+bool ModelSnapshot::matches(const BipartiteGraph &graph) const
+{
+  return isOpen() && header->fingerprint == graph.fingerprint();
+}
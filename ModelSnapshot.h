@@ -0,0 +1,117 @@
+#ifndef MODELSNAPSHOT_H
+#define MODELSNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "BipartiteGraph.h"
+
+class PageRank;
+class Collaborative;
+class Content;
+
+// Binary, versioned snapshot of the computed model (PageRank scores, user
+// neighbor lists, each item's top content neighbors), tagged with the
+// fingerprint of the graph it was computed from.
+//
+// Layout (native endianness, every section 8-byte aligned):
+//   Header
+//   RankEntry[rankCount]
+//   ListIndex[userListCount], ListIndex[itemListCount]
+//   NeighborEntry[...] for all user lists, then all item lists
+//
+// open() maps the file read-only; the accessors below read straight out of
+// the mapping, so a snapshot costs no parsing beyond header validation.
+class ModelSnapshot
+{
+public:
+  static constexpr uint32_t FORMAT_VERSION = 2;
+
+  struct RankEntry
+  {
+    int32_t userId;
+    int32_t reserved;
+    double rank;
+  };
+
+  struct NeighborEntry
+  {
+    int32_t id;
+    float similarity;
+  };
+
+  struct ListIndex
+  {
+    int32_t id;
+    uint32_t count;
+    uint64_t offset; // in NeighborEntry units from the start of the entries
+  };
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fingerprint;
+    uint64_t rankCount;
+    uint64_t userListCount;
+    uint64_t itemListCount;
+    uint64_t entryCount;
+    uint64_t fileSize;
+  };
+
+  using NeighborLists = std::unordered_map<int, std::vector<std::pair<int, float>>>;
+
+  ModelSnapshot() = default;
+  ~ModelSnapshot();
+  ModelSnapshot(const ModelSnapshot &) = delete;
+  ModelSnapshot &operator=(const ModelSnapshot &) = delete;
+
+  // Writes the model computed for `graph`; the file is written to a
+  // temporary name and renamed into place so readers never see a torn file
+  static bool save(const std::string &path, const BipartiteGraph &graph,
+                   const PageRank &pageRank, const Collaborative &collaborative,
+                   const Content &content);
+
+  // Maps and validates a snapshot file; returns false (and stays closed) on
+  // a missing, truncated or wrong-version file
+  bool open(const std::string &path);
+  void close();
+
+  bool isOpen() const { return header != nullptr; }
+  uint64_t getFingerprint() const { return header ? header->fingerprint : 0; }
+
+  // True if the snapshot was computed from exactly this graph
+  bool matches(const BipartiteGraph &graph) const;
+
+  size_t rankCount() const { return header ? header->rankCount : 0; }
+  const RankEntry *ranks() const { return rankEntries; }
+
+  template <typename Fn>
+  void forEachUserList(Fn &&fn) const { forEachList(userIndex, header ? header->userListCount : 0, fn); }
+
+  template <typename Fn>
+  void forEachItemList(Fn &&fn) const { forEachList(itemIndex, header ? header->itemListCount : 0, fn); }
+
+private:
+  void *mapping = nullptr;
+  size_t mappingSize = 0;
+  const Header *header = nullptr;
+  const RankEntry *rankEntries = nullptr;
+  const ListIndex *userIndex = nullptr;
+  const ListIndex *itemIndex = nullptr;
+  const NeighborEntry *entries = nullptr;
+
+  // fn(id, const NeighborEntry *begin, size_t count)
+  template <typename Fn>
+  void forEachList(const ListIndex *index, uint64_t count, Fn &fn) const
+  {
+    for (uint64_t i = 0; i < count; i++)
+    {
+      fn(index[i].id, entries + index[i].offset, static_cast<size_t>(index[i].count));
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "ModelStore.h"
+#include "Trace.h"
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+
+ModelVersion::ModelVersion(BipartiteGraph bg, int numThreads)
+    : graph(std::move(bg)),
+      pageRank(graph),
+      collaborative(graph, pageRank),
+      content(graph),
+      hybrid(graph, collaborative, content, pageRank)
+{
+  // Computed here, off to the side, so no reader waits on the lazy path
+  pageRank.calculatePageRanks();
+  collaborative.preComputeSimilarities(numThreads);
+  collaborative.preComputePopularity();
+  content.preComputePopularity();
+}
+
+namespace
+{
+  size_t distinctUsers(const std::vector<std::pair<int, int>> &changes)
+  {
+    std::unordered_set<int> users;
+    for (const auto &[userId, _] : changes)
+      users.insert(userId);
+    return users.size();
+  }
+}
+
+ModelVersion::ModelVersion(BipartiteGraph bg, const ModelVersion &previous,
+                           const std::vector<std::pair<int, int>> &changes)
+    : graph(std::move(bg)),
+      pageRank(graph, previous.pageRank, distinctUsers(changes)),
+      collaborative(graph, pageRank, previous.collaborative),
+      content(graph, previous.content),
+      hybrid(graph, collaborative, content, pageRank)
+{
+  // The previous ranks serve until enough users have changed; then the
+  // refresh starts from them
+  if (pageRank.isStale() || !pageRank.isComputed())
+    pageRank.calculatePageRanks();
+  if (!changes.empty())
+    collaborative.onRatingsChanged(changes);
+  collaborative.preComputePopularity();
+  content.preComputePopularity();
+}
+
+void ModelVersion::reportMemory(MemoryAccounting::Report &report) const
+{
+  graph.reportMemory(report);
+  pageRank.reportMemory(report);
+  collaborative.reportMemory(report);
+  content.reportMemory(report);
+  hybrid.reportMemory(report);
+}
+
+ModelStore::ModelStore(BipartiteGraph initial, int numThreads)
+    : numThreads(std::max(1, numThreads))
+{
+  current.publish(std::make_unique<ModelVersion>(std::move(initial), this->numThreads));
+}
+
+uint64_t ModelStore::apply(const std::vector<RatingEvent> &events)
+{
+  TRACE_SPAN("ModelStore::apply");
+  std::lock_guard<std::mutex> lock(writerMutex);
+
+  // Only writers publish, so the current version cannot be retired while
+  // we hold writerMutex
+  const ModelVersion &previous = *current.get();
+  BipartiteGraph next = previous.graph;
+
+  std::vector<std::pair<int, int>> changes;
+  changes.reserve(events.size());
+  for (const auto &event : events)
+  {
+    bool applied = event.type == RatingEvent::DELETE
+                       ? next.removeRating(event.userId, event.movieId)
+                       : next.addRating(event.userId, event.movieId, event.rating);
+    if (applied)
+      changes.push_back({event.userId, event.movieId});
+  }
+
+  return current.publish(std::make_unique<ModelVersion>(std::move(next), previous, changes));
+}
+
+uint64_t ModelStore::update(const std::function<void(BipartiteGraph &)> &mutate)
+{
+  TRACE_SPAN("ModelStore::update");
+  std::lock_guard<std::mutex> lock(writerMutex);
+
+  BipartiteGraph next = current.get()->graph;
+  mutate(next);
+  return current.publish(std::make_unique<ModelVersion>(std::move(next), numThreads));
+}
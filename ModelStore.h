@@ -0,0 +1,94 @@
+#ifndef MODELSTORE_H
+#define MODELSTORE_H
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BipartiteGraph.h"
+#include "Collabrative.h"
+#include "Content.h"
+#include "Epoch.h"
+#include "Hybrid.h"
+#include "PageRank.h"
+#include "RatingLog.h"
+
+// One immutable version of the graph and every model built from it. The
+// engines reference the graph inside the same version, so a reader holding
+// a version sees a consistent graph and models for as long as it holds it.
+struct ModelVersion
+{
+  BipartiteGraph graph;
+  PageRank pageRank;
+  Collaborative collaborative;
+  Content content;
+  Hybrid hybrid;
+
+  // Builds every model from scratch
+  ModelVersion(BipartiteGraph bg, int numThreads);
+
+  // Builds the next version from the previous one, sharing whatever the
+  // changes leave alone (see CopyOnWrite.h): similarities carry over and
+  // only users in changes are recomputed, and PageRank keeps the previous
+  // ranks until they are stale
+  ModelVersion(BipartiteGraph bg, const ModelVersion &previous,
+               const std::vector<std::pair<int, int>> &changes);
+
+  // Every engine's structures, graph first. Cache budgets are process-wide
+  // and a version built from a previous one takes over its similarity
+  // caches' charges, so storage the two share is charged once. This report
+  // still counts shared storage in both versions
+  void reportMemory(MemoryAccounting::Report &report) const;
+
+  ModelVersion(const ModelVersion &) = delete;
+  ModelVersion &operator=(const ModelVersion &) = delete;
+};
+
+// Serves reads from the current ModelVersion while writers build the next.
+//
+// Readers never take a lock: read() pins an epoch and loads the current
+// version pointer. Writers copy the current graph, apply their changes to
+// the copy, build the next version off to the side and publish it with an
+// atomic pointer swap. The copy shares the graph's lists and the engines'
+// caches with the current version, so a batch copies only what it changes. The replaced version is freed once its last reader
+// is done. Writers are serialized among themselves.
+class ModelStore
+{
+private:
+  Versioned<ModelVersion> current;
+  std::mutex writerMutex;
+  int numThreads;
+
+public:
+  // Keeps the version it was created from alive for its whole lifetime
+  class Reader
+  {
+  private:
+    Epoch::Guard guard;
+    const ModelVersion *version;
+
+  public:
+    explicit Reader(const Versioned<ModelVersion> &versioned) : version(versioned.get()) {}
+
+    const ModelVersion &operator*() const { return *version; }
+    const ModelVersion *operator->() const { return version; }
+  };
+
+  explicit ModelStore(BipartiteGraph initial,
+                      int numThreads = std::thread::hardware_concurrency());
+
+  Reader read() const { return Reader(current); }
+
+  uint64_t getVersion() const { return current.getVersion(); }
+
+  // Applies rating events to a copy of the current graph and publishes a
+  // version whose models are updated incrementally. Returns the new
+  // version number
+  uint64_t apply(const std::vector<RatingEvent> &events);
+
+  // Arbitrary graph changes (new users, new items): publishes a version
+  // rebuilt from scratch
+  uint64_t update(const std::function<void(BipartiteGraph &)> &mutate);
+};
+
+#endif
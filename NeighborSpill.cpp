@@ -0,0 +1,163 @@
+#include "NeighborSpill.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <unordered_set>
+#include <unistd.h>
+
+namespace
+{
+  bool ranksBefore(const NeighborSpill::Entry &a, const NeighborSpill::Entry &b)
+  {
+    if (a.userId != b.userId)
+      return a.userId < b.userId;
+    if (a.similarity != b.similarity)
+      return a.similarity > b.similarity;
+    return a.neighborId < b.neighborId;
+  }
+
+  // Sequential reader over one run, refilled a chunk at a time
+  class RunReader
+  {
+  private:
+    std::ifstream file;
+    std::vector<NeighborSpill::Entry> chunk;
+    size_t position = 0;
+    size_t filled = 0;
+
+  public:
+    RunReader(const std::string &path, size_t chunkEntries)
+        : file(path, std::ios::binary), chunk(std::max<size_t>(1, chunkEntries)) {}
+
+    bool ok() const { return static_cast<bool>(file) || file.eof(); }
+
+    // False at the end of the run
+    bool next(NeighborSpill::Entry &entry)
+    {
+      if (position == filled)
+      {
+        file.read(reinterpret_cast<char *>(chunk.data()), chunk.size() * sizeof(NeighborSpill::Entry));
+        filled = static_cast<size_t>(file.gcount()) / sizeof(NeighborSpill::Entry);
+        position = 0;
+        if (filled == 0)
+          return false;
+      }
+      entry = chunk[position++];
+      return true;
+    }
+  };
+}
+
+NeighborSpill::NeighborSpill(std::string directory, size_t memoryBudget)
+    : directory(std::move(directory)),
+      bufferEntries(std::max<size_t>(1, memoryBudget / sizeof(Entry)))
+{
+}
+
+NeighborSpill::~NeighborSpill()
+{
+  for (const auto &path : runs)
+  {
+    std::remove(path.c_str());
+  }
+}
+
+bool NeighborSpill::add(int userId, const std::vector<std::pair<int, float>> &neighbors)
+{
+  for (const auto &[neighborId, similarity] : neighbors)
+  {
+    buffer.push_back({userId, neighborId, similarity});
+    if (buffer.size() >= bufferEntries && !spill())
+      return false;
+  }
+  return true;
+}
+
+bool NeighborSpill::spill()
+{
+  if (buffer.empty())
+    return true;
+
+  static std::atomic<uint64_t> nextRun{0};
+  std::string path = directory + "/neighbors-" + std::to_string(::getpid()) + "-" +
+                     std::to_string(nextRun++) + ".run";
+  std::sort(buffer.begin(), buffer.end(), ranksBefore);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(Entry));
+  file.close();
+  runs.push_back(path);
+  if (!file)
+    return false;
+
+  Metrics::increment(Metrics::SIMILARITY_SPILL_RUNS);
+  buffer.clear();
+  return true;
+}
+
+bool NeighborSpill::merge(size_t k, const std::function<void(int, std::vector<std::pair<int, float>> &)> &fn)
+{
+  if (!spill())
+    return false;
+  // The write buffer is done with; its budget goes to the readers
+  std::vector<Entry>().swap(buffer);
+
+  std::vector<std::unique_ptr<RunReader>> readers;
+  size_t chunkEntries = bufferEntries / std::max<size_t>(1, runs.size());
+  for (const auto &path : runs)
+  {
+    readers.push_back(std::make_unique<RunReader>(path, chunkEntries));
+    if (!readers.back()->ok())
+      return false;
+  }
+
+  // Smallest entry on top: the order runs were sorted in
+  auto later = [](const std::pair<Entry, size_t> &a, const std::pair<Entry, size_t> &b)
+  { return ranksBefore(b.first, a.first); };
+  std::priority_queue<std::pair<Entry, size_t>, std::vector<std::pair<Entry, size_t>>, decltype(later)> heads(later);
+  for (size_t r = 0; r < readers.size(); r++)
+  {
+    Entry entry;
+    if (readers[r]->next(entry))
+      heads.push({entry, r});
+  }
+
+  std::vector<std::pair<int, float>> list;
+  std::unordered_set<int> listed;
+  int currentUser = 0;
+  bool haveUser = false;
+  while (!heads.empty())
+  {
+    auto [entry, r] = heads.top();
+    heads.pop();
+    Entry following;
+    if (readers[r]->next(following))
+      heads.push({following, r});
+
+    if (!haveUser || entry.userId != currentUser)
+    {
+      if (haveUser)
+        fn(currentUser, list);
+      list.clear();
+      listed.clear();
+      currentUser = entry.userId;
+      haveUser = true;
+    }
+    // Entries arrive best first, so the first k distinct neighbors win
+    if (list.size() < k && listed.insert(entry.neighborId).second)
+      list.push_back({entry.neighborId, entry.similarity});
+  }
+  if (haveUser)
+    fn(currentUser, list);
+
+  for (const auto &reader : readers)
+  {
+    if (!reader->ok())
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef NEIGHBORSPILL_H
+#define NEIGHBORSPILL_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// External-memory collection of per-user neighbor lists.
+//
+// Lists are buffered in memory up to the byte budget, then sorted by
+// (user, similarity descending, neighbor) and written out as a run file of
+// fixed 12-byte records. merge() streams every run through a k-way merge,
+// reading each run in budget-sized chunks, and hands back one top-k list
+// per user in ascending user order. A user's entries may be spread over
+// several runs (partial lists); the merge combines them. Run files are
+// removed when the spill is destroyed.
+class NeighborSpill
+{
+public:
+  struct Entry
+  {
+    int32_t userId;
+    int32_t neighborId;
+    float similarity;
+  };
+
+  NeighborSpill(std::string directory, size_t memoryBudget);
+  ~NeighborSpill();
+
+  NeighborSpill(const NeighborSpill &) = delete;
+  NeighborSpill &operator=(const NeighborSpill &) = delete;
+
+  // Returns false if a run could not be written
+  bool add(int userId, const std::vector<std::pair<int, float>> &neighbors);
+
+  // Takes over a run file written elsewhere (e.g. by another process),
+  // already sorted in run order. It is merged and removed with the others
+  void addRun(const std::string &path) { runs.push_back(path); }
+
+  // Calls fn with each user's best k neighbors (most similar first). A
+  // neighbor listed more than once for a user keeps its best entry.
+  // Returns false if a run could not be written or read back
+  bool merge(size_t k, const std::function<void(int, std::vector<std::pair<int, float>> &)> &fn);
+
+  size_t runCount() const { return runs.size(); }
+
+private:
+  std::string directory;
+  size_t bufferEntries;
+  std::vector<Entry> buffer;
+  std::vector<std::string> runs;
+
+  bool spill();
+};
+
+#endif
@@ -1,11 +1,129 @@
 #include "PageRank.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "ModelSnapshot.h"
 #include <algorithm>
 #include <cmath>
-#include <unordered_set>
 
-PageRank::PageRank(const BipartiteGraph &bg) : graph(bg)
+namespace
 {
-  calculatePageRanks();
+  // Rated-item sets of every user as rows of packed words over the dense
+  // item indices, so the number of movies two users share is an AND plus a
+  // popcount per word
+  struct Incidence
+  {
+    size_t wordsPerRow = 0;
+    std::vector<uint64_t> words;
+
+    const uint64_t *row(size_t i) const { return words.data() + i * wordsPerRow; }
+  };
+
+  Incidence buildIncidence(const BipartiteGraph &graph, const std::vector<int> &users)
+  {
+    Incidence incidence;
+    incidence.wordsPerRow = (graph.getItemCount() + 63) / 64;
+    incidence.words.assign(users.size() * incidence.wordsPerRow, 0);
+    for (size_t i = 0; i < users.size(); i++)
+    {
+      const auto &watched = graph.getWatchedItems(users[i]).getWords();
+      size_t words = std::min(watched.size(), incidence.wordsPerRow);
+      std::copy(watched.begin(), watched.begin() + words,
+                incidence.words.begin() + i * incidence.wordsPerRow);
+    }
+    return incidence;
+  }
+
+  // Catalogs up to 256 items: the whole row is at most four words and the
+  // loop unrolls completely
+  template <size_t W>
+  int sharedFixed(const uint64_t *a, const uint64_t *b)
+  {
+    int count = 0;
+    for (size_t w = 0; w < W; w++)
+      count += __builtin_popcountll(a[w] & b[w]);
+    return count;
+  }
+
+  int sharedBlocked(const uint64_t *a, const uint64_t *b, size_t words)
+  {
+    int count = 0;
+    for (size_t w = 0; w < words; w++)
+      count += __builtin_popcountll(a[w] & b[w]);
+    return count;
+  }
+
+  // Users are processed in tiles so a tile of "other" rows stays in cache
+  // while a tile of users accumulates over it. Each user still adds its
+  // contributions in ascending other-user order
+  constexpr size_t TILE_USERS = 256;
+
+  template <typename SharedCount>
+  void accumulateContributions(const Incidence &incidence, const std::vector<double> &activity,
+                               const std::vector<double> &ratingCounts,
+                               const std::vector<double> &current, std::vector<double> &accumulated,
+                               double damping, SharedCount sharedCount)
+  {
+    size_t count = current.size();
+    for (size_t iBegin = 0; iBegin < count; iBegin += TILE_USERS)
+    {
+      size_t iEnd = std::min(iBegin + TILE_USERS, count);
+      for (size_t jBegin = 0; jBegin < count; jBegin += TILE_USERS)
+      {
+        size_t jEnd = std::min(jBegin + TILE_USERS, count);
+        for (size_t i = iBegin; i < iEnd; i++)
+        {
+          const uint64_t *row = incidence.row(i);
+          double rank = accumulated[i];
+          for (size_t j = jBegin; j < jEnd; j++)
+          {
+            if (j == i)
+              continue;
+            int sharedMovies = sharedCount(row, incidence.row(j));
+            if (sharedMovies > 0)
+            {
+              double contribution = current[j] * sharedMovies / ratingCounts[j];
+              rank += damping * activity[i] * contribution;
+            }
+          }
+          accumulated[i] = rank;
+        }
+      }
+    }
+  }
+}
+
+PageRank::PageRank(const BipartiteGraph &bg) : graph(bg) {}
+
+PageRank::PageRank(const BipartiteGraph &bg, const ModelSnapshot &snapshot) : graph(bg)
+{
+  // Left to compute lazily if the snapshot was built from another graph
+  if (!snapshot.matches(bg))
+    return;
+
+  const auto *entries = snapshot.ranks();
+  auto &loaded = ranks.edit();
+  loaded.reserve(snapshot.rankCount());
+  for (size_t i = 0; i < snapshot.rankCount(); i++)
+  {
+    loaded[entries[i].userId] = entries[i].rank;
+  }
+  version.fetch_add(1, std::memory_order_acq_rel);
+  computed.store(true, std::memory_order_release);
+}
+
+PageRank::PageRank(const BipartiteGraph &bg, const PageRank &previous, size_t changedUsers)
+    : graph(bg)
+{
+  std::lock_guard<std::mutex> lock(previous.computeMutex);
+  ranks = previous.ranks;
+  this->changedUsers = previous.changedUsers + changedUsers;
+  version.store(previous.version.load(std::memory_order_acquire), std::memory_order_relaxed);
+  computed.store(previous.isComputed(), std::memory_order_release);
+}
+
+bool PageRank::isStale() const
+{
+  return changedUsers > STALE_FRACTION * graph.getUserItems().size();
 }
 
 void PageRank::initializeRanks() const
@@ -14,12 +132,16 @@ void PageRank::initializeRanks() const
   if (users.empty())
     return;
 
+  // Users without a previous rank start from the uniform one
   double initialRank = 1.0 / users.size();
-  ranks.clear();
+  std::unordered_map<int, double> initial;
+  initial.reserve(users.size());
   for (const auto &[userId, _] : users)
   {
-    ranks[userId] = initialRank;
+    auto it = ranks->find(userId);
+    initial[userId] = it != ranks->end() ? it->second : initialRank;
   }
+  ranks = CopyOnWrite<std::unordered_map<int, double>>(std::move(initial));
 }
 
 void PageRank::normalizeRanks(std::unordered_map<int, double> &ranks) const
@@ -56,7 +178,30 @@ double PageRank::calculateActivityScore(size_t numRatings, size_t maxRatings) co
   }
 }
 
+void PageRank::ensureComputed() const
+{
+  if (computed.load(std::memory_order_acquire))
+    return;
+  std::lock_guard<std::mutex> lock(computeMutex);
+  if (!computed.load(std::memory_order_relaxed))
+  {
+    computeRanks();
+    changedUsers = 0;
+    version.fetch_add(1, std::memory_order_acq_rel);
+    computed.store(true, std::memory_order_release);
+  }
+}
+
 void PageRank::calculatePageRanks() const
+{
+  std::lock_guard<std::mutex> lock(computeMutex);
+  computeRanks();
+  changedUsers = 0;
+  version.fetch_add(1, std::memory_order_acq_rel);
+  computed.store(true, std::memory_order_release);
+}
+
+void PageRank::computeRanks() const
 {
   const auto &users = graph.getUserItems();
   const auto &items = graph.getItems();
@@ -66,6 +211,10 @@ void PageRank::calculatePageRanks() const
     return;
   }
 
+  TRACE_SPAN("PageRank::calculatePageRanks");
+  Metrics::increment(Metrics::PAGERANK_RUNS);
+  Metrics::ScopedTimer timer(Metrics::PAGERANK_NS);
+
   // Initialize ranks
   initializeRanks();
 
@@ -76,63 +225,79 @@ void PageRank::calculatePageRanks() const
     maxRatings = std::max(maxRatings, userRatings.size());
   }
 
+  // Everything that does not change between iterations, per user in the
+  // graph's dense user order if it has one (GraphOrdering), otherwise in
+  // the users map's order
+  std::vector<int> order = graph.getUserOrder();
+  if (order.empty())
+  {
+    order.reserve(users.size());
+    for (const auto &[userId, _] : users)
+    {
+      order.push_back(userId);
+    }
+  }
+  std::vector<double> activity;
+  std::vector<double> ratingCounts;
+  for (int userId : order)
+  {
+    size_t userRatings = users.at(userId).size();
+    activity.push_back(calculateActivityScore(userRatings, maxRatings));
+    ratingCounts.push_back(static_cast<double>(userRatings));
+  }
+  Incidence incidence = buildIncidence(graph, order);
+
   // Iterative PageRank calculation
+  int iterationsRun = 0;
+  double residual = 0.0;
+  std::vector<double> current(order.size());
+  std::vector<double> accumulated(order.size());
   for (int iteration = 0; iteration < MAX_ITERATIONS; iteration++)
   {
     std::unordered_map<int, double> newRanks;
     double totalDiff = 0.0;
+    iterationsRun++;
 
-    // Calculate new rank for each user
-    for (const auto &[userId, userRatings] : users)
+    // Initialize with damping factor, then add the contribution from other
+    // users through shared movies
+    for (size_t i = 0; i < order.size(); i++)
     {
-      // Get activity score based on number of ratings
-      double activityScore = calculateActivityScore(userRatings.size(), maxRatings);
-
-      // Initialize with damping factor
-      double newRank = (1.0 - DAMPING) / users.size();
-
-      // Create set of movies rated by this user
-      std::unordered_set<int> userMovies;
-      for (const auto &[movieId, _] : userRatings)
-      {
-        if (items.find(movieId) != items.end())
-        {
-          userMovies.insert(movieId);
-        }
-      }
-
-      // Calculate contribution from other users through shared movies
-      for (const auto &[otherId, otherRatings] : users)
-      {
-        if (otherId == userId)
-          continue;
-
-        // Count shared movies
-        int sharedMovies = 0;
-        for (const auto &[movieId, _] : otherRatings)
-        {
-          if (userMovies.count(movieId) > 0)
-          {
-            sharedMovies++;
-          }
-        }
-
-        if (sharedMovies > 0)
-        {
-          double contribution = ranks[otherId] * sharedMovies / otherRatings.size();
-          newRank += DAMPING * activityScore * contribution;
-        }
-      }
+      current[i] = ranks->at(order[i]);
+      accumulated[i] = (1.0 - DAMPING) / users.size();
+    }
+    switch (incidence.wordsPerRow)
+    {
+    case 1:
+      accumulateContributions(incidence, activity, ratingCounts, current, accumulated, DAMPING, sharedFixed<1>);
+      break;
+    case 2:
+      accumulateContributions(incidence, activity, ratingCounts, current, accumulated, DAMPING, sharedFixed<2>);
+      break;
+    case 3:
+      accumulateContributions(incidence, activity, ratingCounts, current, accumulated, DAMPING, sharedFixed<3>);
+      break;
+    case 4:
+      accumulateContributions(incidence, activity, ratingCounts, current, accumulated, DAMPING, sharedFixed<4>);
+      break;
+    default:
+      accumulateContributions(incidence, activity, ratingCounts, current, accumulated, DAMPING,
+                              [words = incidence.wordsPerRow](const uint64_t *a, const uint64_t *b)
+                              { return sharedBlocked(a, b, words); });
+      break;
+    }
 
-      newRanks[userId] = newRank;
-      totalDiff += std::abs(newRank - ranks[userId]);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      newRanks[order[i]] = accumulated[i];
+      totalDiff += std::abs(accumulated[i] - current[i]);
     }
 
     // Normalize new ranks
     normalizeRanks(newRanks);
 
     // Update ranks
-    ranks = std::move(newRanks);
+    ranks = CopyOnWrite<std::unordered_map<int, double>>(std::move(newRanks));
+    residual = totalDiff;
 
     // Check for convergence
     if (totalDiff < CONVERGENCE_THRESHOLD)
@@ -140,10 +305,20 @@ void PageRank::calculatePageRanks() const
       break;
     }
   }
+
+  Metrics::setGauge(Metrics::PAGERANK_ITERATIONS, iterationsRun);
+  Metrics::setGauge(Metrics::PAGERANK_RESIDUAL, residual);
 }
 
 double PageRank::getPageRank(int userId) const
 {
-  auto it = ranks.find(userId);
-  return it != ranks.end() ? it->second : MIN_RANK;
+  ensureComputed();
+  auto it = ranks->find(userId);
+  return it != ranks->end() ? it->second : MIN_RANK;
+}
+
+void PageRank::reportMemory(MemoryAccounting::Report &report) const
+{
+  std::lock_guard<std::mutex> lock(computeMutex);
+  report.add("pagerank.ranks", MemoryAccounting::heapBytes(*ranks));
 }
@@ -1,39 +1,100 @@
 #ifndef PAGERANK_H
 #define PAGERANK_H
 
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <unordered_map>
 #include "BipartiteGraph.h"
+#include "CopyOnWrite.h"
+#include "MemoryAccounting.h"
 
+class ModelSnapshot;
+
+// User influence scores over the rating graph.
+//
+// One instance is meant to be shared by every engine built on the same
+// graph. Ranks are computed on first use rather than at construction, once,
+// and are read without locking afterwards.
+//
+// A model version built from the previous one after a rating batch shares
+// the previous ranks rather than rerunning the iteration: ranks move little
+// with a few changed users. Once the users changed since the last run
+// exceed STALE_FRACTION of all users the ranks are stale, and the next
+// computation starts from the previous ranks, which converges in a few
+// iterations.
 class PageRank
 {
 private:
     const BipartiteGraph &graph;
-    mutable std::unordered_map<int, double> ranks;
+    // Shared with the instance it was carried over from, if any
+    mutable CopyOnWrite<std::unordered_map<int, double>> ranks;
+    // Users whose ratings changed since the ranks were computed
+    mutable size_t changedUsers = 0;
+    mutable std::atomic<bool> computed{false};
+    // Bumped each time the ranks are (re)computed or loaded
+    mutable std::atomic<uint64_t> version{0};
+    mutable std::mutex computeMutex;
 
     // PageRank parameters
     static constexpr double DAMPING = 0.85;
     static constexpr int MAX_ITERATIONS = 50;
     static constexpr double CONVERGENCE_THRESHOLD = 0.0001;
     static constexpr double MIN_RANK = 0.0001;
+    static constexpr double STALE_FRACTION = 0.05;
 
     // Activity thresholds
     static constexpr double CORE_ACTIVITY_THRESHOLD = 0.5;
     static constexpr double ACTIVITY_BOOST = 3.0;
 
     // Helper methods
+    // Starts from the current ranks where there are any
     void initializeRanks() const;
     void normalizeRanks(std::unordered_map<int, double> &ranks) const;
     double calculateActivityScore(size_t numRatings, size_t maxRatings) const;
+    void computeRanks() const;
+    void ensureComputed() const;
 
 public:
     explicit PageRank(const BipartiteGraph &bg);
 
-    // Calculate and return PageRank scores
+    // Takes ranks from a snapshot of this graph, computing them only if the
+    // snapshot was built from a different graph
+    PageRank(const BipartiteGraph &bg, const ModelSnapshot &snapshot);
+
+    // Carries over previous's ranks for a graph in which changedUsers more
+    // users' ratings differ, sharing them until they go stale
+    PageRank(const BipartiteGraph &bg, const PageRank &previous, size_t changedUsers);
+
+    PageRank(const PageRank &) = delete;
+    PageRank &operator=(const PageRank &) = delete;
+
+    // Computes ranks now instead of on first use. Recomputing replaces the
+    // ranks in place, so it must not race with readers
     void calculatePageRanks() const;
 
+    bool isComputed() const { return computed.load(std::memory_order_acquire); }
+
+    // True if the ranks were carried over through too many changed users
+    // and should be recomputed
+    bool isStale() const;
+
+    // Changes whenever the ranks do; 0 until they first exist
+    uint64_t getVersion() const { return version.load(std::memory_order_acquire); }
+
     // Get rank for a specific user
     double getPageRank(int userId) const;
+
+    // The rank map; does not force computation
+    void reportMemory(MemoryAccounting::Report &report) const;
+
+    // Users added since the ranks were computed have none until the next
+    // computation; getPageRank gives them the minimum
+    const std::unordered_map<int, double> &getRanks() const
+    {
+        ensureComputed();
+        return *ranks;
+    }
 };
 
 #endif
\ No newline at end of file
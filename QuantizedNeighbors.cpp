@@ -0,0 +1,175 @@
+#include "QuantizedNeighbors.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Four packed lanes; the compiler lowers conversion and multiply on them
+  // to SSE/NEON instructions, widening four codes per step
+  typedef float Float4 __attribute__((vector_size(16)));
+  typedef int32_t Int4 __attribute__((vector_size(16)));
+
+  template <typename Code>
+  void dequantize(const Code *codes, size_t count, float step, float *out)
+  {
+    Float4 scale = {step, step, step, step};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      Int4 wide = {codes[i], codes[i + 1], codes[i + 2], codes[i + 3]};
+      Float4 values = __builtin_convertvector(wide, Float4) * scale;
+      std::copy(&values[0], &values[0] + 4, out + i);
+    }
+    for (; i < count; i++)
+    {
+      out[i] = codes[i] * step;
+    }
+  }
+
+  template <typename Code>
+  void quantize(const std::vector<std::pair<int, float>> &list, float step, std::vector<Code> &codes)
+  {
+    const float maxCode = static_cast<float>(static_cast<Code>(~Code(0)));
+    for (const auto &[_, similarity] : list)
+    {
+      float code = step > 0.0f ? std::round(similarity / step) : 0.0f;
+      codes.push_back(static_cast<Code>(std::clamp(code, 0.0f, maxCode)));
+    }
+  }
+}
+
+void QuantizedNeighbors::append(const std::vector<std::pair<int, float>> &list)
+{
+  const float maxCode = precision == INT8 ? 255.0f : 65535.0f;
+  float best = 0.0f;
+  for (const auto &[neighborId, similarity] : list)
+  {
+    neighborIds.push_back(neighborId);
+    best = std::max(best, similarity);
+  }
+  float step = best / maxCode;
+  steps.push_back(step);
+  if (precision == INT8)
+    quantize(list, step, codes8);
+  else
+    quantize(list, step, codes16);
+  offsets.push_back(static_cast<uint32_t>(neighborIds.size()));
+}
+
+void QuantizedNeighbors::shrink()
+{
+  userIds.shrink_to_fit();
+  neighborIds.shrink_to_fit();
+  codes8.shrink_to_fit();
+  codes16.shrink_to_fit();
+}
+
+QuantizedNeighbors QuantizedNeighbors::build(const Lists &lists, Precision precision)
+{
+  QuantizedNeighbors result;
+  result.precision = precision;
+  for (const auto &[userId, _] : lists)
+  {
+    result.userIds.push_back(userId);
+  }
+  std::sort(result.userIds.begin(), result.userIds.end());
+
+  result.offsets.reserve(result.userIds.size() + 1);
+  result.steps.reserve(result.userIds.size());
+  for (int userId : result.userIds)
+  {
+    result.append(lists.at(userId));
+  }
+  result.shrink();
+  return result;
+}
+
+QuantizedNeighbors QuantizedNeighbors::merge(const Lists &changed) const
+{
+  QuantizedNeighbors result;
+  result.precision = precision;
+  result.userIds = userIds;
+  for (const auto &[userId, _] : changed)
+  {
+    if (find(userId) < 0)
+      result.userIds.push_back(userId);
+  }
+  std::sort(result.userIds.begin(), result.userIds.end());
+
+  result.offsets.reserve(result.userIds.size() + 1);
+  result.steps.reserve(result.userIds.size());
+  result.neighborIds.reserve(neighborIds.size());
+  for (int userId : result.userIds)
+  {
+    auto changedIt = changed.find(userId);
+    if (changedIt != changed.end())
+    {
+      result.append(changedIt->second);
+      continue;
+    }
+
+    int list = find(userId);
+    uint32_t begin = offsets[list], end = offsets[list + 1];
+    result.neighborIds.insert(result.neighborIds.end(), neighborIds.begin() + begin, neighborIds.begin() + end);
+    if (precision == INT8)
+      result.codes8.insert(result.codes8.end(), codes8.begin() + begin, codes8.begin() + end);
+    else
+      result.codes16.insert(result.codes16.end(), codes16.begin() + begin, codes16.begin() + end);
+    result.steps.push_back(steps[list]);
+    result.offsets.push_back(static_cast<uint32_t>(result.neighborIds.size()));
+  }
+  result.shrink();
+  return result;
+}
+
+int QuantizedNeighbors::find(int userId) const
+{
+  auto it = std::lower_bound(userIds.begin(), userIds.end(), userId);
+  if (it == userIds.end() || *it != userId)
+    return -1;
+  return static_cast<int>(it - userIds.begin());
+}
+
+void QuantizedNeighbors::similarities(int list, float *out) const
+{
+  size_t begin = offsets[list];
+  if (precision == INT8)
+    dequantize(codes8.data() + begin, size(list), steps[list], out);
+  else
+    dequantize(codes16.data() + begin, size(list), steps[list], out);
+}
+
+std::vector<std::pair<int, float>> QuantizedNeighbors::get(int userId) const
+{
+  int list = find(userId);
+  if (list < 0)
+    return {};
+
+  std::vector<float> values(size(list));
+  similarities(list, values.data());
+  std::vector<std::pair<int, float>> result;
+  result.reserve(values.size());
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    result.push_back({ids(list)[i], values[i]});
+  }
+  return result;
+}
+
+QuantizedNeighbors::Lists QuantizedNeighbors::expand() const
+{
+  Lists lists;
+  lists.reserve(userIds.size());
+  for (int userId : userIds)
+  {
+    lists[userId] = get(userId);
+  }
+  return lists;
+}
+
+size_t QuantizedNeighbors::bytes() const
+{
+  return userIds.capacity() * sizeof(int32_t) + offsets.capacity() * sizeof(uint32_t) +
+         steps.capacity() * sizeof(float) + neighborIds.capacity() * sizeof(int32_t) +
+         codes8.capacity() * sizeof(uint8_t) + codes16.capacity() * sizeof(uint16_t);
+}
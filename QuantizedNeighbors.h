@@ -0,0 +1,76 @@
+#ifndef QUANTIZEDNEIGHBORS_H
+#define QUANTIZEDNEIGHBORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Immutable, compact copy of per-user neighbor lists.
+//
+// Lists are packed back to back behind a sorted user index instead of one
+// heap vector per map node. Each similarity is stored as an 8- or 16-bit
+// code scaled by its list's largest value, so a list keeps its order and
+// loses at most half a step (1/510 or 1/131070 of its best similarity).
+// An entry costs 5 or 6 bytes against 8 in a float list, plus 12 bytes per
+// user against a hash node and vector header.
+class QuantizedNeighbors
+{
+public:
+  enum Precision
+  {
+    INT8,
+    INT16
+  };
+
+  using Lists = std::unordered_map<int, std::vector<std::pair<int, float>>>;
+
+  QuantizedNeighbors() = default;
+
+  // Lists must be sorted most similar first, with positive similarities
+  static QuantizedNeighbors build(const Lists &lists, Precision precision);
+
+  // A copy with the changed users' lists encoded in place of their old
+  // ones. Every other list keeps its codes as they are, so lists that did
+  // not change are never quantized twice
+  QuantizedNeighbors merge(const Lists &changed) const;
+
+  bool empty() const { return userIds.empty(); }
+  size_t userCount() const { return userIds.size(); }
+  Precision getPrecision() const { return precision; }
+
+  // Position of the user's list, or -1 if there is none
+  int find(int userId) const;
+
+  size_t size(int list) const { return offsets[list + 1] - offsets[list]; }
+  const int32_t *ids(int list) const { return neighborIds.data() + offsets[list]; }
+
+  // Dequantizes the list's similarities into out[0, size(list))
+  void similarities(int list, float *out) const;
+
+  // The list as (neighbor, similarity) pairs, most similar first
+  std::vector<std::pair<int, float>> get(int userId) const;
+
+  // Float lists again, e.g. to apply incremental updates
+  Lists expand() const;
+
+  // Bytes held by the packed arrays
+  size_t bytes() const;
+
+private:
+  // Encodes one list after the last and closes it in offsets
+  void append(const std::vector<std::pair<int, float>> &list);
+  void shrink();
+
+  Precision precision = INT8;
+  std::vector<int32_t> userIds;
+  std::vector<uint32_t> offsets{0};
+  // Per list: similarity of one code step
+  std::vector<float> steps;
+  std::vector<int32_t> neighborIds;
+  std::vector<uint8_t> codes8;
+  std::vector<uint16_t> codes16;
+};
+
+#endif
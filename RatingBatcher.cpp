@@ -0,0 +1,213 @@
+#include "RatingBatcher.h"
+#include "ModelStore.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include <algorithm>
+
+RatingBatcher::RatingBatcher(BipartiteGraph &bg, Collaborative *collab, RatingLog::Writer *log)
+    : RatingBatcher(bg, collab, log, Options()) {}
+
+RatingBatcher::RatingBatcher(BipartiteGraph &bg, Collaborative *collab, RatingLog::Writer *log, Options options)
+    : graph(&bg), collaborative(collab), log(log), options(options) {}
+
+RatingBatcher::RatingBatcher(ModelStore &store, RatingLog::Writer *log, Options options)
+    : store(&store), log(log), options(options) {}
+
+RatingBatcher::~RatingBatcher()
+{
+  stop();
+}
+
+void RatingBatcher::start()
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  if (worker.joinable())
+    return;
+  stopping = false;
+  worker = std::thread(&RatingBatcher::run, this);
+}
+
+void RatingBatcher::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueReady.notify_all();
+  queueSpace.notify_all();
+  if (worker.joinable())
+    worker.join();
+  flush();
+}
+
+void RatingBatcher::submit(const RatingEvent &event)
+{
+  std::unique_lock<std::mutex> lock(queueMutex);
+  // Backpressure: wait for the applier rather than queueing without bound.
+  // Without a running worker the caller drains the queue itself
+  while (queue.size() >= options.maxQueueSize)
+  {
+    if (!worker.joinable() || stopping)
+    {
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+    else
+    {
+      queueSpace.wait(lock);
+    }
+  }
+
+  if (queue.empty())
+    oldestQueued = std::chrono::steady_clock::now();
+  queue.push_back(event);
+  if (queue.size() >= options.maxBatchSize)
+    queueReady.notify_one();
+}
+
+std::vector<RatingEvent> RatingBatcher::takeBatch(std::unique_lock<std::mutex> &)
+{
+  size_t count = std::min(queue.size(), options.maxBatchSize);
+  std::vector<RatingEvent> batch(queue.begin(), queue.begin() + count);
+  queue.erase(queue.begin(), queue.begin() + count);
+  if (!queue.empty())
+    oldestQueued = std::chrono::steady_clock::now();
+  queueSpace.notify_all();
+  return batch;
+}
+
+void RatingBatcher::run()
+{
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (true)
+  {
+    if (queue.empty())
+    {
+      if (stopping)
+        return;
+      queueReady.wait(lock);
+      continue;
+    }
+
+    // Wait until the batch is full or its oldest event is due
+    auto deadline = oldestQueued + options.maxDelay;
+    if (queue.size() < options.maxBatchSize && !stopping &&
+        std::chrono::steady_clock::now() < deadline)
+    {
+      queueReady.wait_until(lock, deadline);
+      continue;
+    }
+
+    auto batch = takeBatch(lock);
+    lock.unlock();
+    {
+      std::lock_guard<std::mutex> applyLock(applyMutex);
+      applyBatch(batch, true);
+    }
+    lock.lock();
+  }
+}
+
+bool RatingBatcher::flush()
+{
+  std::lock_guard<std::mutex> applyLock(applyMutex);
+  bool ok = true;
+  while (true)
+  {
+    std::vector<RatingEvent> batch;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      if (queue.empty())
+        return ok;
+      batch = takeBatch(lock);
+    }
+    ok &= applyBatch(batch, true);
+  }
+}
+
+size_t RatingBatcher::replay(const std::string &logPath)
+{
+  std::lock_guard<std::mutex> applyLock(applyMutex);
+  std::vector<RatingEvent> batch;
+  size_t count = RatingLog::replay(logPath, [&](const RatingEvent &event)
+                                   {
+    batch.push_back(event);
+    if (batch.size() >= options.maxBatchSize)
+    {
+      applyBatch(batch, false);
+      batch.clear();
+    } });
+  if (!batch.empty())
+    applyBatch(batch, false);
+  return count;
+}
+
+bool RatingBatcher::applyBatch(const std::vector<RatingEvent> &batch, bool writeLog)
+{
+  TRACE_SPAN("RatingBatcher::applyBatch");
+
+  // Write-ahead: the batch is durable before any state changes. If it is
+  // not, nothing is applied; the log has already dropped any partial write
+  if (writeLog && log)
+  {
+    bool logged = true;
+    for (const auto &event : batch)
+      logged &= log->append(event) != 0;
+    logged = log->flush() && logged;
+    if (!logged)
+    {
+      Metrics::increment(Metrics::RATING_LOG_FAILURES);
+      std::lock_guard<std::mutex> lock(queueMutex);
+      rejectedEvents += batch.size();
+      return false;
+    }
+  }
+
+  if (store)
+  {
+    store->apply(batch);
+  }
+  else
+  {
+    std::vector<std::pair<int, int>> changes;
+    changes.reserve(batch.size());
+    for (const auto &event : batch)
+    {
+      bool applied = event.type == RatingEvent::DELETE
+                         ? graph->removeRating(event.userId, event.movieId)
+                         : graph->addRating(event.userId, event.movieId, event.rating);
+      if (applied)
+        changes.push_back({event.userId, event.movieId});
+    }
+
+    if (collaborative && !changes.empty())
+      collaborative->onRatingsChanged(changes);
+  }
+
+  Metrics::increment(Metrics::RATING_EVENTS_APPLIED, batch.size());
+  Metrics::record(Metrics::RATING_BATCH_SIZE, batch.size());
+
+  std::lock_guard<std::mutex> lock(queueMutex);
+  appliedEvents += batch.size();
+  appliedBatches++;
+  return true;
+}
+
+size_t RatingBatcher::getAppliedEvents() const
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return appliedEvents;
+}
+
+size_t RatingBatcher::getAppliedBatches() const
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return appliedBatches;
+}
+
+size_t RatingBatcher::getRejectedEvents() const
+{
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return rejectedEvents;
+}
@@ -0,0 +1,104 @@
+#ifndef RATINGBATCHER_H
+#define RATINGBATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BipartiteGraph.h"
+#include "Collabrative.h"
+#include "RatingLog.h"
+
+class ModelStore;
+
+// Applies rating events to the graph and dependent models in micro-batches.
+//
+// Submitted events are queued and applied by a background thread once
+// maxBatchSize events are waiting or the oldest has waited maxDelay. Each
+// batch is first appended to the event log with a single write, then applied
+// to the graph, and then handed to Collaborative in one call so each
+// affected user's similarities are recomputed once per batch rather than
+// once per event. A batch the log fails to write is rejected whole: none of
+// its events are applied, and they are counted by getRejectedEvents().
+//
+// Against a bare graph, PageRank is not updated per batch; it is a global
+// computation and is refreshed on its own schedule. The graph and
+// Collaborative are mutated in place with no lock readers take, so a
+// bare-graph batcher is for single-threaded use (bulk loads, replay):
+// nothing may read them, or serve requests from them, between start() and
+// stop(). Against a ModelStore each batch publishes one new version, so
+// readers are never blocked and are safe while the applier runs.
+class RatingBatcher
+{
+public:
+  struct Options
+  {
+    size_t maxBatchSize = 256;
+    std::chrono::milliseconds maxDelay{50};
+    // Submissions block once this many events are queued
+    size_t maxQueueSize = 65536;
+  };
+
+  // log and collaborative may be null
+  RatingBatcher(BipartiteGraph &bg, Collaborative *collab, RatingLog::Writer *log);
+  RatingBatcher(BipartiteGraph &bg, Collaborative *collab, RatingLog::Writer *log, Options options);
+  RatingBatcher(ModelStore &store, RatingLog::Writer *log, Options options);
+  ~RatingBatcher();
+
+  RatingBatcher(const RatingBatcher &) = delete;
+  RatingBatcher &operator=(const RatingBatcher &) = delete;
+
+  // Starts the background applier; without it, events apply on flush().
+  // Against a bare graph, the graph and Collaborative belong to the applier
+  // until stop() returns
+  void start();
+
+  // Applies everything still queued and stops the background applier
+  void stop();
+
+  void submit(const RatingEvent &event);
+
+  // Applies every queued event on the calling thread before returning.
+  // Returns false if any batch was rejected because the log failed
+  bool flush();
+
+  // Rebuilds state after a restart by applying a log's events in batches.
+  // Replayed events are not written back to the log
+  size_t replay(const std::string &logPath);
+
+  size_t getAppliedEvents() const;
+  size_t getAppliedBatches() const;
+  size_t getRejectedEvents() const;
+
+private:
+  // Exactly one of graph and store is set
+  BipartiteGraph *graph = nullptr;
+  Collaborative *collaborative = nullptr;
+  ModelStore *store = nullptr;
+  RatingLog::Writer *log;
+  Options options;
+
+  mutable std::mutex queueMutex;
+  std::condition_variable queueReady;
+  std::condition_variable queueSpace;
+  std::deque<RatingEvent> queue;
+  std::chrono::steady_clock::time_point oldestQueued;
+  bool stopping = false;
+  std::thread worker;
+
+  // Serializes batch application between the worker and flush()
+  std::mutex applyMutex;
+  size_t appliedEvents = 0;
+  size_t appliedBatches = 0;
+  size_t rejectedEvents = 0;
+
+  void run();
+  std::vector<RatingEvent> takeBatch(std::unique_lock<std::mutex> &lock);
+  // Returns false, leaving all state unchanged, if the log write failed
+  bool applyBatch(const std::vector<RatingEvent> &batch, bool writeLog);
+};
+
+#endif
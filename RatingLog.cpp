@@ -0,0 +1,229 @@
+#include "RatingLog.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+  const char LOG_MAGIC[8] = {'R', 'A', 'T', 'E', 'L', 'O', 'G', '1'};
+
+  // Record layout (little-endian on every supported target):
+  //   0  uint64 sequence
+  //   8  int32  userId
+  //   12 int32  movieId
+  //   16 float  rating
+  //   20 uint8  type, 3 bytes zero padding
+  //   24 uint32 reserved (zero)
+  //   28 uint32 crc32 of bytes [0, 28)
+  constexpr size_t CRC_OFFSET = 28;
+
+  uint32_t crc32(const char *data, size_t size)
+  {
+    static uint32_t table[256] = {};
+    static bool initialized = []()
+    {
+      for (uint32_t i = 0; i < 256; i++)
+      {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+          c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+      }
+      return true;
+    }();
+    (void)initialized;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+    {
+      crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+  }
+
+  bool writeAll(int fd, const char *data, size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t written = ::write(fd, data, size);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+        return false;
+      data += written;
+      size -= static_cast<size_t>(written);
+    }
+    return true;
+  }
+}
+
+void RatingLog::encode(const RatingEvent &event, char *out)
+{
+  std::memset(out, 0, RECORD_SIZE);
+  std::memcpy(out, &event.sequence, 8);
+  std::memcpy(out + 8, &event.userId, 4);
+  std::memcpy(out + 12, &event.movieId, 4);
+  std::memcpy(out + 16, &event.rating, 4);
+  out[20] = static_cast<char>(event.type);
+  uint32_t crc = crc32(out, CRC_OFFSET);
+  std::memcpy(out + CRC_OFFSET, &crc, 4);
+}
+
+bool RatingLog::decode(const char *in, RatingEvent &event)
+{
+  uint32_t crc;
+  std::memcpy(&crc, in + CRC_OFFSET, 4);
+  if (crc != crc32(in, CRC_OFFSET))
+    return false;
+
+  uint8_t type = static_cast<uint8_t>(in[20]);
+  if (type < RatingEvent::ADD || type > RatingEvent::DELETE)
+    return false;
+
+  event.type = static_cast<RatingEvent::Type>(type);
+  std::memcpy(&event.sequence, in, 8);
+  std::memcpy(&event.userId, in + 8, 4);
+  std::memcpy(&event.movieId, in + 12, 4);
+  std::memcpy(&event.rating, in + 16, 4);
+  return true;
+}
+
+size_t RatingLog::replay(const std::string &path, const std::function<void(const RatingEvent &)> &fn)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return 0;
+
+  char magic[sizeof(LOG_MAGIC)];
+  if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+    return 0;
+
+  size_t count = 0;
+  char record[RECORD_SIZE];
+  RatingEvent event{};
+  while (file.read(record, RECORD_SIZE))
+  {
+    if (!decode(record, event))
+      break; // torn tail
+    fn(event);
+    count++;
+  }
+  return count;
+}
+
+RatingLog::Writer::Writer(const std::string &path, bool syncOnFlush)
+    : syncOnFlush(syncOnFlush)
+{
+  // Find where the valid prefix ends so a torn tail is overwritten rather
+  // than left in front of new records
+  uint64_t lastSequence = 0;
+  size_t validRecords = replay(path, [&](const RatingEvent &event)
+                               { lastSequence = event.sequence; });
+  nextSequence = lastSequence + 1;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    error = "cannot open " + path + ": " + std::strerror(errno);
+    return;
+  }
+
+  off_t validEnd = static_cast<off_t>(sizeof(LOG_MAGIC) + validRecords * RECORD_SIZE);
+  off_t size = ::lseek(fd, 0, SEEK_END);
+  char magic[sizeof(LOG_MAGIC)] = {};
+  bool hasMagic = size >= static_cast<off_t>(sizeof(LOG_MAGIC)) &&
+                  ::pread(fd, magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic)) &&
+                  std::memcmp(magic, LOG_MAGIC, sizeof(LOG_MAGIC)) == 0;
+
+  if (!hasMagic)
+  {
+    // Empty or foreign file: start a fresh log
+    if (::ftruncate(fd, 0) != 0 || !writeAll(fd, LOG_MAGIC, sizeof(LOG_MAGIC)))
+    {
+      error = "cannot initialize " + path + ": " + std::strerror(errno);
+      ::close(fd);
+      fd = -1;
+      return;
+    }
+  }
+  else if (size != validEnd)
+  {
+    // Only a torn tail may go: if any full record past the first bad one
+    // is intact, the bad one is corruption in the middle of the log
+    char record[RECORD_SIZE];
+    RatingEvent event{};
+    for (off_t offset = validEnd + RECORD_SIZE; offset + static_cast<off_t>(RECORD_SIZE) <= size;
+         offset += RECORD_SIZE)
+    {
+      if (::pread(fd, record, RECORD_SIZE, offset) == static_cast<ssize_t>(RECORD_SIZE) &&
+          decode(record, event))
+      {
+        error = path + ": corrupt record at offset " + std::to_string(validEnd) +
+                " is followed by valid records";
+        ::close(fd);
+        fd = -1;
+        return;
+      }
+    }
+    if (::ftruncate(fd, validEnd) != 0)
+    {
+      error = "cannot truncate " + path + ": " + std::strerror(errno);
+      ::close(fd);
+      fd = -1;
+      return;
+    }
+  }
+  committedEnd = ::lseek(fd, 0, SEEK_END);
+}
+
+RatingLog::Writer::~Writer()
+{
+  if (fd >= 0)
+  {
+    flush();
+    ::close(fd);
+  }
+}
+
+uint64_t RatingLog::Writer::append(RatingEvent event)
+{
+  if (fd < 0)
+    return 0;
+  event.sequence = nextSequence++;
+  size_t offset = pending.size();
+  pending.resize(offset + RECORD_SIZE);
+  encode(event, pending.data() + offset);
+  return event.sequence;
+}
+
+bool RatingLog::Writer::flush()
+{
+  if (fd < 0)
+    return false;
+  if (pending.empty())
+    return true;
+
+  bool ok = writeAll(fd, pending.data(), pending.size());
+  if (ok && syncOnFlush)
+    ok = ::fdatasync(fd) == 0;
+
+  if (ok)
+  {
+    committedEnd += static_cast<off_t>(pending.size());
+  }
+  else
+  {
+    // Drop whatever part of the batch reached the file, so replay never
+    // sees records the caller was told failed, and reuse their sequences
+    if (::ftruncate(fd, committedEnd) != 0 || ::lseek(fd, committedEnd, SEEK_SET) != committedEnd)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+    nextSequence -= pending.size() / RECORD_SIZE;
+  }
+  pending.clear();
+  return ok;
+}
@@ -0,0 +1,83 @@
+#ifndef RATINGLOG_H
+#define RATINGLOG_H
+
+#include <cstdint>
+#include <functional>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+struct RatingEvent
+{
+  enum Type : uint8_t
+  {
+    ADD = 1,
+    UPDATE = 2,
+    DELETE = 3
+  };
+
+  Type type;
+  int userId;
+  int movieId;
+  float rating; // ignored for DELETE
+  uint64_t sequence = 0;
+};
+
+// Append-only binary log of rating events.
+//
+// The file starts with an 8-byte magic, followed by fixed-size 32-byte
+// records, each carrying a CRC32 of its payload. A crash mid-append can only
+// leave a torn tail: a short final record, or bad records with nothing
+// valid after them. Replay detects it by its size or checksum and stops
+// there; everything before it is intact. A bad record with valid ones after
+// it is corruption rather than a crash, and the writer refuses to open the
+// log instead of truncating those records away.
+class RatingLog
+{
+public:
+  static constexpr size_t RECORD_SIZE = 32;
+
+  class Writer
+  {
+  private:
+    int fd = -1;
+    uint64_t nextSequence = 1;
+    // End of the last successfully flushed record
+    off_t committedEnd = 0;
+    std::vector<char> pending;
+    bool syncOnFlush;
+    std::string error;
+
+  public:
+    // Opens (creating if needed) the log for appending; sequence numbers
+    // continue after the last valid record already in the file, and a torn
+    // tail is truncated. A corrupt record followed by valid ones leaves the
+    // writer closed, with the reason in getError(). Without syncOnFlush a
+    // flushed batch survives a process crash but not a power loss
+    explicit Writer(const std::string &path, bool syncOnFlush = true);
+    ~Writer();
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+    // Why the log could not be opened; empty if it was
+    const std::string &getError() const { return error; }
+
+    // Buffers one event and returns its sequence number, or 0 if the log
+    // is not open
+    uint64_t append(RatingEvent event);
+
+    // Writes buffered records (and fsyncs if requested). On an I/O error
+    // the file is truncated back to the last flushed record, the buffered
+    // records are dropped and false is returned
+    bool flush();
+  };
+
+  // Calls fn for every intact record in order; returns how many were read
+  static size_t replay(const std::string &path, const std::function<void(const RatingEvent &)> &fn);
+
+  static void encode(const RatingEvent &event, char *out);
+  static bool decode(const char *in, RatingEvent &event);
+};
+
+#endif
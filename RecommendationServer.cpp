@@ -0,0 +1,503 @@
+#include "RecommendationServer.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+  // epoll user data: fixed ids for the loop's own descriptors, increasing
+  // ids for connections so a reused fd never matches a stale completion
+  constexpr uint64_t WAKE_ID = 0;
+  constexpr uint64_t UNIX_LISTENER_ID = 1;
+  constexpr uint64_t TCP_LISTENER_ID = 2;
+  constexpr uint64_t FIRST_CONNECTION_ID = 16;
+
+  constexpr int MAX_EVENTS = 64;
+  constexpr size_t READ_CHUNK = 64 * 1024;
+  // Stop reading from a client that is not reading its responses
+  constexpr size_t MAX_PENDING_OUTPUT = 1 << 20;
+
+  bool addToEpoll(int epollFd, int fd, uint32_t events, uint64_t id)
+  {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+  }
+}
+
+RecommendationServer::RecommendationServer(ModelStore &store, Options options)
+    : store(store), options(std::move(options)), nextConnectionId(FIRST_CONNECTION_ID)
+{
+  this->options.workers = std::max(1, this->options.workers);
+  this->options.maxBatchSize = std::max<size_t>(1, this->options.maxBatchSize);
+  this->options.maxInFlightPerConnection = std::max<size_t>(1, this->options.maxInFlightPerConnection);
+}
+
+RecommendationServer::~RecommendationServer()
+{
+  stop();
+}
+
+bool RecommendationServer::start()
+{
+  if (loop.joinable())
+    return true;
+
+  stopping = false;
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollFd < 0 || wakeFd < 0 || !addToEpoll(epollFd, wakeFd, EPOLLIN, WAKE_ID) ||
+      !openListeners())
+  {
+    closeAll();
+    return false;
+  }
+
+  loop = std::thread(&RecommendationServer::runLoop, this);
+  for (int i = 0; i < options.workers; i++)
+  {
+    workers.emplace_back(&RecommendationServer::runWorker, this);
+  }
+  return true;
+}
+
+void RecommendationServer::stop()
+{
+  if (!loop.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueReady.notify_all();
+  wake();
+
+  loop.join();
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+  workers.clear();
+  closeAll();
+  queue.clear();
+  completed.clear();
+}
+
+bool RecommendationServer::openListeners()
+{
+  if (!options.unixPath.empty())
+  {
+    sockaddr_un addr{};
+    if (options.unixPath.size() >= sizeof(addr.sun_path))
+      return false;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, options.unixPath.c_str(), options.unixPath.size() + 1);
+
+    // A stale socket file from an earlier run would make bind fail
+    ::unlink(options.unixPath.c_str());
+    unixFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (unixFd < 0 || ::bind(unixFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        ::listen(unixFd, SOMAXCONN) < 0 ||
+        !addToEpoll(epollFd, unixFd, EPOLLIN, UNIX_LISTENER_ID))
+      return false;
+  }
+
+  if (options.tcpPort >= 0)
+  {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(options.tcpPort));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    tcpFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (tcpFd < 0)
+      return false;
+    int one = 1;
+    ::setsockopt(tcpFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    socklen_t length = sizeof(addr);
+    if (::bind(tcpFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        ::listen(tcpFd, SOMAXCONN) < 0 ||
+        ::getsockname(tcpFd, reinterpret_cast<sockaddr *>(&addr), &length) < 0 ||
+        !addToEpoll(epollFd, tcpFd, EPOLLIN, TCP_LISTENER_ID))
+      return false;
+    boundTcpPort = ntohs(addr.sin_port);
+  }
+
+  return unixFd >= 0 || tcpFd >= 0;
+}
+
+void RecommendationServer::closeAll()
+{
+  for (auto &[id, connection] : connections)
+  {
+    ::close(connection.fd);
+  }
+  connections.clear();
+
+  if (unixFd >= 0)
+  {
+    ::close(unixFd);
+    ::unlink(options.unixPath.c_str());
+    unixFd = -1;
+  }
+  for (int *fd : {&tcpFd, &wakeFd, &epollFd})
+  {
+    if (*fd >= 0)
+    {
+      ::close(*fd);
+      *fd = -1;
+    }
+  }
+  boundTcpPort = -1;
+}
+
+void RecommendationServer::wake()
+{
+  uint64_t one = 1;
+  if (wakeFd >= 0)
+    (void)::write(wakeFd, &one, sizeof(one));
+}
+
+void RecommendationServer::runLoop()
+{
+  epoll_event events[MAX_EVENTS];
+  while (!stopping)
+  {
+    int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+    if (ready < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (int i = 0; i < ready; i++)
+    {
+      uint64_t id = events[i].data.u64;
+      if (id == WAKE_ID)
+      {
+        uint64_t count;
+        (void)::read(wakeFd, &count, sizeof(count));
+        deliverCompleted();
+        continue;
+      }
+      if (id == UNIX_LISTENER_ID || id == TCP_LISTENER_ID)
+      {
+        accept(id == TCP_LISTENER_ID ? tcpFd : unixFd, id == TCP_LISTENER_ID);
+        continue;
+      }
+
+      // Closed earlier in this round
+      auto it = connections.find(id);
+      if (it == connections.end())
+        continue;
+
+      Connection &connection = it->second;
+      uint32_t flags = events[i].events;
+      bool open = !(flags & (EPOLLERR | EPOLLHUP)) || (flags & EPOLLIN);
+      if (open && (flags & EPOLLIN))
+        open = onReadable(id, connection);
+      if (open && (flags & EPOLLOUT))
+        open = flushOutput(connection);
+
+      if (open)
+        updateInterest(id, connection);
+      else
+        closeConnection(id);
+    }
+  }
+}
+
+void RecommendationServer::accept(int listenFd, bool tcp)
+{
+  while (true)
+  {
+    int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+
+    if (tcp)
+    {
+      int one = 1;
+      ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    uint64_t id = nextConnectionId++;
+    if (!addToEpoll(epollFd, fd, EPOLLIN, id))
+    {
+      ::close(fd);
+      continue;
+    }
+    Connection connection;
+    connection.fd = fd;
+    connections.emplace(id, std::move(connection));
+  }
+}
+
+bool RecommendationServer::onReadable(uint64_t id, Connection &connection)
+{
+  char buffer[READ_CHUNK];
+  size_t limit = ServerProtocol::REQUEST_SIZE * options.maxInFlightPerConnection;
+  while (connection.in.size() - connection.inOffset < limit)
+  {
+    ssize_t got = ::read(connection.fd, buffer, sizeof(buffer));
+    if (got > 0)
+    {
+      connection.in.append(buffer, static_cast<size_t>(got));
+      continue;
+    }
+    if (got == 0)
+      return false;
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      break;
+    return false;
+  }
+
+  parseFrames(id, connection);
+  // Rejections are answered immediately
+  return flushOutput(connection);
+}
+
+void RecommendationServer::parseFrames(uint64_t id, Connection &connection)
+{
+  auto now = std::chrono::steady_clock::now();
+  std::vector<Pending> accepted;
+  while (connection.in.size() - connection.inOffset >= ServerProtocol::REQUEST_SIZE &&
+         connection.inFlight < options.maxInFlightPerConnection)
+  {
+    ServerRequest request;
+    bool valid = ServerProtocol::decodeRequest(connection.in.data() + connection.inOffset, request);
+    connection.inOffset += ServerProtocol::REQUEST_SIZE;
+    Metrics::increment(Metrics::SERVER_REQUESTS);
+    if (!valid)
+    {
+      ServerResponse response;
+      response.requestId = request.requestId;
+      response.status = ServerResponse::BAD_REQUEST;
+      ServerProtocol::encodeResponse(response, connection.out);
+      continue;
+    }
+    accepted.push_back({id, request, now});
+    connection.inFlight++;
+  }
+
+  if (connection.inOffset == connection.in.size())
+  {
+    connection.in.clear();
+    connection.inOffset = 0;
+  }
+  else if (connection.inOffset > connection.in.size() / 2)
+  {
+    connection.in.erase(0, connection.inOffset);
+    connection.inOffset = 0;
+  }
+
+  if (accepted.empty())
+    return;
+
+  size_t admitted = 0;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (auto &pending : accepted)
+    {
+      if (queue.size() < options.maxQueueSize)
+      {
+        queue.push_back(std::move(pending));
+        admitted++;
+        continue;
+      }
+      ServerResponse response;
+      response.requestId = pending.request.requestId;
+      response.status = ServerResponse::OVERLOADED;
+      ServerProtocol::encodeResponse(response, connection.out);
+      connection.inFlight--;
+      Metrics::increment(Metrics::SERVER_OVERLOADED);
+    }
+  }
+  if (admitted == 1)
+    queueReady.notify_one();
+  else if (admitted > 1)
+    queueReady.notify_all();
+}
+
+bool RecommendationServer::flushOutput(Connection &connection)
+{
+  size_t written = 0;
+  while (written < connection.out.size())
+  {
+    ssize_t sent = ::send(connection.fd, connection.out.data() + written,
+                          connection.out.size() - written, MSG_NOSIGNAL);
+    if (sent > 0)
+    {
+      written += static_cast<size_t>(sent);
+      continue;
+    }
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    return false;
+  }
+  connection.out.erase(0, written);
+  return true;
+}
+
+void RecommendationServer::updateInterest(uint64_t id, Connection &connection)
+{
+  bool reading = connection.inFlight < options.maxInFlightPerConnection &&
+                 connection.out.size() < MAX_PENDING_OUTPUT;
+  bool writing = !connection.out.empty();
+  if (reading == connection.reading && writing == connection.writing)
+    return;
+
+  connection.reading = reading;
+  connection.writing = writing;
+  epoll_event event{};
+  event.events = (reading ? uint32_t(EPOLLIN) : 0u) | (writing ? uint32_t(EPOLLOUT) : 0u);
+  event.data.u64 = id;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void RecommendationServer::deliverCompleted()
+{
+  std::vector<Completed> batch;
+  {
+    std::lock_guard<std::mutex> lock(completedMutex);
+    batch.swap(completed);
+  }
+
+  std::vector<uint64_t> touched;
+  for (auto &done : batch)
+  {
+    // Responses for a connection that has since closed are dropped
+    auto it = connections.find(done.connectionId);
+    if (it == connections.end())
+      continue;
+    it->second.out += done.frames;
+    it->second.inFlight -= done.count;
+    touched.push_back(done.connectionId);
+  }
+  std::sort(touched.begin(), touched.end());
+  touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+  for (uint64_t id : touched)
+  {
+    Connection &connection = connections.at(id);
+    // Requests held back by the in-flight limit can go now
+    parseFrames(id, connection);
+    if (flushOutput(connection))
+      updateInterest(id, connection);
+    else
+      closeConnection(id);
+  }
+}
+
+void RecommendationServer::closeConnection(uint64_t id)
+{
+  auto it = connections.find(id);
+  if (it == connections.end())
+    return;
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+  ::close(it->second.fd);
+  connections.erase(it);
+}
+
+void RecommendationServer::runWorker()
+{
+  while (true)
+  {
+    std::vector<Pending> batch;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueReady.wait(lock, [this]()
+                      { return stopping || !queue.empty(); });
+      if (stopping)
+        return;
+
+      size_t take = std::min(queue.size(), options.maxBatchSize);
+      batch.assign(std::make_move_iterator(queue.begin()),
+                   std::make_move_iterator(queue.begin() + take));
+      queue.erase(queue.begin(), queue.begin() + take);
+    }
+    Metrics::record(Metrics::SERVER_BATCH_SIZE, batch.size());
+
+    // The whole batch is scored against one pinned version, and each
+    // connection's responses are handed back as one buffer
+    std::vector<Completed> done;
+    {
+      ModelStore::Reader models = store.read();
+      for (const auto &pending : batch)
+      {
+        auto waited = std::chrono::steady_clock::now() - pending.arrival;
+        Metrics::record(Metrics::SERVER_QUEUE_NS, static_cast<uint64_t>(
+                                                      std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count()));
+
+        auto it = std::find_if(done.begin(), done.end(), [&](const Completed &c)
+                               { return c.connectionId == pending.connectionId; });
+        if (it == done.end())
+          it = done.insert(done.end(), Completed{pending.connectionId, 0, {}});
+        ServerProtocol::encodeResponse(handle(*models, pending), it->frames);
+        it->count++;
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(completedMutex);
+      std::move(done.begin(), done.end(), std::back_inserter(completed));
+    }
+    wake();
+  }
+}
+
+ServerResponse RecommendationServer::handle(const ModelVersion &models, const Pending &pending) const
+{
+  const ServerRequest &request = pending.request;
+  ServerResponse response;
+  response.requestId = request.requestId;
+  if (!models.graph.getUserItems().count(request.userId))
+  {
+    response.status = ServerResponse::UNKNOWN_USER;
+    return response;
+  }
+
+  std::vector<std::pair<int, double>> recommendations;
+  if (request.budgetMicros == 0)
+  {
+    recommendations = models.hybrid.getRecommendations(request.userId, request.n);
+  }
+  else
+  {
+    // The budget covers time spent queued as well
+    auto remaining = std::chrono::microseconds(request.budgetMicros) -
+                     (std::chrono::steady_clock::now() - pending.arrival);
+    auto result = models.hybrid.getRecommendations(
+        request.userId, request.n,
+        std::max<std::chrono::nanoseconds>(remaining, std::chrono::nanoseconds(0)));
+    recommendations = std::move(result.recommendations);
+    if (result.quality == Hybrid::Result::PARTIAL)
+      response.status = ServerResponse::PARTIAL;
+    else if (result.quality == Hybrid::Result::POPULARITY)
+      response.status = ServerResponse::POPULARITY;
+  }
+
+  for (const auto &[movieId, score] : recommendations)
+  {
+    response.recommendations.push_back({movieId, static_cast<float>(score)});
+  }
+  return response;
+}
@@ -0,0 +1,129 @@
+#ifndef RECOMMENDATIONSERVER_H
+#define RECOMMENDATIONSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "ModelStore.h"
+#include "ServerProtocol.h"
+
+// Resident recommendation service over a Unix domain socket and/or loopback
+// TCP, speaking the ServerProtocol frames.
+//
+// One event-loop thread owns every socket (epoll, non-blocking I/O). It
+// decodes request frames into a bounded queue; worker threads take up to
+// maxBatchSize requests at a time and score the whole batch against one
+// pinned ModelStore version, then hand the encoded responses back to the
+// loop through an eventfd, so each connection gets one write per batch.
+//
+// Backpressure is two-level: a connection with maxInFlightPerConnection
+// requests outstanding is no longer read from, so the kernel socket buffer
+// fills and the client blocks; and a request arriving while the shared
+// queue holds maxQueueSize requests is answered OVERLOADED at once rather
+// than queued.
+class RecommendationServer
+{
+public:
+  struct Options
+  {
+    // Empty: no Unix socket listener
+    std::string unixPath;
+    // -1: no TCP listener; 0: any free loopback port (see getTcpPort)
+    int tcpPort = -1;
+    int workers = 1;
+    size_t maxBatchSize = 32;
+    size_t maxQueueSize = 1024;
+    size_t maxInFlightPerConnection = 128;
+  };
+
+  RecommendationServer(ModelStore &store, Options options);
+  ~RecommendationServer();
+
+  RecommendationServer(const RecommendationServer &) = delete;
+  RecommendationServer &operator=(const RecommendationServer &) = delete;
+
+  // Opens the listeners and starts the loop and workers. Returns false if
+  // no listener could be opened
+  bool start();
+
+  // Closes every connection; queued requests are dropped
+  void stop();
+
+  // The bound TCP port, or -1 without a TCP listener
+  int getTcpPort() const { return boundTcpPort; }
+
+private:
+  struct Connection
+  {
+    int fd;
+    std::string in;
+    size_t inOffset = 0;
+    std::string out;
+    size_t inFlight = 0;
+    bool reading = true;
+    bool writing = false;
+  };
+
+  struct Pending
+  {
+    uint64_t connectionId;
+    ServerRequest request;
+    std::chrono::steady_clock::time_point arrival;
+  };
+
+  struct Completed
+  {
+    uint64_t connectionId;
+    size_t count;
+    std::string frames;
+  };
+
+  ModelStore &store;
+  Options options;
+
+  int epollFd = -1;
+  int wakeFd = -1;
+  int unixFd = -1;
+  int tcpFd = -1;
+  int boundTcpPort = -1;
+  std::atomic<bool> stopping{false};
+  std::thread loop;
+  std::vector<std::thread> workers;
+
+  // Owned by the loop thread
+  std::unordered_map<uint64_t, Connection> connections;
+  uint64_t nextConnectionId;
+
+  std::mutex queueMutex;
+  std::condition_variable queueReady;
+  std::deque<Pending> queue;
+
+  std::mutex completedMutex;
+  std::vector<Completed> completed;
+
+  bool openListeners();
+  void closeAll();
+  void wake();
+
+  void runLoop();
+  void accept(int listenFd, bool tcp);
+  // Return false once the connection should be closed
+  bool onReadable(uint64_t id, Connection &connection);
+  bool flushOutput(Connection &connection);
+  void parseFrames(uint64_t id, Connection &connection);
+  void updateInterest(uint64_t id, Connection &connection);
+  void deliverCompleted();
+  void closeConnection(uint64_t id);
+
+  void runWorker();
+  ServerResponse handle(const ModelVersion &models, const Pending &pending) const;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "ResultCache.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <iterator>
+
+size_t ResultCache::KeyHash::operator()(const Key &key) const
+{
+  uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(key.userId));
+  h = h * 0x9E3779B97F4A7C15ull ^ key.n;
+  h = h * 0x9E3779B97F4A7C15ull ^ key.filter.hash();
+  return static_cast<size_t>(h ^ (h >> 29));
+}
+
+ResultCache::ResultCache(size_t budgetBytes)
+    : budgetBytes(budgetBytes)
+{
+  for (size_t i = 0; i < SHARD_COUNT; i++)
+  {
+    shards.push_back(std::make_unique<Shard>());
+  }
+}
+
+size_t ResultCache::entryBytes(const Entry &entry)
+{
+  // The list node, the list's value vector and the index node. The key is
+  // stored in both nodes, so its filter's genre list is held twice
+  using IndexValue = std::pair<const Key, std::list<Entry>::iterator>;
+  return MemoryAccounting::allocationBytes(2 * sizeof(void *) + sizeof(Entry)) +
+         MemoryAccounting::heapBytes(entry.value) + 2 * entry.key.filter.heapBytes() +
+         MemoryAccounting::allocationBytes(sizeof(void *) + sizeof(IndexValue)) + sizeof(void *);
+}
+
+size_t ResultCache::shardBudget() const
+{
+  size_t budget = budgetBytes ? budgetBytes : MemoryAccounting::getBudget(MemoryAccounting::RESULT_CACHE);
+  return budget / SHARD_COUNT;
+}
+
+void ResultCache::charge(std::ptrdiff_t delta) const
+{
+  if (budgetBytes == 0)
+    globalCharge.adjust(delta);
+}
+
+bool ResultCache::overGlobalBudget() const
+{
+  return budgetBytes == 0 && globalCharge.overBudget();
+}
+
+void ResultCache::erase(Shard &shard, std::list<Entry>::iterator entry) const
+{
+  size_t bytes = entryBytes(*entry);
+  shard.bytes -= bytes;
+  charge(-static_cast<std::ptrdiff_t>(bytes));
+  shard.index.erase(entry->key);
+  shard.entries.erase(entry);
+}
+
+ResultCache::Shard &ResultCache::shardFor(const Key &key) const
+{
+  // High bits, so the shard choice is independent of the bucket choice
+  // inside the shard's own map
+  return *shards[(KeyHash()(key) >> 32) % SHARD_COUNT];
+}
+
+bool ResultCache::lookup(const Key &key, const Version &version, Value &out) const
+{
+  Shard &shard = shardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end())
+  {
+    Metrics::increment(Metrics::RESULT_CACHE_MISS);
+    return false;
+  }
+
+  if (!(it->second->version == version))
+  {
+    // Computed from an older graph or model: drop it lazily
+    erase(shard, it->second);
+    Metrics::increment(Metrics::RESULT_CACHE_MISS);
+    return false;
+  }
+
+  shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+  out = it->second->value;
+  Metrics::increment(Metrics::RESULT_CACHE_HIT);
+  return true;
+}
+
+void ResultCache::insert(const Key &key, const Version &version, Value value)
+{
+  Shard &shard = shardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end())
+  {
+    size_t previous = entryBytes(*it->second);
+    it->second->version = version;
+    it->second->value = std::move(value);
+    size_t bytes = entryBytes(*it->second);
+    shard.bytes += bytes - previous;
+    charge(static_cast<std::ptrdiff_t>(bytes) - static_cast<std::ptrdiff_t>(previous));
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+  }
+  else
+  {
+    shard.entries.push_front({key, version, std::move(value)});
+    shard.index[key] = shard.entries.begin();
+    size_t bytes = entryBytes(shard.entries.front());
+    shard.bytes += bytes;
+    charge(static_cast<std::ptrdiff_t>(bytes));
+  }
+
+  // The newest list always stays, even if it alone is over budget
+  size_t budget = shardBudget();
+  while ((shard.bytes > budget || overGlobalBudget()) && shard.entries.size() > 1)
+  {
+    erase(shard, std::prev(shard.entries.end()));
+  }
+}
+
+size_t ResultCache::size() const
+{
+  size_t total = 0;
+  for (const auto &shard : shards)
+  {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    total += shard->entries.size();
+  }
+  return total;
+}
+
+void ResultCache::clear()
+{
+  for (const auto &shard : shards)
+  {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->entries.clear();
+    shard->index.clear();
+    charge(-static_cast<std::ptrdiff_t>(shard->bytes));
+    shard->bytes = 0;
+  }
+}
+
+size_t ResultCache::bytes() const
+{
+  size_t total = 0;
+  for (const auto &shard : shards)
+  {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    total += shard->bytes + MemoryAccounting::allocationBytes(shard->index.bucket_count() * sizeof(void *));
+  }
+  return total;
+}
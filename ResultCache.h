@@ -0,0 +1,110 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "ItemFilter.h"
+#include "MemoryAccounting.h"
+
+// Bounded LRU cache of final top-N recommendation lists.
+//
+// Entries are keyed by (userId, n, filter) and stamped with the graph,
+// PageRank, collaborative and content model versions they were computed
+// from. A lookup under newer versions treats the entry as a miss and drops
+// it, so nothing has to be flushed when the graph or a model changes. The cache is split into shards, each with its
+// own lock and LRU list, so concurrent requests for different users rarely
+// contend. Each shard holds an equal share of the byte budget and drops
+// least recently used lists once over it. Caches on the global budget also
+// charge it jointly, so a shard drops entries while all of them together
+// are over it; a cache given its own budget stands alone.
+class ResultCache
+{
+public:
+  struct Key
+  {
+    int userId;
+    size_t n;
+    ItemFilter filter;
+
+    bool operator==(const Key &other) const
+    {
+      return userId == other.userId && n == other.n && filter == other.filter;
+    }
+  };
+
+  struct Version
+  {
+    uint64_t graph;
+    uint64_t rank;
+    uint64_t collaborative;
+    uint64_t content;
+
+    bool operator==(const Version &other) const
+    {
+      return graph == other.graph && rank == other.rank &&
+             collaborative == other.collaborative && content == other.content;
+    }
+  };
+
+  using Value = std::vector<std::pair<int, double>>;
+
+  static constexpr size_t SHARD_COUNT = 16;
+
+  // A budget of 0 follows the global RESULT_CACHE budget
+  explicit ResultCache(size_t budgetBytes = 0);
+
+  // Copies the cached list into out if it was computed at this version
+  bool lookup(const Key &key, const Version &version, Value &out) const;
+
+  void insert(const Key &key, const Version &version, Value value);
+
+  size_t size() const;
+  void clear();
+
+  // Estimated resident bytes of every shard's entries and index
+  size_t bytes() const;
+
+private:
+  struct KeyHash
+  {
+    size_t operator()(const Key &key) const;
+  };
+
+  struct Entry
+  {
+    Key key;
+    Version version;
+    Value value;
+  };
+
+  struct Shard
+  {
+    std::mutex mutex;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+    // Sum of entryBytes over entries
+    size_t bytes = 0;
+  };
+
+  size_t budgetBytes;
+
+  static size_t entryBytes(const Entry &entry);
+  size_t shardBudget() const;
+  // Unlinks an entry from its shard. Caller holds the shard's mutex
+  void erase(Shard &shard, std::list<Entry>::iterator entry) const;
+  // Moves the global RESULT_CACHE usage along with a shard's bytes
+  void charge(std::ptrdiff_t delta) const;
+  bool overGlobalBudget() const;
+  // Lookups reorder the LRU lists
+  mutable std::vector<std::unique_ptr<Shard>> shards;
+  mutable MemoryAccounting::Charge globalCharge{MemoryAccounting::RESULT_CACHE};
+
+  Shard &shardFor(const Key &key) const;
+};
+
+#endif
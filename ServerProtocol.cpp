@@ -0,0 +1,204 @@
+#include "ServerProtocol.h"
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+  // Request layout:
+  //   0  uint8  op
+  //   1  uint8  reserved (zero)
+  //   2  uint16 n
+  //   4  uint32 requestId
+  //   8  int32  userId
+  //   12 uint32 budgetMicros
+  //
+  // Response header layout:
+  //   0  uint32 requestId
+  //   4  uint8  status
+  //   5  uint8  reserved (zero)
+  //   6  uint16 count
+  // followed by count entries of int32 movieId, float score
+
+  bool readAll(int fd, char *data, size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t got = ::read(fd, data, size);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+        return false;
+      data += got;
+      size -= static_cast<size_t>(got);
+    }
+    return true;
+  }
+
+  bool writeAll(int fd, const char *data, size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t written = ::write(fd, data, size);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+        return false;
+      data += written;
+      size -= static_cast<size_t>(written);
+    }
+    return true;
+  }
+}
+
+void ServerProtocol::encodeRequest(const ServerRequest &request, char *out)
+{
+  std::memset(out, 0, REQUEST_SIZE);
+  out[0] = static_cast<char>(request.op);
+  std::memcpy(out + 2, &request.n, 2);
+  std::memcpy(out + 4, &request.requestId, 4);
+  std::memcpy(out + 8, &request.userId, 4);
+  std::memcpy(out + 12, &request.budgetMicros, 4);
+}
+
+bool ServerProtocol::decodeRequest(const char *in, ServerRequest &request)
+{
+  std::memcpy(&request.n, in + 2, 2);
+  std::memcpy(&request.requestId, in + 4, 4);
+  std::memcpy(&request.userId, in + 8, 4);
+  std::memcpy(&request.budgetMicros, in + 12, 4);
+
+  uint8_t op = static_cast<uint8_t>(in[0]);
+  if (op != ServerRequest::RECOMMEND)
+    return false;
+  request.op = static_cast<ServerRequest::Op>(op);
+  return request.n > 0 && request.n <= MAX_RESULTS;
+}
+
+void ServerProtocol::encodeResponse(const ServerResponse &response, std::string &out)
+{
+  uint16_t count = static_cast<uint16_t>(response.recommendations.size());
+  size_t offset = out.size();
+  out.resize(offset + RESPONSE_HEADER_SIZE + count * RESPONSE_ENTRY_SIZE, '\0');
+
+  char *p = &out[offset];
+  std::memcpy(p, &response.requestId, 4);
+  p[4] = static_cast<char>(response.status);
+  std::memcpy(p + 6, &count, 2);
+  p += RESPONSE_HEADER_SIZE;
+  for (uint16_t i = 0; i < count; i++, p += RESPONSE_ENTRY_SIZE)
+  {
+    std::memcpy(p, &response.recommendations[i].first, 4);
+    std::memcpy(p + 4, &response.recommendations[i].second, 4);
+  }
+}
+
+size_t ServerProtocol::responseEntries(const char *header)
+{
+  uint16_t count;
+  std::memcpy(&count, header + 6, 2);
+  return count;
+}
+
+void ServerProtocol::decodeResponse(const char *header, ServerResponse &response)
+{
+  std::memcpy(&response.requestId, header, 4);
+  response.status = static_cast<ServerResponse::Status>(static_cast<uint8_t>(header[4]));
+
+  size_t count = responseEntries(header);
+  response.recommendations.resize(count);
+  const char *p = header + RESPONSE_HEADER_SIZE;
+  for (size_t i = 0; i < count; i++, p += RESPONSE_ENTRY_SIZE)
+  {
+    std::memcpy(&response.recommendations[i].first, p, 4);
+    std::memcpy(&response.recommendations[i].second, p + 4, 4);
+  }
+}
+
+ServerClient::~ServerClient()
+{
+  close();
+}
+
+bool ServerClient::connectUnix(const std::string &path)
+{
+  close();
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path))
+    return false;
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool ServerClient::connectTcp(int port)
+{
+  close();
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ServerClient::close()
+{
+  if (fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+bool ServerClient::send(const ServerRequest &request)
+{
+  char frame[ServerProtocol::REQUEST_SIZE];
+  ServerProtocol::encodeRequest(request, frame);
+  return fd >= 0 && writeAll(fd, frame, sizeof(frame));
+}
+
+bool ServerClient::receive(ServerResponse &response)
+{
+  std::vector<char> buffer(ServerProtocol::RESPONSE_HEADER_SIZE);
+  if (fd < 0 || !readAll(fd, buffer.data(), buffer.size()))
+    return false;
+
+  size_t count = ServerProtocol::responseEntries(buffer.data());
+  buffer.resize(ServerProtocol::RESPONSE_HEADER_SIZE + count * ServerProtocol::RESPONSE_ENTRY_SIZE);
+  if (!readAll(fd, buffer.data() + ServerProtocol::RESPONSE_HEADER_SIZE,
+               count * ServerProtocol::RESPONSE_ENTRY_SIZE))
+    return false;
+
+  ServerProtocol::decodeResponse(buffer.data(), response);
+  return true;
+}
+
+bool ServerClient::call(const ServerRequest &request, ServerResponse &response)
+{
+  return send(request) && receive(response);
+}
@@ -0,0 +1,93 @@
+#ifndef SERVERPROTOCOL_H
+#define SERVERPROTOCOL_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary wire format of RecommendationServer.
+//
+// Requests are fixed 16-byte frames; responses are an 8-byte header followed
+// by count 8-byte (movieId, score) entries. Every field is little-endian.
+// Requests on one connection may be pipelined; responses carry the request's
+// id and may come back in any order.
+struct ServerRequest
+{
+  enum Op : uint8_t
+  {
+    RECOMMEND = 1
+  };
+
+  Op op = RECOMMEND;
+  uint32_t requestId = 0;
+  int userId = 0;
+  uint16_t n = 10;
+  // Per-request latency budget; 0 means no deadline
+  uint32_t budgetMicros = 0;
+};
+
+struct ServerResponse
+{
+  enum Status : uint8_t
+  {
+    OK = 0,
+    // Deadline hit: fewer candidates were scored
+    PARTIAL = 1,
+    // Deadline hit before scoring: popularity list
+    POPULARITY = 2,
+    UNKNOWN_USER = 3,
+    BAD_REQUEST = 4,
+    // Queue full; retry later
+    OVERLOADED = 5
+  };
+
+  uint32_t requestId = 0;
+  Status status = OK;
+  std::vector<std::pair<int, float>> recommendations;
+};
+
+namespace ServerProtocol
+{
+  constexpr size_t REQUEST_SIZE = 16;
+  constexpr size_t RESPONSE_HEADER_SIZE = 8;
+  constexpr size_t RESPONSE_ENTRY_SIZE = 8;
+  constexpr uint16_t MAX_RESULTS = 1000;
+
+  void encodeRequest(const ServerRequest &request, char *out);
+  // False if the frame is malformed (unknown op, n out of range)
+  bool decodeRequest(const char *in, ServerRequest &request);
+
+  void encodeResponse(const ServerResponse &response, std::string &out);
+  // Entry count announced by a response header
+  size_t responseEntries(const char *header);
+  // header must be followed by responseEntries(header) entries
+  void decodeResponse(const char *header, ServerResponse &response);
+}
+
+// Blocking client for one server connection. Requests may be pipelined by
+// calling send() several times before receive().
+class ServerClient
+{
+private:
+  int fd = -1;
+
+public:
+  ServerClient() = default;
+  ~ServerClient();
+  ServerClient(const ServerClient &) = delete;
+  ServerClient &operator=(const ServerClient &) = delete;
+
+  bool connectUnix(const std::string &path);
+  bool connectTcp(int port);
+  bool isConnected() const { return fd >= 0; }
+  void close();
+
+  bool send(const ServerRequest &request);
+  bool receive(ServerResponse &response);
+
+  // send() then receive(); only valid with nothing else in flight
+  bool call(const ServerRequest &request, ServerResponse &response);
+};
+
+#endif
@@ -0,0 +1,395 @@
+#include "ShardedPrecompute.h"
+#include "NeighborSpill.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+  const char GRAPH_MAGIC[8] = {'R', 'E', 'C', 'G', 'R', 'A', 'P', 'H'};
+  constexpr uint32_t GRAPH_FORMAT_VERSION = 1;
+
+  // Layout (native endianness, every section 8-byte aligned):
+  //   Header
+  //   UserRow[userCount + 1]      last row only marks the end of the edges
+  //   uint64 itemFirstEdge[itemCount + 1]
+  //   Edge userEdges[edgeCount]   index = item position
+  //   Edge itemEdges[edgeCount]   index = user position
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t userCount;
+    uint64_t itemCount;
+    uint64_t edgeCount;
+    uint64_t fileSize;
+  };
+
+  struct UserRow
+  {
+    int32_t userId;
+    int32_t reserved;
+    double norm;
+    uint64_t firstEdge;
+  };
+
+  struct Edge
+  {
+    int32_t index;
+    float rating;
+  };
+
+  uint64_t fileSize(uint64_t users, uint64_t items, uint64_t edges)
+  {
+    return sizeof(Header) + (users + 1) * sizeof(UserRow) +
+           (items + 1) * sizeof(uint64_t) + 2 * edges * sizeof(Edge);
+  }
+
+  // Read-only mapping of a graph file
+  class GraphFile
+  {
+  public:
+    const Header *header = nullptr;
+    const UserRow *users = nullptr;
+    const uint64_t *itemFirstEdge = nullptr;
+    const Edge *userEdges = nullptr;
+    const Edge *itemEdges = nullptr;
+
+    ~GraphFile()
+    {
+      if (mapping)
+        munmap(mapping, mappingSize);
+    }
+
+    bool open(const std::string &path)
+    {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+      struct stat st;
+      if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+      {
+        ::close(fd);
+        return false;
+      }
+      mappingSize = static_cast<size_t>(st.st_size);
+      mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (mapping == MAP_FAILED)
+      {
+        mapping = nullptr;
+        return false;
+      }
+
+      const Header *h = static_cast<const Header *>(mapping);
+      if (std::memcmp(h->magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) != 0 ||
+          h->version != GRAPH_FORMAT_VERSION || h->headerSize != sizeof(Header) ||
+          h->fileSize != mappingSize ||
+          fileSize(h->userCount, h->itemCount, h->edgeCount) != mappingSize)
+        return false;
+
+      const char *base = static_cast<const char *>(mapping) + sizeof(Header);
+      users = reinterpret_cast<const UserRow *>(base);
+      base += (h->userCount + 1) * sizeof(UserRow);
+      itemFirstEdge = reinterpret_cast<const uint64_t *>(base);
+      base += (h->itemCount + 1) * sizeof(uint64_t);
+      userEdges = reinterpret_cast<const Edge *>(base);
+      itemEdges = userEdges + h->edgeCount;
+      header = h;
+      return users[h->userCount].firstEdge == h->edgeCount &&
+             itemFirstEdge[h->itemCount] == h->edgeCount;
+    }
+
+  private:
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+  };
+
+  // First user position of a shard, cutting at equal shares of the edges
+  size_t shardBegin(const GraphFile &graph, int shard, int shardCount)
+  {
+    uint64_t target = graph.header->edgeCount * static_cast<uint64_t>(shard) / shardCount;
+    const UserRow *end = graph.users + graph.header->userCount;
+    return std::lower_bound(graph.users, end, target,
+                            [](const UserRow &row, uint64_t edge)
+                            { return row.firstEdge < edge; }) -
+           graph.users;
+  }
+
+  std::string shardPath(const std::string &directory, int shard)
+  {
+    return directory + "/shard-" + std::to_string(::getpid()) + "-" + std::to_string(shard) + ".run";
+  }
+
+  // shard_worker in the running executable's directory
+  std::string defaultWorkerPath()
+  {
+    char buffer[4096];
+    ssize_t length = ::readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+    if (length <= 0)
+      return "./shard_worker";
+    std::string self(buffer, static_cast<size_t>(length));
+    return self.substr(0, self.rfind('/') + 1) + "shard_worker";
+  }
+
+  // Flattens the ratings of userIds (ascending), read through
+  // forEachRating(userId, fn(movieId, rating)), into a graph file
+  template <typename ForEachRating>
+  bool writeGraphFile(const std::vector<int> &userIds, ForEachRating forEachRating, const std::string &path)
+  {
+    // Items are numbered by first appearance; they only key posting lists
+    std::unordered_map<int, int32_t> itemPosition;
+    std::vector<UserRow> users;
+    std::vector<Edge> userEdges;
+    users.reserve(userIds.size() + 1);
+    for (int userId : userIds)
+    {
+      UserRow row{userId, 0, 0.0, userEdges.size()};
+      forEachRating(userId, [&](int movieId, float rating)
+                    {
+        row.norm += rating * rating;
+        auto [it, _] = itemPosition.emplace(movieId, static_cast<int32_t>(itemPosition.size()));
+        userEdges.push_back({it->second, rating}); });
+      users.push_back(row);
+    }
+    users.push_back({0, 0, 0.0, userEdges.size()});
+
+    // Transpose into item posting lists of user positions
+    std::vector<uint64_t> itemFirstEdge(itemPosition.size() + 1, 0);
+    for (const Edge &edge : userEdges)
+    {
+      itemFirstEdge[edge.index + 1]++;
+    }
+    for (size_t i = 1; i < itemFirstEdge.size(); i++)
+    {
+      itemFirstEdge[i] += itemFirstEdge[i - 1];
+    }
+    std::vector<Edge> itemEdges(userEdges.size());
+    std::vector<uint64_t> fill(itemFirstEdge.begin(), itemFirstEdge.end() - 1);
+    for (size_t u = 0; u < userIds.size(); u++)
+    {
+      for (uint64_t e = users[u].firstEdge; e < users[u + 1].firstEdge; e++)
+      {
+        itemEdges[fill[userEdges[e].index]++] = {static_cast<int32_t>(u), userEdges[e].rating};
+      }
+    }
+
+    Header header{};
+    std::memcpy(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC));
+    header.version = GRAPH_FORMAT_VERSION;
+    header.headerSize = sizeof(Header);
+    header.userCount = userIds.size();
+    header.itemCount = itemPosition.size();
+    header.edgeCount = userEdges.size();
+    header.fileSize = fileSize(header.userCount, header.itemCount, header.edgeCount);
+
+    std::string tmpPath = path + ".tmp";
+    {
+      std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+      if (!file)
+        return false;
+      file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      file.write(reinterpret_cast<const char *>(users.data()), users.size() * sizeof(UserRow));
+      file.write(reinterpret_cast<const char *>(itemFirstEdge.data()), itemFirstEdge.size() * sizeof(uint64_t));
+      file.write(reinterpret_cast<const char *>(userEdges.data()), userEdges.size() * sizeof(Edge));
+      file.write(reinterpret_cast<const char *>(itemEdges.data()), itemEdges.size() * sizeof(Edge));
+      file.close();
+      if (!file)
+      {
+        std::remove(tmpPath.c_str());
+        return false;
+      }
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+  }
+}
+
+extern char **environ;
+
+bool ShardedPrecompute::writeGraph(const BipartiteGraph &graph, const std::string &path)
+{
+  TRACE_SPAN("ShardedPrecompute::writeGraph");
+  const auto &userItems = graph.getUserItems();
+  std::vector<int> userIds;
+  userIds.reserve(userItems.size());
+  for (const auto &[userId, _] : userItems)
+  {
+    userIds.push_back(userId);
+  }
+  std::sort(userIds.begin(), userIds.end());
+
+  return writeGraphFile(userIds, [&](int userId, const auto &fn)
+                        {
+    for (const auto &[movieId, rating] : userItems.at(userId))
+      fn(movieId, rating); }, path);
+}
+
+bool ShardedPrecompute::writeGraph(const CompressedAdjacency &adjacency, const std::string &path)
+{
+  TRACE_SPAN("ShardedPrecompute::writeGraph");
+  // Rows are decoded one at a time; the uncompressed graph never exists
+  return writeGraphFile(adjacency.getUserIds(), [&](int userId, const auto &fn)
+                        {
+    auto cursor = adjacency.userItems(userId);
+    int movieId;
+    float rating;
+    while (cursor.next(movieId, rating))
+      fn(movieId, rating); }, path);
+}
+
+bool ShardedPrecompute::runShard(const std::string &graphPath, int shard, int shardCount, size_t k,
+                                 const std::string &outputPath)
+{
+  TRACE_SPAN("ShardedPrecompute::runShard");
+  GraphFile graph;
+  if (!graph.open(graphPath) || shardCount < 1 || shard < 0 || shard >= shardCount)
+    return false;
+
+  size_t userCount = graph.header->userCount;
+  size_t begin = shardBegin(graph, shard, shardCount);
+  size_t end = shard + 1 < shardCount ? shardBegin(graph, shard + 1, shardCount) : userCount;
+
+  std::string tmpPath = outputPath + ".tmp";
+  std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+  if (!file)
+    return false;
+
+  // Dense accumulators over user positions, reset through `touched`
+  std::vector<double> dots(userCount, 0.0);
+  std::vector<bool> seen(userCount, false);
+  std::vector<uint32_t> touched;
+  std::vector<std::pair<int, float>> row;
+  auto byScore = [](const auto &a, const auto &b)
+  { return a.second > b.second || (a.second == b.second && a.first < b.first); };
+
+  for (size_t u = begin; u < end; u++)
+  {
+    const UserRow &user = graph.users[u];
+    for (uint64_t e = user.firstEdge; e < graph.users[u + 1].firstEdge; e++)
+    {
+      const Edge &item = graph.userEdges[e];
+      for (uint64_t p = graph.itemFirstEdge[item.index]; p < graph.itemFirstEdge[item.index + 1]; p++)
+      {
+        const Edge &other = graph.itemEdges[p];
+        if (static_cast<size_t>(other.index) == u)
+          continue;
+        if (!seen[other.index])
+        {
+          seen[other.index] = true;
+          touched.push_back(other.index);
+        }
+        dots[other.index] += item.rating * other.rating;
+      }
+    }
+
+    row.clear();
+    for (uint32_t other : touched)
+    {
+      double otherNorm = graph.users[other].norm;
+      if (user.norm > 0.0 && otherNorm > 0.0)
+      {
+        float similarity = static_cast<float>(dots[other] / (std::sqrt(user.norm) * std::sqrt(otherNorm)));
+        if (similarity > 0)
+          row.push_back({graph.users[other].userId, similarity});
+      }
+      dots[other] = 0.0;
+      seen[other] = false;
+    }
+    touched.clear();
+
+    // Users ascend and each list is best first: already in run order
+    size_t keep = std::min(row.size(), k);
+    std::partial_sort(row.begin(), row.begin() + keep, row.end(), byScore);
+    for (size_t i = 0; i < keep; i++)
+    {
+      NeighborSpill::Entry entry{user.userId, row[i].first, row[i].second};
+      file.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+  }
+
+  file.close();
+  if (!file)
+  {
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+  return std::rename(tmpPath.c_str(), outputPath.c_str()) == 0;
+}
+
+namespace
+{
+  // Writes the graph file with writeGraph(path), then runs the shards
+  bool runShards(const std::function<bool(const std::string &)> &writeGraph,
+                 const ShardedPrecompute::Options &options, size_t k,
+                 const std::function<void(int, std::vector<std::pair<int, float>> &)> &fn)
+  {
+    TRACE_SPAN("ShardedPrecompute::run");
+    int processes = std::max(1, options.processes);
+    std::string graphPath = options.workDirectory + "/graph-" + std::to_string(::getpid()) + ".bin";
+    if (!writeGraph(graphPath))
+      return false;
+
+    // The spill owns the shard runs from here on and removes them on exit
+    NeighborSpill spill(options.workDirectory, options.mergeBudget);
+    std::string workerPath = options.workerPath.empty() ? defaultWorkerPath() : options.workerPath;
+    std::string shardCount = std::to_string(processes);
+    std::string topK = std::to_string(k);
+    std::vector<pid_t> workers;
+    bool ok = true;
+    for (int shard = 0; shard < processes; shard++)
+    {
+      std::string outputPath = shardPath(options.workDirectory, shard);
+      spill.addRun(outputPath);
+      std::string shardIndex = std::to_string(shard);
+      std::vector<char *> argv = {workerPath.data(), graphPath.data(), shardIndex.data(),
+                                  shardCount.data(), topK.data(), outputPath.data(), nullptr};
+      pid_t pid;
+      if (::posix_spawn(&pid, workerPath.c_str(), nullptr, nullptr, argv.data(), environ) != 0)
+      {
+        ok = false;
+        break;
+      }
+      workers.push_back(pid);
+    }
+
+    for (pid_t pid : workers)
+    {
+      int status = 0;
+      pid_t waited;
+      do
+      {
+        waited = ::waitpid(pid, &status, 0);
+      } while (waited < 0 && errno == EINTR);
+      ok &= waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    std::remove(graphPath.c_str());
+
+    return ok && spill.merge(k, fn);
+  }
+}
+
+bool ShardedPrecompute::run(const BipartiteGraph &graph, const Options &options, size_t k,
+                            const std::function<void(int, std::vector<std::pair<int, float>> &)> &fn)
+{
+  return runShards([&](const std::string &path)
+                   { return writeGraph(graph, path); }, options, k, fn);
+}
+
+bool ShardedPrecompute::run(const CompressedAdjacency &adjacency, const Options &options, size_t k,
+                            const std::function<void(int, std::vector<std::pair<int, float>> &)> &fn)
+{
+  return runShards([&](const std::string &path)
+                   { return writeGraph(adjacency, path); }, options, k, fn);
+}
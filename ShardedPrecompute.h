@@ -0,0 +1,63 @@
+#ifndef SHARDEDPRECOMPUTE_H
+#define SHARDEDPRECOMPUTE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BipartiteGraph.h"
+#include "CompressedAdjacency.h"
+
+// User-neighbor precompute split across worker processes.
+//
+// The coordinator flattens the graph into a read-only file (user rows with
+// their rating norms, and the transposed item posting lists, both as dense
+// position arrays) and starts the shard_worker program once per shard.
+// Workers are spawned and exec'd rather than forked, so they inherit none
+// of the coordinator's threads, locks or heap. Each worker maps the file,
+// scores the exact cosine row of every user in its contiguous range of
+// user ids, and writes the top-k lists as one sorted NeighborSpill run.
+// The coordinator merges the shard runs back into per-user lists.
+//
+// Shards are balanced by rating count rather than user count. A worker
+// only needs the graph file and its shard number, so shard_worker can
+// equally be started on another host sharing the file.
+namespace ShardedPrecompute
+{
+  struct Options
+  {
+    // Holds the graph file and shard runs; all are removed before returning
+    std::string workDirectory = "/tmp";
+    int processes = 4;
+    // Read buffer shared by the shard runs during the merge
+    size_t mergeBudget = 64u << 20;
+    // The worker program; empty means shard_worker next to the running
+    // executable
+    std::string workerPath;
+  };
+
+  // Writes the flattened graph; returns false on I/O failure
+  bool writeGraph(const BipartiteGraph &graph, const std::string &path);
+  // Same, decoding one compressed row at a time
+  bool writeGraph(const CompressedAdjacency &adjacency, const std::string &path);
+
+  // Worker side (shard_worker's main): scores shard `shard` of
+  // `shardCount` from a graph file and writes its top-k lists to
+  // outputPath as a sorted run
+  bool runShard(const std::string &graphPath, int shard, int shardCount, size_t k,
+                const std::string &outputPath);
+
+  // Coordinator side: runs every shard in its own process and calls fn with
+  // each user's top-k list in ascending user order. Returns false if any
+  // worker failed or a file could not be written or read
+  bool run(const BipartiteGraph &graph, const Options &options, size_t k,
+           const std::function<void(int, std::vector<std::pair<int, float>> &)> &fn);
+
+  // Same from compressed rating lists, e.g. CompressedAdjacency::loadRatings
+  // for a graph too large to hold uncompressed
+  bool run(const CompressedAdjacency &adjacency, const Options &options, size_t k,
+           const std::function<void(int, std::vector<std::pair<int, float>> &)> &fn);
+}
+
+#endif
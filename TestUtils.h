@@ -4,6 +4,7 @@
 #include <string>
 #include <random>
 #include <algorithm>
+#include "BipartiteGraph.h"
 
 namespace TestUtils
 {
@@ -59,4 +60,35 @@ namespace TestUtils
     return ratings;
   }
 
+  // Movies 1..movieCount alternating Action/Drama, imdb 5-9
+  inline void addTwoGenreCatalog(BipartiteGraph &bg, int movieCount)
+  {
+    for (int i = 1; i <= movieCount; i++)
+    {
+      bg.addItem(i, {i % 2 ? "Action" : "Drama"}, 100, 5.0f + i % 5, 2020);
+    }
+  }
+
+  // Users 1..userCount with ratingCount random ratings each
+  inline void addRandomUsers(BipartiteGraph &bg, int userCount, int movieCount, int ratingCount, std::mt19937 &rng)
+  {
+    for (int u = 1; u <= userCount; u++)
+    {
+      bg.addUser(u, generateRandomRatings(movieCount, ratingCount, rng));
+    }
+  }
+
+  // Users 1..userCount with the same few overlapping ratings on every run
+  inline void addPatternUsers(BipartiteGraph &bg, int userCount, int movieCount)
+  {
+    for (int u = 1; u <= userCount; u++)
+    {
+      std::vector<std::pair<int, float>> ratings = {{(u - 1) % movieCount + 1, 4.0f}, {u % movieCount + 1, 3.0f}};
+      int third = (u * 7) % movieCount + 1;
+      if (third != ratings[0].first && third != ratings[1].first)
+        ratings.push_back({third, 5.0f});
+      bg.addUser(u, ratings);
+    }
+  }
+
 }
\ No newline at end of file
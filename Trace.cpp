@@ -0,0 +1,185 @@
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace
+{
+  struct ThreadRing
+  {
+    int tid = 0;
+    std::string threadName;
+    std::atomic<bool> finished{false};
+    // Total number of spans ever written; slot = head % RING_CAPACITY
+    std::atomic<uint64_t> head{0};
+    // Spans before this index were discarded by Trace::clear()
+    std::atomic<uint64_t> clearedAt{0};
+    std::vector<Trace::Event> events;
+
+    ThreadRing() : events(Trace::RING_CAPACITY) {}
+  };
+
+  struct Registry
+  {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    int nextTid = 1;
+  };
+
+  Registry &registry()
+  {
+    static Registry *instance = new Registry();
+    return *instance;
+  }
+
+  struct RingHolder
+  {
+    std::shared_ptr<ThreadRing> ring;
+
+    RingHolder() : ring(std::make_shared<ThreadRing>())
+    {
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      ring->tid = reg.nextTid++;
+      reg.rings.push_back(ring);
+    }
+
+    ~RingHolder()
+    {
+      ring->finished.store(true, std::memory_order_release);
+    }
+  };
+
+  ThreadRing &localRing()
+  {
+    thread_local RingHolder holder;
+    return *holder.ring;
+  }
+
+  const auto traceEpoch = std::chrono::steady_clock::now();
+
+  void appendJsonString(std::ostringstream &out, const std::string &s)
+  {
+    out << '"';
+    for (char c : s)
+    {
+      if (c == '"' || c == '\\')
+        out << '\\';
+      out << c;
+    }
+    out << '"';
+  }
+}
+
+uint64_t Trace::nowNs()
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - traceEpoch)
+                                   .count());
+}
+
+void Trace::record(const char *name, uint64_t beginNs, uint64_t endNs)
+{
+  auto &ring = localRing();
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  ring.events[head % RING_CAPACITY] = {name, beginNs, endNs};
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const std::string &name)
+{
+  auto &ring = localRing();
+  auto &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  ring.threadName = name;
+}
+
+std::string Trace::toChromeJson()
+{
+  auto &reg = registry();
+  std::vector<std::shared_ptr<ThreadRing>> rings;
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    rings = reg.rings;
+  }
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  for (const auto &ring : rings)
+  {
+    std::string threadName;
+    {
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      threadName = ring->threadName;
+    }
+    if (!threadName.empty())
+    {
+      out << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+          << ring->tid << ",\"args\":{\"name\":";
+      appendJsonString(out, threadName);
+      out << "}}";
+      first = false;
+    }
+
+    // Copy the live window, then drop anything the writer lapped while we
+    // were reading (a lapped slot may have been torn mid-copy)
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t start = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+    start = std::max(start, std::min(head, ring->clearedAt.load(std::memory_order_acquire)));
+    std::vector<Event> copy;
+    copy.reserve(head - start);
+    for (uint64_t i = start; i < head; i++)
+    {
+      copy.push_back(ring->events[i % RING_CAPACITY]);
+    }
+    // The writer may be filling slot headAfter, which shares its place in
+    // the ring with event headAfter - RING_CAPACITY
+    uint64_t headAfter = ring->head.load(std::memory_order_acquire);
+    uint64_t safeStart = headAfter + 1 > RING_CAPACITY ? headAfter + 1 - RING_CAPACITY : 0;
+    size_t skip = safeStart > start ? std::min<uint64_t>(safeStart - start, copy.size()) : 0;
+
+    for (size_t i = skip; i < copy.size(); i++)
+    {
+      const auto &e = copy[i];
+      out << (first ? "" : ",") << "{\"name\":";
+      appendJsonString(out, e.name);
+      out << ",\"cat\":\"recommender\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+          << ",\"ts\":" << (e.beginNs / 1000.0)
+          << ",\"dur\":" << ((e.endNs - e.beginNs) / 1000.0) << "}";
+      first = false;
+    }
+  }
+  out << "],\"displayTimeUnit\":\"ns\"}";
+  return out.str();
+}
+
+bool Trace::writeChromeJson(const std::string &path)
+{
+  std::ofstream file(path);
+  if (!file)
+    return false;
+  file << toChromeJson();
+  return static_cast<bool>(file);
+}
+
+void Trace::clear()
+{
+  auto &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  reg.rings.erase(std::remove_if(reg.rings.begin(), reg.rings.end(),
+                                 [](const auto &ring)
+                                 { return ring->finished.load(std::memory_order_acquire); }),
+                  reg.rings.end());
+  // Live rings are owned by their threads; skip past what they have written
+  // rather than racing them on the buffer contents
+  for (auto &ring : reg.rings)
+  {
+    ring->clearedAt.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped-span tracer that emits Chrome trace-event JSON (chrome://tracing,
+// Perfetto). Each thread appends completed spans to its own fixed-size ring
+// buffer; the oldest spans are overwritten when a ring is full. Only the
+// owning thread writes to a ring, so recording never takes a lock.
+//
+// Instrumentation goes through the TRACE_* macros below, which expand to
+// nothing unless the build defines RECOMMENDER_TRACE (make TRACE=1).
+class Trace
+{
+public:
+  struct Event
+  {
+    const char *name; // must point at a string literal
+    uint64_t beginNs;
+    uint64_t endNs;
+  };
+
+  static constexpr size_t RING_CAPACITY = 8192;
+
+  static uint64_t nowNs();
+
+  // Appends a completed span to the calling thread's ring
+  static void record(const char *name, uint64_t beginNs, uint64_t endNs);
+
+  // Labels the calling thread in the trace viewer
+  static void setThreadName(const std::string &name);
+
+  // Copies every thread's ring into one trace-event document
+  static std::string toChromeJson();
+  static bool writeChromeJson(const std::string &path);
+
+  // Drops recorded spans and the rings of threads that have exited
+  static void clear();
+
+  class Span
+  {
+  private:
+    const char *name;
+    uint64_t beginNs;
+
+  public:
+    explicit Span(const char *n) : name(n), beginNs(nowNs()) {}
+    ~Span() { Trace::record(name, beginNs, nowNs()); }
+  };
+
+  // Lock guard that records a span only when acquisition had to wait, so
+  // serialization on a mutex shows up in the timeline without flooding it
+  template <typename Mutex>
+  class TracedLock
+  {
+  private:
+    Mutex &mutex;
+
+  public:
+    TracedLock(Mutex &m, const char *name) : mutex(m)
+    {
+      if (!mutex.try_lock())
+      {
+        uint64_t waitStart = nowNs();
+        mutex.lock();
+        Trace::record(name, waitStart, nowNs());
+      }
+    }
+    ~TracedLock() { mutex.unlock(); }
+
+    TracedLock(const TracedLock &) = delete;
+    TracedLock &operator=(const TracedLock &) = delete;
+  };
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef RECOMMENDER_TRACE
+#define TRACE_SPAN(name) Trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#define TRACE_LOCK(var, mutex, name) Trace::TracedLock<std::decay_t<decltype(mutex)>> var(mutex, name)
+#else
+#define TRACE_SPAN(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_LOCK(var, mutex, name) std::lock_guard<std::decay_t<decltype(mutex)>> var(mutex)
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+#include "BipartiteGraph.h"
+#include "LoadGenerator.h"
+#include "Metrics.h"
+#include "ModelStore.h"
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+// Defined in main.cpp
+void loadMovies(BipartiteGraph &bg, const string &filename);
+void loadRatings(BipartiteGraph &bg, const string &filename);
+
+// Usage: loadgen (movies.csv ratings.csv | --synthetic USERS MOVIES)
+//                [--threads N] [--requests N] [--open QPS] [--n N]
+//                [--target hybrid|collaborative|content] [--zipf S]
+//                [--trace FILE] [--seed N] [--no-result-cache]
+//
+// Builds the models once, then runs the load and prints latency
+// percentiles, throughput, the result cache hit rate and the engines'
+// metrics. --no-result-cache makes every hybrid request score in full.
+int main(int argc, char **argv)
+{
+  BipartiteGraph bg;
+  LoadGenerator::Options options;
+  int first = 3;
+
+  if (argc >= 4 && string(argv[1]) == "--synthetic")
+  {
+    int users = stoi(argv[2]);
+    int movies = stoi(argv[3]);
+    LoadGenerator::buildSyntheticGraph(bg, users, movies, 20, 42);
+    first = 4;
+  }
+  else if (argc >= 3)
+  {
+    loadMovies(bg, argv[1]);
+    loadRatings(bg, argv[2]);
+  }
+  else
+  {
+    cerr << "usage: " << argv[0]
+         << " (movies.csv ratings.csv | --synthetic USERS MOVIES) [--threads N] [--requests N]"
+            " [--open QPS] [--n N] [--target hybrid|collaborative|content] [--zipf S]"
+            " [--trace FILE] [--seed N] [--no-result-cache]\n";
+    return 1;
+  }
+
+  bool resultCache = true;
+  for (int i = first; i < argc; i++)
+  {
+    string flag = argv[i];
+    if (flag == "--no-result-cache")
+    {
+      resultCache = false;
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      cerr << "missing value for " << flag << "\n";
+      return 1;
+    }
+    string value = argv[++i];
+    if (flag == "--threads")
+      options.threads = stoi(value);
+    else if (flag == "--requests")
+      options.requests = stoul(value);
+    else if (flag == "--open")
+    {
+      options.mode = LoadGenerator::OPEN_LOOP;
+      options.qps = stod(value);
+    }
+    else if (flag == "--n")
+      options.n = stoul(value);
+    else if (flag == "--target")
+      options.target = value == "collaborative" ? LoadGenerator::COLLABORATIVE
+                       : value == "content"     ? LoadGenerator::CONTENT
+                                                : LoadGenerator::HYBRID;
+    else if (flag == "--zipf")
+      options.zipfExponent = stod(value);
+    else if (flag == "--trace")
+      options.trace = LoadGenerator::loadTrace(value);
+    else if (flag == "--seed")
+      options.seed = stoull(value);
+    else
+    {
+      cerr << "unknown option " << flag << "\n";
+      return 1;
+    }
+  }
+
+  ModelVersion models(move(bg), max(1, static_cast<int>(thread::hardware_concurrency())));
+  models.hybrid.setResultCacheEnabled(resultCache);
+  LoadGenerator generator(models.graph, models.collaborative, models.content, models.hybrid);
+  cout << generator.run(options).toText();
+  cout << Metrics::snapshot().toText();
+  return 0;
+}
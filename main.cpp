@@ -2,6 +2,7 @@
 #include "Collabrative.h"
 #include "Content.h"
 #include "Hybrid.h"
+#include "ModelStore.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -86,16 +87,11 @@ void loadRatings(BipartiteGraph &bg, const string &filename)
   }
 }
 
-// Function to run recommendations for a specific user
-vector<pair<int, float>> getRecommendationsForUser(int userId, BipartiteGraph &bg)
+// Function to run recommendations for a specific user. The models are built
+// once per graph (ModelVersion) and reused across calls
+vector<pair<int, float>> getRecommendationsForUser(int userId, const ModelVersion &models)
 {
-  Collaborative collaborative(bg);
-  Content content(bg);
-  collaborative.preComputeSimilarities();
-  content.preComputeSimilarities();
-
-  Hybrid hybrid(bg, collaborative, content);
-  auto recommendations = hybrid.getRecommendations(userId);
+  auto recommendations = models.hybrid.getRecommendations(userId);
 
   // Convert double scores to float
   vector<pair<int, float>> floatRecommendations;
@@ -104,4 +100,4 @@ vector<pair<int, float>> getRecommendationsForUser(int userId, BipartiteGraph &b
     floatRecommendations.push_back({movieId, static_cast<float>(score)});
   }
   return floatRecommendations;
-}
\ No newline at end of file
+}
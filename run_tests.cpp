@@ -2,6 +2,26 @@
 #include "Collabrative.h"
 #include "Content.h"
 #include "Hybrid.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Arena.h"
+#include "CompressedAdjacency.h"
+#include "ModelSnapshot.h"
+#include "RatingLog.h"
+#include "RatingBatcher.h"
+#include "ModelStore.h"
+#include "ItemFilter.h"
+#include "ResultCache.h"
+#include "RecommendationServer.h"
+#include "LoadGenerator.h"
+#include "MinHashLsh.h"
+#include "DenseSimilarity.h"
+#include "GraphOrdering.h"
+#include "NeighborSpill.h"
+#include "ShardedPrecompute.h"
+#include "QuantizedNeighbors.h"
+#include "MemoryAccounting.h"
+#include <atomic>
 #include "TestUtils.h"
 #include <iostream>
 #include <cassert>
@@ -11,7 +31,20 @@
 #include <iomanip>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
 #include <algorithm>
+#include <numeric>
+#include <unordered_set>
+#include <map>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <filesystem>
 
 using namespace std;
 using namespace TestUtils;
@@ -22,6 +55,13 @@ void printTestResult(const string &testName, bool passed)
   cout << setw(60) << left << testName << ": " << (passed ? "PASSED" : "FAILED") << endl;
 }
 
+// Scratch files go under TEST_DATA_DIR when set (see Dockerfile)
+string testDataPath(const string &name)
+{
+  const char *dir = getenv("TEST_DATA_DIR");
+  return string(dir ? dir : "/tmp") + "/" + name;
+}
+
 // Helper function to measure execution time
 template <typename Func>
 double measureExecutionTime(Func func)
@@ -156,6 +196,40 @@ bool test_PageRank_HandlesIsolatedUsers()
   return rank1 > 0 && rank2 > 0; // Should assign non-zero ranks
 }
 
+bool test_PageRank_SharedAndComputedOnce()
+{
+  BipartiteGraph bg;
+  bg.addItem(1, {"Action"}, 120, 8.0, 2020);
+  bg.addItem(2, {"Action"}, 115, 7.5, 2020);
+  bg.addItem(3, {"Drama"}, 110, 7.0, 2020);
+  bg.addUser(1, {{1, 5.0}, {2, 4.8}});
+  bg.addUser(2, {{1, 4.9}, {3, 3.0}});
+  bg.addUser(3, {{3, 4.0}});
+
+  uint64_t runsBefore = Metrics::snapshot().counter(Metrics::PAGERANK_RUNS);
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  Hybrid hybrid(bg, collab, content, pageRank);
+  Hybrid sharedViaCollab(bg, collab, content);
+  bool lazy = !pageRank.isComputed() &&
+              Metrics::snapshot().counter(Metrics::PAGERANK_RUNS) == runsBefore;
+
+  for (int round = 0; round < 3; round++)
+  {
+    for (int u = 1; u <= 3; u++)
+    {
+      hybrid.getRecommendations(u);
+      sharedViaCollab.getRecommendations(u);
+    }
+  }
+  bool once = Metrics::snapshot().counter(Metrics::PAGERANK_RUNS) == runsBefore + 1;
+
+  return lazy && once && &collab.getPageRank() == &pageRank &&
+         hybrid.getUserPageRank(1) == sharedViaCollab.getUserPageRank(1);
+}
+
 // Test Suite 4: Hybrid Recommendation Integration Tests
 bool test_Hybrid_CombinesAllComponents()
 {
@@ -205,6 +279,2057 @@ bool test_Hybrid_HandlesEdgeCases()
   return recs.empty(); // Should handle case with no unwatched movies
 }
 
+bool test_Hybrid_TwoStageCandidates()
+{
+  BipartiteGraph bg;
+  mt19937 rng(17);
+  const int NUM_MOVIES = 400;
+  const int NUM_USERS = 40;
+  vector<string> genres = {"Action", "Drama", "Comedy", "Sci-Fi", "Horror"};
+  for (int i = 1; i <= NUM_MOVIES; i++)
+  {
+    bg.addItem(i, {genres[i % genres.size()], genres[(i / 7) % genres.size()]}, 100, 7.0, 2020);
+  }
+  for (int u = 1; u <= NUM_USERS; u++)
+  {
+    bg.addUser(u, generateRandomRatings(NUM_MOVIES, 15, rng));
+  }
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+  Hybrid hybrid(bg, collab, content, pageRank);
+
+  // The default limits scale with the catalog, so 400 items are pruned to
+  // a quarter of them
+  bool prunedByDefault = true;
+  for (int u = 1; u <= 5; u++)
+  {
+    prunedByDefault &= hybrid.getCandidates(u).size() == NUM_MOVIES / 4;
+  }
+
+  // Content neighbors come from the per-item top lists, which cache
+  // eviction does not thin out
+  size_t contentBudget = MemoryAccounting::getBudget(MemoryAccounting::CONTENT_SIMILARITY_CACHE);
+  MemoryAccounting::setBudget(MemoryAccounting::CONTENT_SIMILARITY_CACHE, 16u << 10);
+  Content evicted(bg);
+  evicted.preComputeSimilarities(2);
+  MemoryAccounting::setBudget(MemoryAccounting::CONTENT_SIMILARITY_CACHE, contentBudget);
+  auto topLists = evicted.getItemNeighbors();
+  auto cachedLists = evicted.getNeighborLists();
+  bool keptTopLists = topLists.size() == static_cast<size_t>(NUM_MOVIES) && cachedLists.size() < topLists.size();
+  for (const auto &[movieId, list] : topLists)
+  {
+    keptTopLists &= list.size() == Content::NEIGHBORS_PER_ITEM &&
+                    list == content.getItemNeighbors().at(movieId);
+  }
+
+  Hybrid::CandidateOptions options;
+  options.maxCandidates = 60;
+  options.neighborItems = 30;
+  options.similarItems = 20;
+  options.genrePopular = 10;
+  hybrid.setCandidateOptions(options);
+
+  bool valid = true;
+  for (int u = 1; u <= NUM_USERS; u++)
+  {
+    auto candidates = hybrid.getCandidates(u);
+    const Bitset &watched = bg.getWatchedItems(u);
+    unordered_set<int> unique(candidates.begin(), candidates.end());
+    valid &= candidates.size() == options.maxCandidates && unique.size() == candidates.size();
+    for (int movieId : candidates)
+    {
+      valid &= !watched.test(bg.getItemIndex(movieId));
+    }
+
+    // The top neighbor's items are among the candidates
+    auto neighbors = collab.getNeighbors(u);
+    if (!neighbors.empty())
+    {
+      bool fromNeighbor = false;
+      for (const auto &[movieId, _] : bg.getUserItems().at(neighbors[0].first))
+      {
+        fromNeighbor |= unique.count(movieId) > 0;
+      }
+      valid &= fromNeighbor;
+    }
+  }
+
+  // Only candidates reach the scorer
+  auto before = Metrics::snapshot().histogram(Metrics::HYBRID_CANDIDATES);
+  auto recs = hybrid.getRecommendations(1);
+  auto after = Metrics::snapshot().histogram(Metrics::HYBRID_CANDIDATES);
+  auto candidates = hybrid.getCandidates(1);
+  unordered_set<int> candidateSet(candidates.begin(), candidates.end());
+  bool scoredCandidates = recs.size() == 10 &&
+                          after.sum - before.sum == options.maxCandidates;
+  for (const auto &[movieId, _] : recs)
+  {
+    scoredCandidates &= candidateSet.count(movieId) > 0;
+  }
+
+  return valid && scoredCandidates && prunedByDefault && keptTopLists;
+}
+
+bool test_Hybrid_DeadlineDegradesGracefully()
+{
+  BipartiteGraph bg;
+  mt19937 rng(23);
+  addTwoGenreCatalog(bg, 60);
+  addRandomUsers(bg, 30, 60, 8, rng);
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+  Hybrid hybrid(bg, collab, content, pageRank);
+
+  // A generous budget changes nothing
+  auto full = hybrid.getRecommendations(1, 10, chrono::seconds(10));
+  bool fullMatches = !full.degraded() && full.recommendations == hybrid.getRecommendations(1, 10);
+
+  // So does an unbounded one, rather than overflowing into the past. A
+  // user not served yet, so the result cache cannot answer
+  auto unbounded = hybrid.getRecommendations(4, 10, chrono::nanoseconds::max());
+  auto unboundedFiltered = hybrid.getRecommendations(5, 10, chrono::nanoseconds::max(), ItemFilter().genre("Drama"));
+  fullMatches &= unbounded.quality == Hybrid::Result::FULL &&
+                 unbounded.recommendations == hybrid.getRecommendations(4, 10) &&
+                 unboundedFiltered.quality == Hybrid::Result::FULL;
+
+  // An already expired budget serves the popularity list
+  uint64_t fallbacksBefore = Metrics::snapshot().counter(Metrics::HYBRID_POPULARITY_FALLBACKS);
+  auto expired = hybrid.getRecommendations(2, 10, chrono::nanoseconds(0));
+  auto popular = collab.getPopularRecommendations(bg.getWatchedItems(2), 10);
+  bool fellBack = expired.degraded() && expired.quality == Hybrid::Result::POPULARITY &&
+                  expired.recommendations.size() == popular.size() &&
+                  Metrics::snapshot().counter(Metrics::HYBRID_POPULARITY_FALLBACKS) == fallbacksBefore + 1;
+  for (size_t i = 0; fellBack && i < popular.size(); i++)
+  {
+    fellBack &= expired.recommendations[i].first == popular[i].first &&
+                !bg.getWatchedItems(2).test(bg.getItemIndex(popular[i].first));
+  }
+
+  // Every unwatched item of the small catalog is a candidate, but the
+  // neighbors' strongest item comes first, ahead of the catalog order
+  auto candidates = hybrid.getCandidates(3);
+  const Bitset &watched = bg.getWatchedItems(3);
+  unordered_map<int, double> neighborScores;
+  for (const auto &[neighborId, similarity] : collab.getNeighbors(3))
+  {
+    for (const auto &[movieId, rating] : bg.getUserItems().at(neighborId))
+    {
+      if (!watched.test(bg.getItemIndex(movieId)))
+        neighborScores[movieId] += similarity * rating;
+    }
+  }
+  int strongest = -1;
+  for (const auto &[movieId, score] : neighborScores)
+  {
+    if (strongest < 0 || score > neighborScores[strongest] ||
+        (score == neighborScores[strongest] && movieId < strongest))
+      strongest = movieId;
+  }
+  bool sourceOrder = candidates.size() == 60 - watched.count() && !candidates.empty() &&
+                     candidates[0] == strongest;
+
+  return fullMatches && fellBack && !popular.empty() && sourceOrder;
+}
+
+bool test_ItemFilter_PushesDownIntoEngines()
+{
+  BipartiteGraph bg;
+  mt19937 rng(29);
+  vector<string> genres = {"Action", "Drama", "Comedy", "Sci-Fi"};
+  uniform_int_distribution<int> lengthDist(70, 200);
+  uniform_real_distribution<float> imdbDist(3.0f, 9.5f);
+  for (int i = 1; i <= 120; i++)
+  {
+    bg.addItem(i, {genres[i % 4], genres[(i / 5) % 4]}, lengthDist(rng), imdbDist(rng), i % 4);
+  }
+  // Replacing an item moves it between bitmaps
+  bg.addItem(3, {"Comedy"}, 95, 7.25f, 1);
+  for (int u = 1; u <= 30; u++)
+  {
+    bg.addUser(u, generateRandomRatings(120, 10, rng));
+  }
+
+  auto passes = [&](const BipartiteGraph::Item &item)
+  {
+    bool comedy = find(item.genres.begin(), item.genres.end(), "Comedy") != item.genres.end();
+    return item.rating <= 2 && item.length <= 119 && item.imdb >= 6.3f && item.imdb <= 8.75f && comedy;
+  };
+  ItemFilter filter = ItemFilter().ratingAtMost(2).lengthAtMost(119).imdbAtLeast(6.3f).imdbAtMost(8.75f).genre("Comedy");
+
+  // The compiled bitmap matches a brute-force scan
+  const Bitset &watched = bg.getWatchedItems(1);
+  Bitset excluded = filter.excludedItems(bg, watched);
+  bool exact = true;
+  size_t allowed = 0;
+  for (size_t i = 0; i < bg.getItemCount(); i++)
+  {
+    bool expectExcluded = watched.test(i) || !passes(bg.getItemAt(i));
+    exact &= excluded.test(i) == expectExcluded;
+    allowed += !expectExcluded;
+  }
+  exact &= passes(bg.getItems().at(3)) && allowed > 0;
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+  Hybrid hybrid(bg, collab, content, pageRank);
+
+  auto allPass = [&](const auto &recs, int userId)
+  {
+    bool ok = true;
+    for (const auto &[movieId, _] : recs)
+    {
+      int index = bg.getItemIndex(movieId);
+      ok &= passes(bg.getItemAt(index)) && !bg.getWatchedItems(userId).test(index);
+    }
+    return ok;
+  };
+
+  auto before = Metrics::snapshot().histogram(Metrics::HYBRID_CANDIDATES);
+  auto hybridRecs = hybrid.getRecommendations(1, 10, filter);
+  auto filteredCandidates = Metrics::snapshot().histogram(Metrics::HYBRID_CANDIDATES).sum - before.sum;
+  hybrid.getRecommendations(1, 10);
+  auto unfilteredCandidates = Metrics::snapshot().histogram(Metrics::HYBRID_CANDIDATES).sum - before.sum - filteredCandidates;
+
+  bool engines = allPass(hybridRecs, 1) &&
+                 hybridRecs.size() == min<size_t>(10, allowed) &&
+                 allPass(content.getRecommendations(1, 10, filter), 1) &&
+                 allPass(collab.getRecommendations(1, 10, filter), 1) &&
+                 allPass(content.getRecommendations(999, 10, filter), 999) &&
+                 filteredCandidates == allowed && filteredCandidates < unfilteredCandidates;
+
+  return exact && engines && ItemFilter().empty() && !filter.empty();
+}
+
+bool test_ColdStart_ListsBuiltOncePerVersion()
+{
+  BipartiteGraph bg;
+  mt19937 rng(31);
+  addTwoGenreCatalog(bg, 50);
+  addRandomUsers(bg, 20, 50, 10, rng);
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+
+  // Many cold-start requests build each list once
+  uint64_t buildsBefore = Metrics::snapshot().counter(Metrics::POPULARITY_LIST_BUILDS);
+  vector<pair<int, float>> first;
+  bool stable = true;
+  for (int u = 1000; u < 1050; u++)
+  {
+    auto collabRecs = collab.getRecommendations(u);
+    auto contentRecs = content.getRecommendations(u, 5);
+    if (first.empty())
+      first = contentRecs;
+    stable &= contentRecs == first && collabRecs.size() == 5;
+  }
+  bool builtOnce = Metrics::snapshot().counter(Metrics::POPULARITY_LIST_BUILDS) == buildsBefore + 2;
+
+  // Matches a fresh sort of the catalog
+  vector<pair<int, float>> byImdb;
+  for (const auto &[movieId, item] : bg.getItems())
+  {
+    byImdb.push_back({movieId, item.imdb});
+  }
+  sort(byImdb.begin(), byImdb.end(), [](const auto &a, const auto &b)
+       { return a.second > b.second; });
+  bool correct = first.size() == 5 && first[0].second == byImdb[0].second &&
+                 first[4].second == byImdb[4].second;
+
+  // A graph change refreshes the lists on the next request
+  bg.addItem(51, {"Drama"}, 100, 9.9f, 2020);
+  auto refreshed = content.getRecommendations(1000, 5);
+  bool refreshedOnce = refreshed[0].first == 51 &&
+                       content.getRecommendations(1001, 5) == refreshed &&
+                       Metrics::snapshot().counter(Metrics::POPULARITY_LIST_BUILDS) == buildsBefore + 3;
+
+  return stable && builtOnce && correct && refreshedOnce;
+}
+
+bool test_Hybrid_ModelChangesInvalidateCaches()
+{
+  BipartiteGraph bg;
+  mt19937 rng(40);
+  addTwoGenreCatalog(bg, 60);
+  addRandomUsers(bg, 50, 60, 10, rng);
+
+  // Serve every user before either model is precomputed, so the result
+  // cache, score cache and candidate index all hold results of the old one
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  Hybrid hybrid(bg, collab, content, pageRank);
+  for (int u = 1; u <= 50; u++)
+  {
+    hybrid.getRecommendations(u, 10);
+  }
+
+  uint64_t collabBefore = collab.getModelVersion(), contentBefore = content.getModelVersion();
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+  bool bumped = collab.getModelVersion() != collabBefore && content.getModelVersion() != contentBefore;
+
+  Hybrid fresh(bg, collab, content, pageRank);
+  bool matchesFresh = true;
+  for (int u = 1; u <= 50; u++)
+  {
+    matchesFresh &= hybrid.getRecommendations(u, 10) == fresh.getRecommendations(u, 10);
+  }
+
+  // Switching the neighbor precision is a model change too
+  collabBefore = collab.getModelVersion();
+  collab.setNeighborPrecision(Collaborative::INT8);
+  bumped &= collab.getModelVersion() != collabBefore;
+
+  return bumped && matchesFresh;
+}
+
+bool test_ResultCache_InvalidatesOnVersionChange()
+{
+  BipartiteGraph bg;
+  mt19937 rng(37);
+  addTwoGenreCatalog(bg, 40);
+  addRandomUsers(bg, 20, 40, 8, rng);
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+  Hybrid hybrid(bg, collab, content, pageRank);
+
+  // Repeats hit, including concurrent ones; a different filter does not
+  auto hitsBefore = Metrics::snapshot().counter(Metrics::RESULT_CACHE_HIT);
+  auto first = hybrid.getRecommendations(1, 10);
+  bool repeatsHit = true;
+  vector<thread> threads;
+  for (int t = 0; t < 4; t++)
+  {
+    threads.emplace_back([&]()
+                         {
+      for (int i = 0; i < 10; i++)
+      {
+        if (hybrid.getRecommendations(1, 10) != first)
+          repeatsHit = false;
+      } });
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  auto filtered = hybrid.getRecommendations(1, 10, ItemFilter().genre("Drama"));
+  repeatsHit &= Metrics::snapshot().counter(Metrics::RESULT_CACHE_HIT) == hitsBefore + 40;
+
+  // Rating the top recommendation bumps the graph version and evicts it
+  bg.addRating(1, first[0].first, 4.0f);
+  collab.onRatingAdded(1, first[0].first, 4.0f);
+  auto updated = hybrid.getRecommendations(1, 10);
+  bool invalidated = Metrics::snapshot().counter(Metrics::RESULT_CACHE_HIT) == hitsBefore + 40;
+  for (const auto &[movieId, _] : updated)
+  {
+    invalidated &= movieId != first[0].first;
+  }
+
+  // The cache stays within its capacity
+  ResultCache cache(32);
+  for (int u = 0; u < 200; u++)
+  {
+    cache.insert({u, 10, ItemFilter()}, {1, 1}, {{u, 1.0}});
+  }
+  ResultCache::Value value;
+  bool bounded = cache.size() <= 32 && cache.lookup({199, 10, ItemFilter()}, {1, 1}, value) &&
+                 value[0].first == 199 && !cache.lookup({199, 10, ItemFilter()}, {2, 1}, value) &&
+                 !cache.lookup({199, 10, ItemFilter()}, {1, 1}, value);
+
+  return repeatsHit && !filtered.empty() && invalidated && bounded;
+}
+
+bool test_RecommendationServer_ServesPipelinedRequests()
+{
+  BipartiteGraph bg;
+  addTwoGenreCatalog(bg, 30);
+  addPatternUsers(bg, 20, 30);
+  ModelStore store(bg, 2);
+
+  RecommendationServer::Options options;
+  options.unixPath = testDataPath("test_server.sock");
+  options.tcpPort = 0;
+  options.workers = 2;
+  options.maxBatchSize = 8;
+  options.maxInFlightPerConnection = 16;
+  RecommendationServer server(store, options);
+  if (!server.start())
+    return false;
+
+  // Pipelined requests over the Unix socket, more than the in-flight limit
+  ServerClient client;
+  bool served = client.connectUnix(options.unixPath);
+  for (uint32_t id = 0; id < 60; id++)
+  {
+    served &= client.send({ServerRequest::RECOMMEND, id, static_cast<int>(id % 20) + 1, 5, 0});
+  }
+  vector<bool> seen(60, false);
+  for (int i = 0; i < 60 && served; i++)
+  {
+    ServerResponse response;
+    served = client.receive(response) && response.requestId < 60 &&
+             response.status == ServerResponse::OK && response.recommendations.size() == 5;
+    if (served)
+      seen[response.requestId] = true;
+  }
+  served &= count(seen.begin(), seen.end(), true) == 60;
+
+  // Same answer as calling the engine directly, over TCP
+  ServerClient tcpClient;
+  ServerResponse response;
+  bool matches = tcpClient.connectTcp(server.getTcpPort()) &&
+                 tcpClient.call({ServerRequest::RECOMMEND, 7, 3, 5, 0}, response);
+  auto expected = store.read()->hybrid.getRecommendations(3, 5);
+  matches &= response.requestId == 7 && response.recommendations.size() == expected.size();
+  for (size_t i = 0; matches && i < expected.size(); i++)
+  {
+    matches = response.recommendations[i].first == expected[i].first;
+  }
+
+  // Errors are per request and the connection stays usable. The budgeted
+  // request asks for an uncached n so it cannot be served from the cache
+  bool errors = tcpClient.call({ServerRequest::RECOMMEND, 8, 999, 5, 0}, response) &&
+                response.status == ServerResponse::UNKNOWN_USER &&
+                tcpClient.call({ServerRequest::RECOMMEND, 9, 1, 0, 0}, response) &&
+                response.status == ServerResponse::BAD_REQUEST &&
+                tcpClient.call({ServerRequest::RECOMMEND, 10, 1, 4, 1}, response) &&
+                response.status != ServerResponse::OK && !response.recommendations.empty();
+  server.stop();
+
+  // A full queue rejects instead of queueing
+  options.tcpPort = -1;
+  options.maxQueueSize = 0;
+  RecommendationServer overloaded(store, options);
+  ServerClient rejected;
+  bool backpressure = overloaded.start() && rejected.connectUnix(options.unixPath) &&
+                      rejected.call({ServerRequest::RECOMMEND, 11, 1, 5, 0}, response) &&
+                      response.status == ServerResponse::OVERLOADED;
+  overloaded.stop();
+
+  return served && matches && errors && backpressure;
+}
+
+bool test_ServerClient_RetriesInterruptedReads()
+{
+  // A listener that answers late, so a signal lands while receive() waits
+  string path = testDataPath("test_client_eintr.sock");
+  ::unlink(path.c_str());
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      ::listen(listener, 1) != 0)
+    return false;
+
+  // No SA_RESTART: the blocked read fails with EINTR
+  struct sigaction interrupt{}, saved{};
+  interrupt.sa_handler = [](int) {};
+  sigaction(SIGUSR1, &interrupt, &saved);
+
+  ServerClient client;
+  bool connected = client.connectUnix(path);
+  int peer = ::accept(listener, nullptr, nullptr);
+  pthread_t reader = pthread_self();
+  thread server([&]()
+                {
+                  this_thread::sleep_for(chrono::milliseconds(30));
+                  pthread_kill(reader, SIGUSR1);
+                  this_thread::sleep_for(chrono::milliseconds(30));
+                  ServerResponse response;
+                  response.requestId = 42;
+                  response.recommendations = {{1, 0.5f}};
+                  string frame;
+                  ServerProtocol::encodeResponse(response, frame);
+                  (void)::write(peer, frame.data(), frame.size());
+                });
+
+  ServerResponse response;
+  bool received = connected && client.receive(response) && response.requestId == 42 &&
+                  response.recommendations.size() == 1;
+  server.join();
+  sigaction(SIGUSR1, &saved, nullptr);
+  ::close(peer);
+  ::close(listener);
+  ::unlink(path.c_str());
+  return received;
+}
+
+bool test_LoadGenerator_ReportsPercentiles()
+{
+  BipartiteGraph bg;
+  mt19937 rng(11);
+  addTwoGenreCatalog(bg, 30);
+  addRandomUsers(bg, 20, 30, 6, rng);
+  ModelVersion models(bg, 2);
+  LoadGenerator generator(models.graph, models.collaborative, models.content, models.hybrid);
+
+  // Zipf puts most of the mass on the first ranks; exponent 0 is uniform
+  LoadGenerator::ZipfSampler skewed(20, 1.2), uniform(20, 0.0);
+  mt19937_64 sampleRng(5);
+  vector<int> skewedCounts(20), uniformCounts(20);
+  for (int i = 0; i < 20000; i++)
+  {
+    skewedCounts[skewed(sampleRng)]++;
+    uniformCounts[uniform(sampleRng)]++;
+  }
+  bool zipf = skewedCounts[0] > 4 * skewedCounts[10] &&
+              uniformCounts[0] < 2 * uniformCounts[10];
+
+  LoadGenerator::Options options;
+  options.threads = 3;
+  options.requests = 60;
+  auto closed = generator.run(options);
+  bool closedOk = closed.requests == 60 && closed.errors == 0 && closed.throughput > 0 &&
+                  closed.p50Ns <= closed.p90Ns && closed.p90Ns <= closed.p99Ns &&
+                  closed.p99Ns <= closed.p999Ns && closed.p999Ns <= closed.maxNs;
+
+  // 60 hybrid requests over 20 users repeat users, so some hit the result
+  // cache; with it disabled every request scores and none look it up
+  bool cacheReported = closed.resultCacheHits > 0 &&
+                       closed.resultCacheHits + closed.resultCacheMisses == 60 &&
+                       closed.resultCacheHitRate() > 0.0;
+  models.hybrid.setResultCacheEnabled(false);
+  auto uncached = generator.run(options);
+  models.hybrid.setResultCacheEnabled(true);
+  cacheReported &= uncached.requests == 60 && uncached.resultCacheHits == 0 &&
+                   uncached.resultCacheMisses == 0;
+
+  // The synthetic catalog is reproducible from its seed
+  BipartiteGraph synthetic, again;
+  LoadGenerator::buildSyntheticGraph(synthetic, 30, 40, 5, 7);
+  LoadGenerator::buildSyntheticGraph(again, 30, 40, 5, 7);
+  bool syntheticOk = synthetic.getItemCount() == 40 && synthetic.getUserItems().size() == 30 &&
+                     synthetic.getUserItems().at(1) == again.getUserItems().at(1) &&
+                     synthetic.getUserItems().at(1).size() == 5;
+
+  // Open loop holds the schedule: 40 requests at 400/s take at least ~0.1s
+  options.mode = LoadGenerator::OPEN_LOOP;
+  options.qps = 400;
+  options.requests = 40;
+  options.target = LoadGenerator::COLLABORATIVE;
+  auto open = generator.run(options);
+  bool openOk = open.requests == 40 && open.seconds >= 0.095;
+
+  // Replayed traces count users the graph does not have as errors
+  string tracePath = testDataPath("test_loadgen_trace.txt");
+  {
+    ofstream trace(tracePath);
+    trace << "1\n2\n\n999\n3\n";
+  }
+  options.mode = LoadGenerator::CLOSED_LOOP;
+  options.target = LoadGenerator::CONTENT;
+  options.trace = LoadGenerator::loadTrace(tracePath);
+  options.requests = 8;
+  auto replayed = generator.run(options);
+  remove(tracePath.c_str());
+  bool traceOk = options.trace == vector<int>{1, 2, 999, 3} &&
+                 replayed.requests == 8 && replayed.errors == 2;
+
+  return zipf && closedOk && cacheReported && syntheticOk && openOk && traceOk;
+}
+
+bool test_MinHashLsh_RecallAgainstExactNeighbors()
+{
+  // Clustered synthetic data: users mostly rate from their cluster's pool,
+  // so true neighbors share many items and LSH has something to find
+  BipartiteGraph bg;
+  mt19937 rng(43);
+  const int CLUSTERS = 8, USERS_PER_CLUSTER = 40, POOL = 25, MOVIES = CLUSTERS * POOL;
+  for (int i = 1; i <= MOVIES; i++)
+  {
+    bg.addItem(i, {"Drama"}, 100, 7.0, 2020);
+  }
+  uniform_real_distribution<float> ratingDist(1.0f, 5.0f);
+  for (int u = 0; u < CLUSTERS * USERS_PER_CLUSTER; u++)
+  {
+    int cluster = u / USERS_PER_CLUSTER;
+    vector<pair<int, float>> ratings;
+    for (const auto &[movieId, rating] : generateRandomRatings(POOL, 12, rng))
+    {
+      ratings.push_back({cluster * POOL + movieId, rating});
+    }
+    ratings.push_back({uniform_int_distribution<int>(1, MOVIES)(rng), ratingDist(rng)});
+    sort(ratings.begin(), ratings.end());
+    ratings.erase(unique(ratings.begin(), ratings.end(),
+                         [](const auto &a, const auto &b)
+                         { return a.first == b.first; }),
+                  ratings.end());
+    bg.addUser(u + 1, ratings);
+  }
+  size_t allPairs = static_cast<size_t>(CLUSTERS * USERS_PER_CLUSTER) * (CLUSTERS * USERS_PER_CLUSTER - 1) / 2;
+
+  PageRank pageRank(bg);
+  Collaborative exact(bg, pageRank);
+  exact.preComputeSimilarities(2);
+  auto exactLists = exact.getNeighborLists();
+
+  // Wide bands (many, short) favor recall; tall bands favor selectivity
+  MinHashLsh::Options wide;
+  wide.bands = 32;
+  wide.rowsPerBand = 2;
+  MinHashLsh::Options tall;
+  tall.bands = 8;
+  tall.rowsPerBand = 4;
+
+  Collaborative wideApprox(bg, pageRank), tallApprox(bg, pageRank);
+  size_t wideScored = wideApprox.preComputeSimilaritiesApprox(wide, 2);
+  size_t tallScored = tallApprox.preComputeSimilaritiesApprox(tall, 2);
+  double wideRecall = MinHashLsh::recallAtK(exactLists, wideApprox.getNeighborLists(), 10);
+  double tallRecall = MinHashLsh::recallAtK(exactLists, tallApprox.getNeighborLists(), 10);
+
+  cout << "LSH 32x2: recall@10 " << wideRecall << ", " << wideScored << "/" << allPairs << " pairs" << endl;
+  cout << "LSH 8x4:  recall@10 " << tallRecall << ", " << tallScored << "/" << allPairs << " pairs" << endl;
+
+  // Identical item sets always collide
+  MinHashLsh lsh(wide);
+  bool deterministic = lsh.signature({{1, 4.0f}, {7, 2.0f}}) == lsh.signature({{7, 5.0f}, {1, 1.0f}});
+
+  return deterministic && wideRecall >= 0.9 && wideScored < allPairs / 2 &&
+         tallScored < wideScored && tallRecall < wideRecall &&
+         MinHashLsh::recallAtK(exactLists, exactLists, 10) == 1.0;
+}
+
+bool test_DenseSimilarity_MatchesSparseKernel()
+{
+  BipartiteGraph bg;
+  mt19937 rng(44);
+  for (int i = 1; i <= 150; i++)
+  {
+    bg.addItem(i, generateRandomGenres(2, rng), 100, 7.0, 2020);
+  }
+  for (int u = 1; u <= 300; u++)
+  {
+    bg.addUser(u, generateRandomRatings(150, 15, rng));
+  }
+  // A user without ratings gets no neighbors from either kernel
+  bg.addUser(301, {});
+
+  PageRank pageRank(bg);
+  Collaborative sparse(bg, pageRank), dense(bg, pageRank);
+  sparse.setSimilarityKernel(Collaborative::SPARSE);
+  dense.setSimilarityKernel(Collaborative::DENSE);
+  double sparseMs = measureExecutionTime([&]()
+                                { sparse.preComputeSimilarities(2); });
+  double denseMs = measureExecutionTime([&]()
+                               { dense.preComputeSimilarities(2); });
+  cout << "All-pairs similarity: sparse " << sparseMs << "ms, dense " << denseMs << "ms" << endl;
+
+  // Same neighbor similarities in the same order; ids may differ only
+  // between exact ties
+  auto sparseLists = sparse.getNeighborLists();
+  auto denseLists = dense.getNeighborLists();
+  bool matches = sparseLists.size() == denseLists.size();
+  for (const auto &[userId, expected] : sparseLists)
+  {
+    auto it = denseLists.find(userId);
+    if (!matches || it == denseLists.end() || it->second.size() != expected.size())
+    {
+      matches = false;
+      break;
+    }
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+      matches &= fabs(it->second[i].second - expected[i].second) < 1e-5f;
+    }
+  }
+
+  // Auto mode only picks the dense kernel for small catalogs
+  BipartiteGraph large;
+  for (int i = 1; i <= static_cast<int>(DenseSimilarity::MAX_ITEMS) + 1; i++)
+  {
+    large.addItem(i, {"Drama"}, 100, 7.0, 2020);
+  }
+  bool switches = DenseSimilarity::suitable(bg) && !DenseSimilarity::suitable(large);
+
+  return matches && switches && dense.getNeighbors(301).empty();
+}
+
+// The shared-movie counting PageRank used before the bitset kernel, kept
+// as a reference: one hash-set probe per rating per user pair
+unordered_map<int, double> referencePageRanks(const BipartiteGraph &bg)
+{
+  const auto &users = bg.getUserItems();
+  const double DAMPING = 0.85;
+  size_t maxRatings = 0;
+  unordered_map<int, double> ranks;
+  for (const auto &[userId, ratings] : users)
+  {
+    maxRatings = max(maxRatings, ratings.size());
+    ranks[userId] = 1.0 / users.size();
+  }
+
+  for (int iteration = 0; iteration < 50; iteration++)
+  {
+    unordered_map<int, double> newRanks;
+    double totalDiff = 0.0;
+    for (const auto &[userId, ratings] : users)
+    {
+      double ratio = static_cast<double>(ratings.size()) / maxRatings;
+      double activity = ratio >= 0.5 ? 3.0 : 1.0 + 2.0 / (1.0 + exp(-10 * (ratio - 0.5)));
+      double newRank = (1.0 - DAMPING) / users.size();
+      unordered_set<int> movies;
+      for (const auto &[movieId, _] : ratings)
+        movies.insert(movieId);
+      for (const auto &[otherId, otherRatings] : users)
+      {
+        if (otherId == userId)
+          continue;
+        int shared = 0;
+        for (const auto &[movieId, _] : otherRatings)
+          shared += movies.count(movieId);
+        if (shared > 0)
+          newRank += DAMPING * activity * (ranks[otherId] * shared / otherRatings.size());
+      }
+      newRanks[userId] = newRank;
+      totalDiff += fabs(newRank - ranks[userId]);
+    }
+
+    double sum = 0.0;
+    for (const auto &[_, rank] : newRanks)
+      sum += rank;
+    for (auto &[_, rank] : newRanks)
+      rank = max(0.0001, rank / sum);
+    ranks = move(newRanks);
+    if (totalDiff < 0.0001)
+      break;
+  }
+  return ranks;
+}
+
+bool test_PageRank_BitsetKernelMatchesReference()
+{
+  bool matches = true;
+  // 200 items fit in four words per user; 700 take the multi-word path
+  for (int movies : {200, 700})
+  {
+    BipartiteGraph bg;
+    mt19937 rng(45 + movies);
+    for (int i = 1; i <= movies; i++)
+    {
+      bg.addItem(i, {"Drama"}, 100, 7.0, 2020);
+    }
+    for (int u = 1; u <= 150; u++)
+    {
+      bg.addUser(u, generateRandomRatings(movies, 5 + u % 40, rng));
+    }
+
+    PageRank pageRank(bg);
+    unordered_map<int, double> expected;
+    double bitsetMs = measureExecutionTime([&]()
+                                           { pageRank.calculatePageRanks(); });
+    double referenceMs = measureExecutionTime([&]()
+                                              { expected = referencePageRanks(bg); });
+    cout << "PageRank (" << movies << " items): bitset " << bitsetMs
+         << "ms, hash set " << referenceMs << "ms" << endl;
+
+    for (const auto &[userId, rank] : expected)
+    {
+      matches &= fabs(pageRank.getPageRank(userId) - rank) < 1e-12;
+    }
+  }
+  return matches;
+}
+
+bool test_GraphOrdering_ImprovesLocalityKeepsResults()
+{
+  // Clustered ratings under shuffled ids, so input order has no locality
+  BipartiteGraph bg;
+  mt19937 rng(46);
+  const int CLUSTERS = 6, USERS_PER_CLUSTER = 30, POOL = 20, MOVIES = CLUSTERS * POOL;
+  vector<int> movieIds(MOVIES), userIds(CLUSTERS * USERS_PER_CLUSTER);
+  iota(movieIds.begin(), movieIds.end(), 1);
+  iota(userIds.begin(), userIds.end(), 1);
+  shuffle(movieIds.begin(), movieIds.end(), rng);
+  shuffle(userIds.begin(), userIds.end(), rng);
+  for (int i = 1; i <= MOVIES; i++)
+  {
+    bg.addItem(i, {i % 3 ? "Drama" : "Comedy"}, 100, 7.0, 2020);
+  }
+  for (size_t u = 0; u < userIds.size(); u++)
+  {
+    int cluster = static_cast<int>(u) / USERS_PER_CLUSTER;
+    vector<pair<int, float>> ratings;
+    for (const auto &[movie, rating] : generateRandomRatings(POOL, 8, rng))
+    {
+      ratings.push_back({movieIds[cluster * POOL + movie - 1], rating});
+    }
+    bg.addUser(userIds[u], ratings);
+  }
+
+  vector<int> byId(userIds);
+  sort(byId.begin(), byId.end());
+  double idGap = GraphOrdering::averageRaterGap(bg, byId);
+  double degreeGap = GraphOrdering::averageRaterGap(bg, GraphOrdering::compute(bg, GraphOrdering::DEGREE).users);
+  double bfsGap = GraphOrdering::averageRaterGap(bg, GraphOrdering::compute(bg, GraphOrdering::BFS).users);
+  double rcmGap = GraphOrdering::averageRaterGap(bg, GraphOrdering::compute(bg, GraphOrdering::RCM).users);
+  cout << "Average rater gap: by id " << idGap << ", degree " << degreeGap
+       << ", BFS " << bfsGap << ", RCM " << rcmGap << endl;
+  bool localityImproves = bfsGap < idGap / 3 && rcmGap < idGap / 3;
+
+  // Same answers through the external-id API after reordering
+  BipartiteGraph reordered(bg);
+  bool applied = GraphOrdering::reorder(reordered, GraphOrdering::RCM) &&
+                 reordered.getUserOrder().size() == userIds.size();
+
+  PageRank pageRank(bg), reorderedRank(reordered);
+  Collaborative collab(bg, pageRank), reorderedCollab(reordered, reorderedRank);
+  collab.preComputeSimilarities(2);
+  reorderedCollab.preComputeSimilarities(2);
+  bool sameResults = true;
+  for (int userId : userIds)
+  {
+    sameResults &= fabs(pageRank.getPageRank(userId) - reorderedRank.getPageRank(userId)) < 1e-9;
+    auto before = collab.getNeighbors(userId);
+    auto after = reorderedCollab.getNeighbors(userId);
+    sameResults &= before.size() == after.size();
+    for (size_t i = 0; sameResults && i < before.size(); i++)
+    {
+      sameResults &= fabs(before[i].second - after[i].second) < 1e-5f;
+    }
+    for (const auto &[movieId, _] : reordered.getUserItems().at(userId))
+    {
+      sameResults &= reordered.getWatchedItems(userId).test(reordered.getItemIndex(movieId));
+    }
+  }
+  auto comedies = [](const BipartiteGraph &graph)
+  {
+    vector<int> ids;
+    Bitset excluded = ItemFilter().genre("Comedy").excludedItems(graph, Bitset());
+    for (size_t i = 0; i < graph.getItemCount(); i++)
+    {
+      if (!excluded.test(i))
+        ids.push_back(graph.getItemId(i));
+    }
+    sort(ids.begin(), ids.end());
+    return ids;
+  };
+  sameResults &= comedies(bg) == comedies(reordered);
+
+  // Orderings must be permutations; later users are appended
+  bool validated = !reordered.applyOrdering({1, 2}, GraphOrdering::compute(reordered, GraphOrdering::BFS).items);
+  reordered.addUser(10000, {{1, 4.0f}});
+  validated &= reordered.getUserOrder().back() == 10000;
+
+  return localityImproves && applied && sameResults && validated;
+}
+
+bool test_GraphOrdering_NewRatersAfterReorderAreOrdered()
+{
+  BipartiteGraph bg;
+  mt19937 rng(46);
+  addTwoGenreCatalog(bg, 60);
+  addRandomUsers(bg, 80, 60, 10, rng);
+
+  // A user who first appears through addRating, as RatingBatcher adds
+  // them, after the graph was reordered
+  BipartiteGraph reordered(bg);
+  bool applied = GraphOrdering::reorder(reordered, GraphOrdering::BFS);
+  for (int movieId = 1; movieId <= 8; movieId++)
+  {
+    bg.addRating(999, movieId, 4.0f);
+    reordered.addRating(999, movieId, 4.0f);
+  }
+  bool ordered = applied && reordered.getUserOrder().back() == 999 &&
+                 reordered.getUserOrder().size() == reordered.getUserItems().size();
+
+  PageRank pageRank(bg), reorderedRank(reordered);
+  Collaborative collab(bg, pageRank), reorderedCollab(reordered, reorderedRank);
+  collab.preComputeSimilarities(2);
+  reorderedCollab.preComputeSimilarities(2);
+  auto expected = collab.getNeighbors(999);
+  auto actual = reorderedCollab.getNeighbors(999);
+  bool sameResults = !expected.empty() && expected.size() == actual.size() &&
+                     fabs(pageRank.getPageRank(999) - reorderedRank.getPageRank(999)) < 1e-9;
+  for (size_t i = 0; sameResults && i < expected.size(); i++)
+  {
+    sameResults &= fabs(expected[i].second - actual[i].second) < 1e-5f;
+  }
+
+  return ordered && sameResults;
+}
+
+bool test_Collaborative_ExternalPrecomputeMatchesInMemory()
+{
+  BipartiteGraph bg;
+  mt19937 rng(47);
+  for (int i = 1; i <= 80; i++)
+  {
+    bg.addItem(i, {"Drama"}, 100, 7.0, 2020);
+  }
+  for (int u = 1; u <= 300; u++)
+  {
+    bg.addUser(u, generateRandomRatings(80, 4 + u % 12, rng));
+  }
+
+  PageRank pageRank(bg);
+  Collaborative inMemory(bg, pageRank), external(bg, pageRank);
+  inMemory.setSimilarityKernel(Collaborative::SPARSE);
+  inMemory.preComputeSimilarities(2);
+
+  // A budget of a few hundred entries forces many runs and a real merge
+  string spillDir = testDataPath("neighbor_spill");
+  filesystem::remove_all(spillDir);
+  filesystem::create_directories(spillDir);
+  Collaborative::ExternalOptions options;
+  options.spillDirectory = spillDir;
+  options.memoryBudget = 300 * sizeof(NeighborSpill::Entry);
+  options.tileUsers = 64;
+  uint64_t runsBefore = Metrics::snapshot().counter(Metrics::SIMILARITY_SPILL_RUNS);
+  bool computed = external.preComputeSimilaritiesExternal(options, 2);
+  uint64_t runs = Metrics::snapshot().counter(Metrics::SIMILARITY_SPILL_RUNS) - runsBefore;
+  bool cleanedUp = filesystem::is_empty(spillDir);
+  filesystem::remove_all(spillDir);
+
+  bool matches = true;
+  size_t finalEntries = 0;
+  for (int u = 1; u <= 300; u++)
+  {
+    auto expected = inMemory.getNeighbors(u);
+    auto actual = external.getNeighbors(u);
+    finalEntries += actual.size();
+    matches &= expected.size() == actual.size();
+    for (size_t i = 0; matches && i < expected.size(); i++)
+    {
+      matches &= fabs(expected[i].second - actual[i].second) < 1e-5f;
+    }
+  }
+
+  // Partial lists for one user spread over several runs merge into one
+  NeighborSpill spill(testDataPath(""), 2 * sizeof(NeighborSpill::Entry));
+  spill.add(7, {{1, 0.2f}, {2, 0.9f}});
+  spill.add(7, {{3, 0.5f}, {2, 0.4f}});
+  spill.add(3, {{9, 0.1f}});
+  vector<pair<int, vector<pair<int, float>>>> merged;
+  bool mergedOk = spill.merge(2, [&](int userId, vector<pair<int, float>> &list)
+                              { merged.push_back({userId, list}); });
+  mergedOk &= spill.runCount() == 3 && merged.size() == 2 &&
+              merged[0].first == 3 && merged[1].first == 7 &&
+              merged[1].second == vector<pair<int, float>>{{2, 0.9f}, {3, 0.5f}};
+
+  // Rows are scored against five candidate tiles and each partial top K is
+  // spilled, so the runs hold several times the final lists
+  bool spilledPartials = runs > 2 * finalEntries / 300;
+
+  cout << "External precompute: " << runs << " runs" << endl;
+  return computed && runs > 1 && spilledPartials && cleanedUp && matches && mergedOk;
+}
+
+bool test_ShardedPrecompute_MatchesSingleProcess()
+{
+  BipartiteGraph bg;
+  mt19937 rng(48);
+  for (int i = 1; i <= 80; i++)
+  {
+    bg.addItem(i, {"Drama"}, 100, 7.0, 2020);
+  }
+  for (int u = 1; u <= 250; u++)
+  {
+    bg.addUser(u * 3, generateRandomRatings(80, 4 + u % 15, rng));
+  }
+
+  PageRank pageRank(bg);
+  Collaborative single(bg, pageRank), sharded(bg, pageRank), failed(bg, pageRank);
+  single.setSimilarityKernel(Collaborative::SPARSE);
+  single.preComputeSimilarities(2);
+
+  string workDir = testDataPath("sharded_precompute");
+  filesystem::remove_all(workDir);
+  filesystem::create_directories(workDir);
+  ShardedPrecompute::Options options;
+  options.workDirectory = workDir;
+  options.processes = 3;
+  bool computed = sharded.preComputeSimilaritiesSharded(options);
+  bool cleanedUp = filesystem::is_empty(workDir);
+  filesystem::remove_all(workDir);
+
+  bool matches = true;
+  for (int u = 1; u <= 250; u++)
+  {
+    auto expected = single.getNeighbors(u * 3);
+    auto actual = sharded.getNeighbors(u * 3);
+    matches &= expected.size() == actual.size();
+    for (size_t i = 0; matches && i < expected.size(); i++)
+    {
+      matches &= fabs(expected[i].second - actual[i].second) < 1e-5f;
+    }
+  }
+
+  // Workers that cannot write their shard fail the run without touching
+  // the model
+  options.workDirectory = testDataPath("missing_dir/nested");
+  bool failedCleanly = !failed.preComputeSimilaritiesSharded(options) &&
+                       failed.getNeighbors(3).empty();
+
+  return computed && cleanedUp && matches && failedCleanly;
+}
+
+bool test_ShardedPrecompute_RunsFromCompressedRatingsFile()
+{
+  // Ratings to one decimal place survive the one-byte quantization exactly
+  BipartiteGraph bg;
+  mt19937 rng(30);
+  uniform_int_distribution<int> tenths(5, 50);
+  for (int i = 1; i <= 60; i++)
+  {
+    bg.addItem(i, {"Drama"}, 100, 7.0, 2020);
+  }
+  string ratingsPath = testDataPath("compressed_ratings.csv");
+  {
+    ofstream csv(ratingsPath);
+    csv << "userId,movieId,rating,timestamp\n";
+    for (int u = 1; u <= 150; u++)
+    {
+      vector<pair<int, float>> ratings;
+      for (int movieId = 1 + u % 7; movieId <= 60; movieId += 1 + u % 5)
+      {
+        ratings.push_back({movieId, tenths(rng) / 10.0f});
+        csv << u * 2 << "," << movieId << "," << ratings.back().second << ",0\n";
+      }
+      bg.addUser(u * 2, ratings);
+    }
+    // A repeated edge keeps its last rating, as addRating would
+    csv << "2,60,1.5,0\n";
+    csv << "not,a,rating\n";
+    bg.addRating(2, 60, 1.5f);
+  }
+
+  auto adjacency = CompressedAdjacency::loadRatings(ratingsPath);
+  filesystem::remove(ratingsPath);
+
+  bool rowsMatch = adjacency.getUserIds().size() == 150 && adjacency.getUserIds().front() == 2 &&
+                   adjacency.getUserIds().back() == 300;
+  for (const auto &[userId, expected] : bg.getUserItems())
+  {
+    map<int, float> sorted(expected.begin(), expected.end());
+    auto cursor = adjacency.userItems(userId);
+    int id;
+    float rating;
+    size_t seen = 0;
+    while (cursor.next(id, rating))
+    {
+      rowsMatch &= sorted.count(id) && fabs(sorted[id] - rating) < 1e-4f;
+      seen++;
+    }
+    rowsMatch &= seen == sorted.size();
+  }
+
+  string workDir = testDataPath("sharded_compressed");
+  filesystem::remove_all(workDir);
+  filesystem::create_directories(workDir);
+  ShardedPrecompute::Options options;
+  options.workDirectory = workDir;
+  options.processes = 2;
+  map<int, vector<pair<int, float>>> fromGraph, fromCompressed;
+  bool computed =
+      ShardedPrecompute::run(bg, options, 5, [&](int userId, vector<pair<int, float>> &list)
+                             { fromGraph[userId] = list; }) &&
+      ShardedPrecompute::run(adjacency, options, 5, [&](int userId, vector<pair<int, float>> &list)
+                             { fromCompressed[userId] = list; });
+  filesystem::remove_all(workDir);
+
+  bool neighborsMatch = fromGraph.size() == 150 && fromCompressed.size() == fromGraph.size();
+  for (const auto &[userId, expected] : fromGraph)
+  {
+    const auto &actual = fromCompressed[userId];
+    neighborsMatch &= actual.size() == expected.size();
+    for (size_t i = 0; neighborsMatch && i < expected.size(); i++)
+    {
+      neighborsMatch &= fabs(expected[i].second - actual[i].second) < 1e-5f;
+    }
+  }
+
+  return rowsMatch && computed && neighborsMatch;
+}
+
+bool test_QuantizedNeighbors_RankingMatchesFloat()
+{
+  BipartiteGraph bg;
+  mt19937 rng(49);
+  for (int i = 1; i <= 120; i++)
+  {
+    bg.addItem(i, {"Drama"}, 100, 5.0 + (i % 40) / 10.0, 2020);
+  }
+  for (int u = 1; u <= 300; u++)
+  {
+    bg.addUser(u, generateRandomRatings(120, 5 + u % 20, rng));
+  }
+
+  PageRank pageRank(bg);
+  Collaborative exact(bg, pageRank), wide(bg, pageRank), narrow(bg, pageRank);
+  exact.preComputeSimilarities(2);
+  wide.preComputeSimilarities(2);
+  narrow.preComputeSimilarities(2);
+  wide.setNeighborPrecision(Collaborative::INT16);
+  narrow.setNeighborPrecision(Collaborative::INT8);
+
+  // Quantization error stays within half a step of each list's best value
+  bool withinStep = true;
+  for (int u = 1; u <= 300; u++)
+  {
+    auto expected = exact.getNeighbors(u);
+    auto actual = narrow.getNeighbors(u);
+    withinStep &= expected.size() == actual.size();
+    for (size_t i = 0; withinStep && i < expected.size(); i++)
+    {
+      withinStep &= actual[i].first == expected[i].first &&
+                    fabs(actual[i].second - expected[i].second) <= expected[0].second / 510.0f + 1e-6f;
+    }
+  }
+
+  // Top-10 overlap with the float model
+  auto overlap = [&](const Collaborative &model)
+  {
+    double total = 0.0;
+    for (int u = 1; u <= 300; u++)
+    {
+      auto expected = exact.getRecommendations(u, 10);
+      auto actual = model.getRecommendations(u, 10);
+      unordered_set<int> ids;
+      for (const auto &[movieId, _] : expected)
+        ids.insert(movieId);
+      size_t shared = 0;
+      for (const auto &[movieId, _] : actual)
+        shared += ids.count(movieId);
+      total += expected.empty() ? 1.0 : static_cast<double>(shared) / expected.size();
+    }
+    return total / 300;
+  };
+  double wideOverlap = overlap(wide);
+  double narrowOverlap = overlap(narrow);
+
+  QuantizedNeighbors::Lists lists = exact.getNeighborLists();
+  size_t entries = 0;
+  for (const auto &[_, list] : lists)
+    entries += list.size();
+  size_t packed8 = QuantizedNeighbors::build(lists, QuantizedNeighbors::INT8).bytes();
+  size_t packed16 = QuantizedNeighbors::build(lists, QuantizedNeighbors::INT16).bytes();
+  cout << "Quantized neighbors: top-10 overlap int16 " << wideOverlap << ", int8 " << narrowOverlap
+       << "; float lists " << entries * sizeof(pair<int, float>) + lists.size() * sizeof(vector<pair<int, float>>)
+       << " bytes before hash nodes, packed int16/int8 "
+       << packed16 << " / " << packed8 << endl;
+
+  // Incremental updates still apply to packed lists. The changed user's
+  // list is held in float until it is folded in, and lists the update did
+  // not touch keep their packed values
+  auto packedBefore = narrow.getNeighborLists();
+  bg.addRating(1, 7, 5.0f);
+  exact.onRatingAdded(1, 7, 5.0f);
+  narrow.onRatingAdded(1, 7, 5.0f);
+  bool updated = exact.getNeighbors(1) == narrow.getNeighbors(1);
+  size_t changedLists = 0;
+  for (int u = 1; u <= 300; u++)
+  {
+    changedLists += narrow.getNeighbors(u) != packedBefore[u];
+  }
+  updated &= changedLists < 30;
+
+  // Enough batches to fold the changed lists back into the packed ones
+  for (int batch = 0; batch < 8; batch++)
+  {
+    vector<pair<int, int>> changes;
+    for (int u = 2 + batch * 10; u < 12 + batch * 10; u++)
+    {
+      bg.addRating(u, 1 + (u * 7) % 120, 4.5f);
+      changes.push_back({u, 1 + (u * 7) % 120});
+    }
+    exact.onRatingsChanged(changes);
+    narrow.onRatingsChanged(changes);
+  }
+  // Same neighbors, each within a step of the float value; entries that
+  // share a code may trade places
+  for (int u = 1; updated && u <= 300; u++)
+  {
+    auto expected = exact.getNeighbors(u);
+    auto actual = narrow.getNeighbors(u);
+    updated &= expected.size() == actual.size();
+    for (size_t i = 0; updated && i < expected.size(); i++)
+    {
+      updated &= fabs(actual[i].second - expected[i].second) <= expected[0].second / 255.0f &&
+                 any_of(actual.begin(), actual.end(), [&](const auto &entry)
+                        { return entry.first == expected[i].first; });
+    }
+  }
+
+  return withinStep && wideOverlap >= 0.99 && narrowOverlap >= 0.9 && updated;
+}
+
+bool test_MemoryAccounting_ReportsAndEnforcesBudgets()
+{
+  BipartiteGraph bg;
+  mt19937 rng(50);
+  for (int i = 1; i <= 150; i++)
+  {
+    bg.addItem(i, generateRandomGenres(2, rng), 90 + i % 60, 5.0 + (i % 40) / 10.0, i % 4);
+  }
+  for (int u = 1; u <= 400; u++)
+  {
+    bg.addUser(u, generateRandomRatings(150, 5 + u % 25, rng));
+  }
+
+  // Budgets are process-wide; restore them for the tests that follow
+  size_t collabBudget = MemoryAccounting::getBudget(MemoryAccounting::COLLAB_SIMILARITY_CACHE);
+  size_t resultBudget = MemoryAccounting::getBudget(MemoryAccounting::RESULT_CACHE);
+  MemoryAccounting::setBudget(MemoryAccounting::COLLAB_SIMILARITY_CACHE, 128 << 10);
+  MemoryAccounting::setBudget(MemoryAccounting::RESULT_CACHE, 64 << 10);
+
+  uint64_t evictionsBefore = Metrics::snapshot().counter(Metrics::COLLAB_CACHE_EVICTIONS);
+  bool withinBudget = true;
+  size_t total = 0;
+  {
+    ModelVersion version(bg, 2);
+    for (int u = 1; u <= 400; u++)
+    {
+      version.hybrid.getRecommendations(u, 5 + u % 7);
+    }
+
+    MemoryAccounting::Report report;
+    version.reportMemory(report);
+    cout << report.toText();
+    total = report.total();
+    for (const auto &[name, bytes] : report.entries)
+    {
+      if (name == "collaborative.similarity_cache")
+        withinBudget &= bytes <= (128u << 10);
+      if (name == "hybrid.result_cache")
+        withinBudget &= bytes <= (64u << 10) + ResultCache::SHARD_COUNT * 4096;
+      if (name == "graph.user_items" || name == "pagerank.ranks" || name == "hybrid.score_cache")
+        withinBudget &= bytes > 0;
+    }
+    withinBudget &= version.hybrid.getResultCache().size() < 400;
+  }
+  bool evicted = Metrics::snapshot().counter(Metrics::COLLAB_CACHE_EVICTIONS) > evictionsBefore;
+
+  MemoryAccounting::setBudget(MemoryAccounting::COLLAB_SIMILARITY_CACHE, collabBudget);
+  MemoryAccounting::setBudget(MemoryAccounting::RESULT_CACHE, resultBudget);
+
+  // Estimates follow the allocator's rounding
+  bool estimates = MemoryAccounting::allocationBytes(1) == 32 &&
+                   MemoryAccounting::allocationBytes(24) == 32 &&
+                   MemoryAccounting::allocationBytes(40) == 48 &&
+                   MemoryAccounting::heapBytes(vector<int>()) == 0;
+
+  // Cached lists are charged for the heap of their filter's genre names
+  ResultCache plain(1 << 20), filtered(1 << 20);
+  ResultCache::Version v{1, 1};
+  plain.insert({1, 10, ItemFilter()}, v, {{1, 1.0}});
+  filtered.insert({1, 10, ItemFilter().genre("Documentary-Science-Fiction")}, v, {{1, 1.0}});
+  estimates &= filtered.bytes() > plain.bytes();
+
+  return withinBudget && evicted && total > 0 && estimates;
+}
+
+bool test_MemoryAccounting_BudgetsAreSharedAcrossEngines()
+{
+  BipartiteGraph bg;
+  mt19937 rng(51);
+  for (int i = 1; i <= 150; i++)
+  {
+    bg.addItem(i, generateRandomGenres(2, rng), 90 + i % 60, 5.0 + (i % 40) / 10.0, i % 4);
+  }
+  for (int u = 1; u <= 400; u++)
+  {
+    bg.addUser(u, generateRandomRatings(150, 5 + u % 25, rng));
+  }
+
+  size_t collabBudget = MemoryAccounting::getBudget(MemoryAccounting::COLLAB_SIMILARITY_CACHE);
+  MemoryAccounting::setBudget(MemoryAccounting::COLLAB_SIMILARITY_CACHE, 128 << 10);
+  size_t usageBefore = MemoryAccounting::getUsage(MemoryAccounting::COLLAB_SIMILARITY_CACHE);
+
+  // Two engines together stay within one budget, not one each
+  bool shared = true;
+  {
+    PageRank pageRank(bg);
+    Collaborative first(bg, pageRank), second(bg, pageRank);
+    first.preComputeSimilarities(2);
+    second.preComputeSimilarities(2);
+    size_t usage = MemoryAccounting::getUsage(MemoryAccounting::COLLAB_SIMILARITY_CACHE) - usageBefore;
+    MemoryAccounting::Report firstReport, secondReport;
+    first.reportMemory(firstReport);
+    second.reportMemory(secondReport);
+    size_t reported = 0;
+    for (const auto &report : {firstReport, secondReport})
+    {
+      for (const auto &[name, bytes] : report.entries)
+      {
+        if (name == "collaborative.similarity_cache")
+          reported += bytes;
+      }
+    }
+    shared &= usage > 0 && usage <= (128u << 10) && reported <= (128u << 10);
+  }
+  bool released = MemoryAccounting::getUsage(MemoryAccounting::COLLAB_SIMILARITY_CACHE) == usageBefore;
+
+  // A version built from the previous one takes over its charge instead of
+  // adding a second one for the storage they share
+  bool handedOver = true;
+  {
+    auto previous = std::make_unique<ModelVersion>(bg, 2);
+    size_t usage = MemoryAccounting::getUsage(MemoryAccounting::COLLAB_SIMILARITY_CACHE);
+    ModelVersion next(previous->graph, *previous, {});
+    handedOver &= MemoryAccounting::getUsage(MemoryAccounting::COLLAB_SIMILARITY_CACHE) == usage;
+    previous.reset();
+    handedOver &= MemoryAccounting::getUsage(MemoryAccounting::COLLAB_SIMILARITY_CACHE) == usage;
+  }
+  released &= MemoryAccounting::getUsage(MemoryAccounting::COLLAB_SIMILARITY_CACHE) == usageBefore;
+
+  MemoryAccounting::setBudget(MemoryAccounting::COLLAB_SIMILARITY_CACHE, collabBudget);
+  return shared && released && handedOver;
+}
+
+// Test Suite 5: Instrumentation
+bool test_Metrics_RecordsCacheAndStageActivity()
+{
+  BipartiteGraph bg;
+
+  bg.addItem(1, {"Action"}, 120, 8.0, 2020);
+  bg.addItem(2, {"Action"}, 115, 7.5, 2020);
+  bg.addItem(3, {"Drama"}, 110, 7.0, 2020);
+
+  bg.addUser(1, {{1, 5.0}, {2, 4.8}});
+  bg.addUser(2, {{1, 4.9}, {3, 3.0}});
+
+  auto before = Metrics::snapshot();
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities();
+  content.preComputeSimilarities();
+
+  Hybrid hybrid(bg, collab, content);
+  hybrid.getRecommendations(1);
+  collab.getCachedSimilarity(1, 2);
+
+  auto after = Metrics::snapshot();
+
+  bool countersMoved =
+      after.counter(Metrics::HYBRID_REQUESTS) == before.counter(Metrics::HYBRID_REQUESTS) + 1 &&
+      after.counter(Metrics::COLLAB_SIMILARITY_HIT) > before.counter(Metrics::COLLAB_SIMILARITY_HIT) &&
+      after.counter(Metrics::PAGERANK_RUNS) > before.counter(Metrics::PAGERANK_RUNS);
+  bool stagesTimed =
+      after.histogram(Metrics::HYBRID_REQUEST_NS).count > before.histogram(Metrics::HYBRID_REQUEST_NS).count &&
+      after.histogram(Metrics::HYBRID_COLLAB_STAGE_NS).count > before.histogram(Metrics::HYBRID_COLLAB_STAGE_NS).count &&
+      after.histogram(Metrics::HYBRID_CANDIDATES).max >= 1;
+  bool pageRankReported = after.gauge(Metrics::PAGERANK_ITERATIONS) >= 1;
+
+  std::string json = after.toJson();
+  bool exported = json.find("\"collab_similarity_hit\"") != std::string::npos &&
+                  after.toText().find("hybrid_request_ns") != std::string::npos;
+
+  // Bucketing should round-trip within the bucket bounds
+  bool bucketsConsistent = true;
+  for (uint64_t v : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull})
+  {
+    int b = Metrics::bucketIndex(v);
+    bucketsConsistent &= Metrics::bucketLowerBound(b) <= v && v <= Metrics::bucketUpperBound(b);
+  }
+
+  return countersMoved && stagesTimed && pageRankReported && exported && bucketsConsistent;
+}
+
+bool test_Trace_EmitsChromeTraceEvents()
+{
+  Trace::clear();
+
+  std::thread worker([]()
+                     {
+    Trace::setThreadName("trace test worker");
+    Trace::Span span("test worker span"); });
+  worker.join();
+  {
+    Trace::Span span("test main span");
+  }
+
+  std::string json = Trace::toChromeJson();
+  bool hasSpans = json.find("\"test worker span\"") != std::string::npos &&
+                  json.find("\"test main span\"") != std::string::npos &&
+                  json.find("\"ph\":\"X\"") != std::string::npos;
+  bool hasThreadName = json.find("\"trace test worker\"") != std::string::npos;
+
+  // Cleared spans must not reappear in the next flush
+  Trace::clear();
+  bool cleared = Trace::toChromeJson().find("test main span") == std::string::npos;
+
+  return hasSpans && hasThreadName && cleared;
+}
+
+bool test_Arena_ScopesRewindAndReuseBlocks()
+{
+  Arena &arena = Arena::local();
+  bool nestedRewinds = true;
+  {
+    Arena::Scope outer;
+    std::pmr::vector<int> outerScratch(outer.resource());
+    outerScratch.assign(1000, 7);
+    auto afterOuter = arena.mark();
+    {
+      Arena::Scope inner;
+      std::pmr::unordered_map<int, float> innerScratch(inner.resource());
+      for (int i = 0; i < 5000; i++)
+        innerScratch[i] = i * 0.5f;
+    }
+    auto afterInner = arena.mark();
+    nestedRewinds = afterInner.block == afterOuter.block && afterInner.offset == afterOuter.offset &&
+                    outerScratch[999] == 7;
+  }
+
+  // Repeated requests should run out of retained blocks, not new ones
+  BipartiteGraph bg;
+  for (int i = 1; i <= 20; i++)
+  {
+    bg.addItem(i, {i % 2 ? "Action" : "Drama"}, 100 + i, 5.0 + i % 5, i % 4);
+  }
+  for (int u = 1; u <= 30; u++)
+  {
+    bg.addUser(u, {{u % 20 + 1, 4.0f}, {(u * 7) % 20 + 1, 3.0f}, {(u * 3) % 20 + 1, 5.0f}});
+  }
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+  Hybrid hybrid(bg, collab, content);
+
+  auto first = hybrid.getRecommendations(1);
+  size_t warmCapacity = arena.capacity();
+  bool stable = true;
+  for (int round = 0; round < 3; round++)
+  {
+    for (int u = 1; u <= 30; u++)
+    {
+      stable &= hybrid.getRecommendations(u).size() == 10;
+      stable &= !content.getRecommendations(u).empty();
+    }
+  }
+  bool sameResult = hybrid.getRecommendations(1) == first;
+
+  return nestedRewinds && stable && sameResult && arena.capacity() <= 2 * warmCapacity;
+}
+
+bool test_BipartiteGraph_WatchedBitsetMatchesRatings()
+{
+  BipartiteGraph bg;
+  for (int i = 1; i <= 130; i++) // spans three 64-bit words
+  {
+    bg.addItem(i * 10, {"Drama"}, 100, 7.0, 1);
+  }
+  bg.addUser(1, {{10, 4.0}, {650, 3.0}, {1300, 5.0}, {9999, 5.0}}); // 9999 does not exist
+
+  const Bitset &watched = bg.getWatchedItems(1);
+  bool bitsMatch = watched.count() == 3 &&
+                   watched.test(bg.getItemIndex(10)) &&
+                   watched.test(bg.getItemIndex(650)) &&
+                   watched.test(bg.getItemIndex(1300)) &&
+                   !watched.test(bg.getItemIndex(20));
+
+  size_t unwatched = 0;
+  bool skipsWatched = true;
+  watched.forEachClear(bg.getItemCount(), [&](size_t index)
+                       {
+    unwatched++;
+    int id = bg.getItemId(index);
+    skipsWatched &= id != 10 && id != 650 && id != 1300; });
+
+  // Items added after the user are unwatched. Copies share the item table
+  // until one of them changes it, then keep their own dense table
+  bg.addItem(5000, {"Comedy"}, 90, 6.0, 0);
+  BipartiteGraph copy = bg;
+  bool sharedUntilWritten = &copy.getItemAt(0) == &bg.getItemAt(0);
+  copy.addItem(6000, {"Drama"}, 90, 6.0, 0);
+  bool copyConsistent = sharedUntilWritten &&
+                        copy.getItemAt(copy.getItemIndex(5000)).id == 5000 &&
+                        &copy.getItemAt(0) != &bg.getItemAt(0) &&
+                        copy.getItemAt(0).id == bg.getItemAt(0).id &&
+                        bg.getItemIndex(6000) < 0 &&
+                        !copy.getWatchedItems(1).test(copy.getItemIndex(5000));
+
+  return bitsMatch && unwatched == 127 && skipsWatched && copyConsistent &&
+         bg.getWatchedItems(42).count() == 0;
+}
+
+bool test_CompressedAdjacency_RoundTripsRatingLists()
+{
+  BipartiteGraph bg;
+  mt19937 rng(7);
+  const int NUM_MOVIES = 300;
+  for (int i = 1; i <= NUM_MOVIES; i++)
+  {
+    bg.addItem(i * 37, {"Drama"}, 100, 7.0, 1); // sparse ids exercise multi-byte deltas
+  }
+  for (int u = 1; u <= 200; u++)
+  {
+    auto ratings = generateRandomRatings(NUM_MOVIES, 1 + u % 40, rng);
+    for (auto &[movieId, rating] : ratings)
+      movieId *= 37;
+    bg.addUser(u * 1000, ratings);
+  }
+
+  auto adjacency = CompressedAdjacency::fromGraph(bg);
+
+  auto matches = [](CompressedAdjacency::Cursor cursor, std::vector<std::pair<int, float>> expected)
+  {
+    sort(expected.begin(), expected.end());
+    int id;
+    float rating;
+    size_t i = 0;
+    while (cursor.next(id, rating))
+    {
+      if (i >= expected.size() || id != expected[i].first ||
+          std::abs(rating - expected[i].second) > CompressedAdjacency::RATING_STEP / 2 + 1e-4f)
+        return false;
+      i++;
+    }
+    return i == expected.size();
+  };
+
+  bool allMatch = true;
+  size_t edges = 0;
+  for (const auto &[userId, ratings] : bg.getUserItems())
+  {
+    allMatch &= matches(adjacency.userItems(userId), ratings);
+    allMatch &= adjacency.userDegree(userId) == ratings.size();
+    edges += ratings.size();
+  }
+  for (const auto &[itemId, ratings] : bg.getItemUsers())
+  {
+    allMatch &= matches(adjacency.itemUsers(itemId), ratings);
+  }
+
+  int id;
+  float rating;
+  bool missingRowEmpty = !adjacency.userItems(-5).next(id, rating);
+
+  // Uncompressed pairs alone cost 16 bytes per edge across both directions,
+  // before any vector or hash-node overhead
+  size_t rawBytes = edges * 2 * sizeof(std::pair<int, float>);
+  cout << "Compressed adjacency: " << adjacency.bytes() << " bytes vs " << rawBytes
+       << " bytes of raw pairs for " << edges << " edges" << endl;
+
+  return allMatch && missingRowEmpty && adjacency.edgeCount() == edges &&
+         adjacency.bytes() < rawBytes;
+}
+
+bool test_ModelSnapshot_WarmRestartSkipsRecompute()
+{
+  BipartiteGraph bg;
+  mt19937 rng(11);
+  for (int i = 1; i <= 30; i++)
+  {
+    bg.addItem(i, generateRandomGenres(2, rng), 90 + i, 5.0 + (i % 40) / 10.0, i % 4);
+  }
+  for (int u = 1; u <= 40; u++)
+  {
+    bg.addUser(u, generateRandomRatings(30, 3 + u % 6, rng));
+  }
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+
+  string path = testDataPath("model_snapshot_test.bin");
+  if (!ModelSnapshot::save(path, bg, pageRank, collab, content))
+    return false;
+
+  ModelSnapshot snapshot;
+  if (!snapshot.open(path) || !snapshot.matches(bg))
+    return false;
+
+  // Warm start: nothing is recomputed, and the engines answer identically
+  auto runsBefore = Metrics::snapshot().counter(Metrics::PAGERANK_RUNS);
+  PageRank warmRank(bg, snapshot);
+  Collaborative warmCollab(bg, warmRank);
+  Content warmContent(bg);
+  bool loaded = warmCollab.loadSimilarities(snapshot) && warmContent.loadSimilarities(snapshot);
+  bool skippedPageRank = Metrics::snapshot().counter(Metrics::PAGERANK_RUNS) == runsBefore;
+
+  bool sameModel = true;
+  for (int u = 1; u <= 40; u++)
+  {
+    sameModel &= warmRank.getPageRank(u) == pageRank.getPageRank(u);
+    sameModel &= warmCollab.getRecommendations(u) == collab.getRecommendations(u);
+  }
+  sameModel &= warmContent.getSimilarItems(1) == content.getSimilarItems(1);
+
+  // A snapshot of a different graph is rejected
+  BipartiteGraph other = bg;
+  other.addUser(41, {{1, 4.0}});
+  Collaborative otherCollab(other, pageRank);
+  bool rejectsOtherGraph = !snapshot.matches(other) && !otherCollab.loadSimilarities(snapshot);
+
+  // Truncated files never open
+  snapshot.close();
+  string truncatedPath = testDataPath("model_snapshot_truncated.bin");
+  {
+    ifstream in(path, ios::binary);
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    ofstream out(truncatedPath, ios::binary);
+    out.write(bytes.data(), bytes.size() / 2);
+  }
+  ModelSnapshot truncated;
+  bool rejectsTruncated = !truncated.open(truncatedPath);
+
+  // Counts chosen so the unchecked size arithmetic wraps back to the file
+  // size, or a list's end wraps back inside the entries, never open
+  auto rejectsCorrupted = [&](auto corrupt)
+  {
+    ifstream in(path, ios::binary);
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    corrupt(bytes);
+    ofstream(truncatedPath, ios::binary).write(bytes.data(), bytes.size());
+    ModelSnapshot corrupted;
+    return !corrupted.open(truncatedPath);
+  };
+  bool rejectsOverflow = rejectsCorrupted([](string &bytes)
+                                          {
+    auto *header = reinterpret_cast<ModelSnapshot::Header *>(&bytes[0]);
+    header->rankCount += (uint64_t(1) << 63) / sizeof(ModelSnapshot::RankEntry) * 2; });
+  rejectsOverflow &= rejectsCorrupted([](string &bytes)
+                                      {
+    auto *header = reinterpret_cast<ModelSnapshot::Header *>(&bytes[0]);
+    auto *list = reinterpret_cast<ModelSnapshot::ListIndex *>(
+        &bytes[sizeof(ModelSnapshot::Header) + header->rankCount * sizeof(ModelSnapshot::RankEntry)]);
+    list->count = 1;
+    list->offset = ~uint64_t(0); });
+
+  // The fingerprint is cached per graph version and follows mutations
+  uint64_t before = other.fingerprint();
+  other.addUser(42, {{2, 3.0}});
+  bool fingerprintFollows = other.fingerprint() != before && other.fingerprint() == other.fingerprint();
+
+  remove(path.c_str());
+  remove(truncatedPath.c_str());
+
+  return loaded && skippedPageRank && sameModel && rejectsOtherGraph && rejectsTruncated &&
+         rejectsOverflow && fingerprintFollows;
+}
+
+bool test_ModelSnapshot_WarmRestartKeepsItemNeighborsPastEviction()
+{
+  // 200 items give 19,900 content pairs, more than the default content
+  // budget, so the cold engine evicts half of them after precompute
+  BipartiteGraph bg;
+  mt19937 rng(31);
+  for (int i = 1; i <= 200; i++)
+  {
+    bg.addItem(i, generateRandomGenres(2, rng), 90 + i % 60, 5.0 + (i % 40) / 10.0, i % 4);
+  }
+  for (int u = 1; u <= 50; u++)
+  {
+    bg.addUser(u, generateRandomRatings(200, 5 + u % 15, rng));
+  }
+
+  PageRank pageRank(bg);
+  Collaborative collab(bg, pageRank);
+  Content content(bg);
+  collab.preComputeSimilarities(2);
+  content.preComputeSimilarities(2);
+  size_t cachedEntries = 0;
+  for (const auto &[_, list] : content.getNeighborLists())
+    cachedEntries += list.size();
+  bool evicted = cachedEntries / 2 < 200 * 199 / 2;
+
+  string path = testDataPath("model_snapshot_evicted.bin");
+  ModelSnapshot snapshot;
+  bool loaded = ModelSnapshot::save(path, bg, pageRank, collab, content) && snapshot.open(path);
+  PageRank warmRank(bg, snapshot);
+  Collaborative warmCollab(bg, warmRank);
+  Content warmContent(bg);
+  loaded &= warmCollab.loadSimilarities(snapshot) && warmContent.loadSimilarities(snapshot);
+  snapshot.close();
+  remove(path.c_str());
+
+  bool sameNeighbors = warmContent.getItemNeighbors() == content.getItemNeighbors();
+
+  Hybrid cold(bg, collab, content, pageRank), warm(bg, warmCollab, warmContent, warmRank);
+  bool sameRecommendations = true;
+  for (int u = 1; u <= 50; u++)
+  {
+    sameRecommendations &= warm.getRecommendations(u, 10) == cold.getRecommendations(u, 10);
+  }
+
+  return evicted && loaded && sameNeighbors && sameRecommendations;
+}
+
+bool test_Collaborative_IncrementalUpdatesMatchFullRecompute()
+{
+  BipartiteGraph bg;
+  mt19937 rng(5);
+  const int NUM_MOVIES = 40;
+  const int NUM_USERS = 60;
+  for (int i = 1; i <= NUM_MOVIES; i++)
+  {
+    bg.addItem(i, generateRandomGenres(2, rng), 90 + i, 6.0 + (i % 30) / 10.0, i % 4);
+  }
+  for (int u = 1; u <= NUM_USERS; u++)
+  {
+    bg.addUser(u, generateRandomRatings(NUM_MOVIES, 2 + u % 5, rng));
+  }
+
+  PageRank pageRank(bg);
+  Collaborative incremental(bg, pageRank);
+  incremental.preComputeSimilarities(2);
+
+  // Stream in new ratings and rating changes
+  uniform_int_distribution<int> userDist(1, NUM_USERS);
+  uniform_int_distribution<int> movieDist(1, NUM_MOVIES);
+  uniform_real_distribution<float> ratingDist(1.0f, 5.0f);
+  for (int i = 0; i < 200; i++)
+  {
+    int userId = userDist(rng);
+    int movieId = movieDist(rng);
+    float rating = ratingDist(rng);
+    bg.addRating(userId, movieId, rating);
+    incremental.onRatingAdded(userId, movieId, rating);
+  }
+
+  Collaborative full(bg, pageRank);
+  full.preComputeSimilarities(2);
+
+  bool listsMatch = true;
+  for (int u = 1; u <= NUM_USERS; u++)
+  {
+    auto a = incremental.getNeighbors(u);
+    auto b = full.getNeighbors(u);
+    listsMatch &= a.size() == b.size();
+    for (size_t i = 0; listsMatch && i < a.size(); i++)
+    {
+      listsMatch &= std::abs(a[i].second - b[i].second) < 1e-4f;
+      listsMatch &= std::abs(incremental.getCachedSimilarity(u, a[i].first) -
+                             full.calculateSimilarity(u, a[i].first)) < 1e-4f;
+    }
+  }
+
+  return listsMatch && !bg.addRating(1, 9999, 3.0f);
+}
+
+// Test that batched rating events reach the graph and survive a torn log tail
+bool test_RatingLog_ReplayAndMicroBatching()
+{
+  auto buildGraph = []()
+  {
+    BipartiteGraph bg;
+    for (int i = 1; i <= 20; i++)
+    {
+      bg.addItem(i, {"Drama"}, 100, 7.0, 2020);
+    }
+    for (int u = 1; u <= 10; u++)
+    {
+      bg.addUser(u, {{u, 4.0f}});
+    }
+    return bg;
+  };
+
+  string logPath = testDataPath("rating_events.log");
+  remove(logPath.c_str());
+
+  BipartiteGraph live = buildGraph();
+  PageRank pageRank(live);
+  Collaborative collab(live, pageRank);
+  collab.preComputeSimilarities(2);
+
+  mt19937 rng(11);
+  uniform_int_distribution<int> userDist(1, 10);
+  uniform_int_distribution<int> movieDist(1, 20);
+  size_t submitted = 0;
+  {
+    RatingLog::Writer writer(logPath);
+    RatingBatcher::Options options;
+    options.maxBatchSize = 16;
+    options.maxDelay = chrono::milliseconds(5);
+    RatingBatcher batcher(live, &collab, &writer, options);
+    batcher.start();
+    for (int i = 0; i < 120; i++)
+    {
+      RatingEvent event{RatingEvent::ADD, userDist(rng), movieDist(rng), 1.0f + (i % 5)};
+      if (i % 7 == 0)
+        event.type = RatingEvent::DELETE;
+      batcher.submit(event);
+      submitted++;
+    }
+    batcher.stop();
+    if (batcher.getAppliedEvents() != submitted || batcher.getAppliedBatches() >= submitted)
+      return false;
+  }
+
+  // Simulate a crash mid-append
+  {
+    ofstream torn(logPath, ios::binary | ios::app);
+    torn.write("partial", 7);
+  }
+
+  BipartiteGraph recovered = buildGraph();
+  RatingBatcher replayer(recovered, nullptr, nullptr);
+  bool replayedAll = replayer.replay(logPath) == submitted;
+  bool sameRatings = recovered.getUserItems() == live.getUserItems();
+
+  // Reopening truncates the torn tail and continues the sequence
+  uint64_t nextSequence;
+  {
+    RatingLog::Writer writer(logPath);
+    nextSequence = writer.append({RatingEvent::ADD, 1, 2, 3.0f});
+  }
+  bool continued = nextSequence == submitted + 1 &&
+                   RatingLog::replay(logPath, [](const RatingEvent &) {}) == submitted + 1;
+
+  // Collaborative saw every batch
+  Collaborative full(live, pageRank);
+  full.preComputeSimilarities(2);
+  bool modelsMatch = true;
+  for (int u = 1; u <= 10; u++)
+  {
+    auto a = collab.getNeighbors(u);
+    auto b = full.getNeighbors(u);
+    modelsMatch &= a.size() == b.size();
+    for (size_t i = 0; modelsMatch && i < a.size(); i++)
+    {
+      modelsMatch &= std::abs(a[i].second - b[i].second) < 1e-4f;
+    }
+  }
+
+  // A log that cannot be opened rejects the batch; nothing is applied
+  BipartiteGraph untouched = live;
+  RatingLog::Writer closedLog(testDataPath("missing-directory/rating_events.log"));
+  RatingBatcher rejecting(untouched, nullptr, &closedLog);
+  uint64_t failuresBefore = Metrics::snapshot().counter(Metrics::RATING_LOG_FAILURES);
+  rejecting.submit({RatingEvent::ADD, 1, 20, 5.0f});
+  bool rejected = !closedLog.isOpen() && !rejecting.flush() && rejecting.getRejectedEvents() == 1 &&
+                  rejecting.getAppliedEvents() == 0 && untouched.getUserItems() == live.getUserItems() &&
+                  Metrics::snapshot().counter(Metrics::RATING_LOG_FAILURES) == failuresBefore + 1;
+
+  // A write cut short (here by the file size limit) is truncated away and
+  // its sequence numbers are reused
+  bool truncatedBack;
+  {
+    RatingLog::Writer writer(logPath);
+    struct rlimit saved;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    auto oldHandler = signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit = saved;
+    limit.rlim_cur = 8 + (submitted + 1) * RatingLog::RECORD_SIZE + 40;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    writer.append({RatingEvent::ADD, 1, 3, 3.0f});
+    writer.append({RatingEvent::ADD, 1, 4, 3.0f});
+    bool failed = !writer.flush();
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, oldHandler);
+    uint64_t sequence = writer.append({RatingEvent::ADD, 1, 5, 3.0f});
+    truncatedBack = failed && writer.flush() && sequence == submitted + 2 &&
+                    RatingLog::replay(logPath, [](const RatingEvent &) {}) == submitted + 2;
+  }
+
+  // A bad record with valid ones after it is corruption, not a torn tail:
+  // the writer refuses the log and leaves every record in place
+  auto fileSize = [&]()
+  {
+    ifstream file(logPath, ios::binary | ios::ate);
+    return static_cast<size_t>(file.tellg());
+  };
+  auto corrupt = [&](size_t record)
+  {
+    fstream file(logPath, ios::binary | ios::in | ios::out);
+    file.seekp(8 + record * RatingLog::RECORD_SIZE + 9);
+    file.put('\x7f');
+  };
+  corrupt(5);
+  size_t sizeBefore = fileSize();
+  bool refused;
+  {
+    RatingLog::Writer writer(logPath);
+    refused = !writer.isOpen() && !writer.getError().empty() && fileSize() == sizeBefore;
+  }
+
+  // Bad records at the end are a torn tail and are truncated
+  {
+    ofstream clean(logPath, ios::binary | ios::trunc);
+  }
+  {
+    RatingLog::Writer writer(logPath);
+    for (int i = 0; i < 4; i++)
+      writer.append({RatingEvent::ADD, 1, 2 + i, 3.0f});
+  }
+  corrupt(2);
+  corrupt(3);
+  bool tornTruncated;
+  {
+    RatingLog::Writer writer(logPath);
+    tornTruncated = writer.isOpen() && writer.getError().empty() &&
+                    fileSize() == 8 + 2 * RatingLog::RECORD_SIZE;
+  }
+
+  remove(logPath.c_str());
+  return replayedAll && sameRatings && continued && modelsMatch && rejected && truncatedBack && refused &&
+         tornTruncated;
+}
+
+// Test that readers keep a consistent version while writers publish new ones
+bool test_ModelStore_BatchesShareUnchangedStructure()
+{
+  BipartiteGraph bg;
+  mt19937 rng(34);
+  for (int i = 1; i <= 60; i++)
+  {
+    bg.addItem(i, generateRandomGenres(2, rng), 100, 7.0, 2020);
+  }
+  for (int u = 1; u <= 200; u++)
+  {
+    bg.addUser(u, generateRandomRatings(60, 4 + u % 10, rng));
+  }
+  ModelStore store(bg, 2);
+
+  auto before = store.read();
+  uint64_t runsBefore = Metrics::snapshot().counter(Metrics::PAGERANK_RUNS);
+  store.apply({{RatingEvent::ADD, 1, 7, 4.5f}, {RatingEvent::ADD, 2, 7, 1.0f}});
+  auto after = store.read();
+
+  // Only the changed users' and item's lists are copied
+  bool listsShared = true;
+  for (int u = 3; u <= 200; u++)
+  {
+    listsShared &= &after->graph.getUserItems().at(u) == &before->graph.getUserItems().at(u);
+  }
+  for (int i = 1; i <= 60; i++)
+  {
+    if (i != 7)
+      listsShared &= &after->graph.getItemUsers().at(i) == &before->graph.getItemUsers().at(i);
+  }
+  bool changedCopied = &after->graph.getUserItems().at(1) != &before->graph.getUserItems().at(1) &&
+                       !before->graph.getWatchedItems(1).test(before->graph.getItemIndex(7)) &&
+                       after->graph.getWatchedItems(1).test(after->graph.getItemIndex(7));
+  bool catalogShared = &after->graph.getItemAt(0) == &before->graph.getItemAt(0);
+
+  // Two changed users of 200 leave the ranks shared and PageRank unrun
+  bool ranksShared = &after->pageRank.getRanks() == &before->pageRank.getRanks() &&
+                     Metrics::snapshot().counter(Metrics::PAGERANK_RUNS) == runsBefore;
+
+  // Once more than 5% of the users have changed the ranks are refreshed
+  vector<RatingEvent> events;
+  for (int u = 3; u <= 12; u++)
+  {
+    events.push_back({RatingEvent::ADD, u, 9, 3.0f});
+  }
+  store.apply(events);
+  auto refreshed = store.read();
+  bool ranksRefreshed = Metrics::snapshot().counter(Metrics::PAGERANK_RUNS) == runsBefore + 1 &&
+                        &refreshed->pageRank.getRanks() != &after->pageRank.getRanks();
+
+  return listsShared && changedCopied && catalogShared && ranksShared && ranksRefreshed;
+}
+
+bool test_ModelStore_ReadersSeeConsistentVersions()
+{
+  BipartiteGraph bg;
+  addTwoGenreCatalog(bg, 15);
+  addPatternUsers(bg, 12, 15);
+
+  ModelStore store(bg, 2);
+
+  // A reader pinned before the updates keeps seeing the original graph
+  bool isolated;
+  {
+    auto before = store.read();
+    store.apply({{RatingEvent::ADD, 1, 9, 5.0f}});
+    isolated = !before->graph.getWatchedItems(1).test(before->graph.getItemIndex(9)) &&
+               store.read()->graph.getWatchedItems(1).test(store.read()->graph.getItemIndex(9));
+  }
+
+  atomic<bool> done{false};
+  atomic<bool> consistent{true};
+  atomic<int> reads{0};
+  vector<thread> readers;
+  for (int t = 0; t < 2; t++)
+  {
+    readers.emplace_back([&, t]()
+                         {
+      int userId = 1 + t;
+      while (!done.load())
+      {
+        auto version = store.read();
+        const auto &graph = version->graph;
+        // Bitset and rating list come from the same version
+        size_t rated = graph.getUserItems().at(userId).size();
+        if (graph.getWatchedItems(userId).count() != rated)
+          consistent = false;
+        for (const auto &[movieId, _] : version->collaborative.getRecommendations(userId))
+        {
+          if (graph.getWatchedItems(userId).test(graph.getItemIndex(movieId)))
+            consistent = false;
+        }
+        reads++;
+      } });
+  }
+
+  mt19937 rng(3);
+  uniform_int_distribution<int> userDist(1, 12);
+  uniform_int_distribution<int> movieDist(1, 15);
+  uint64_t lastVersion = store.getVersion();
+  bool versionsAdvance = true;
+  for (int batch = 0; batch < 20; batch++)
+  {
+    vector<RatingEvent> events;
+    for (int i = 0; i < 5; i++)
+    {
+      events.push_back({i == 4 ? RatingEvent::DELETE : RatingEvent::ADD,
+                        userDist(rng), movieDist(rng), 2.0f + i % 3});
+    }
+    uint64_t version = store.apply(events);
+    versionsAdvance &= version == lastVersion + 1;
+    lastVersion = version;
+    this_thread::yield();
+  }
+  while (reads.load() < 10)
+  {
+    this_thread::yield();
+  }
+  done = true;
+  for (auto &reader : readers)
+  {
+    reader.join();
+  }
+
+  // Incrementally maintained models match a version built from scratch
+  ModelVersion rebuilt(store.read()->graph, 1);
+  bool modelsMatch = true;
+  {
+    auto latest = store.read();
+    for (int u = 1; u <= 12; u++)
+    {
+      auto a = latest->collaborative.getNeighbors(u);
+      auto b = rebuilt.collaborative.getNeighbors(u);
+      modelsMatch &= a.size() == b.size();
+      for (size_t i = 0; modelsMatch && i < a.size(); i++)
+      {
+        modelsMatch &= std::abs(a[i].second - b[i].second) < 1e-4f;
+      }
+    }
+  }
+
+  // With no readers left every replaced version is reclaimed
+  Epoch::collect();
+  bool reclaimed = Epoch::pendingCount() == 0;
+
+  return isolated && consistent && versionsAdvance && modelsMatch && reclaimed;
+}
+
 // Test PageRank influence on new users
 bool test_CollaborativeFiltering_UsesPageRankForNewUsers()
 {
@@ -333,6 +2458,7 @@ bool test_Scale_EstablishedService()
   }
 
   PageRank pageRank(bg);
+  pageRank.calculatePageRanks(); // Warm up outside the timed sections
   Collaborative collab(bg, pageRank);
   Content content(bg);
 
@@ -556,10 +2682,74 @@ int main()
        test_PageRank_ActiveUsersGetHigherRank()},
       {"PageRank: Handles Isolated Users",
        test_PageRank_HandlesIsolatedUsers()},
+      {"PageRank: Shared And Computed Once",
+       test_PageRank_SharedAndComputedOnce()},
+      {"PageRank: Bitset Kernel Matches Reference",
+       test_PageRank_BitsetKernelMatchesReference()},
       {"Hybrid: Combines All Components",
        test_Hybrid_CombinesAllComponents()},
       {"Hybrid: Handles Edge Cases",
        test_Hybrid_HandlesEdgeCases()},
+      {"Hybrid: Two-Stage Candidate Generation",
+       test_Hybrid_TwoStageCandidates()},
+      {"Hybrid: Deadline Degrades Gracefully",
+       test_Hybrid_DeadlineDegradesGracefully()},
+      {"ItemFilter: Pushes Down Into Engines",
+       test_ItemFilter_PushesDownIntoEngines()},
+      {"Cold Start: Lists Built Once Per Version",
+       test_ColdStart_ListsBuiltOncePerVersion()},
+      {"ResultCache: Invalidates On Version Change",
+       test_ResultCache_InvalidatesOnVersionChange()},
+      {"Hybrid: Model Changes Invalidate Caches",
+       test_Hybrid_ModelChangesInvalidateCaches()},
+      {"Metrics: Records Cache And Stage Activity",
+       test_Metrics_RecordsCacheAndStageActivity()},
+      {"Trace: Emits Chrome Trace Events",
+       test_Trace_EmitsChromeTraceEvents()},
+      {"Arena: Scopes Rewind And Reuse Blocks",
+       test_Arena_ScopesRewindAndReuseBlocks()},
+      {"BipartiteGraph: Watched Bitset Matches Ratings",
+       test_BipartiteGraph_WatchedBitsetMatchesRatings()},
+      {"CompressedAdjacency: Round Trips Rating Lists",
+       test_CompressedAdjacency_RoundTripsRatingLists()},
+      {"ModelSnapshot: Warm Restart Skips Recompute",
+       test_ModelSnapshot_WarmRestartSkipsRecompute()},
+      {"ModelSnapshot: Warm Restart Keeps Item Neighbors Past Eviction",
+       test_ModelSnapshot_WarmRestartKeepsItemNeighborsPastEviction()},
+      {"Collaborative: Incremental Updates Match Full Recompute",
+       test_Collaborative_IncrementalUpdatesMatchFullRecompute()},
+      {"MinHashLsh: Recall Against Exact Neighbors",
+       test_MinHashLsh_RecallAgainstExactNeighbors()},
+      {"DenseSimilarity: Matches Sparse Kernel",
+       test_DenseSimilarity_MatchesSparseKernel()},
+      {"GraphOrdering: Improves Locality, Keeps Results",
+       test_GraphOrdering_ImprovesLocalityKeepsResults()},
+      {"GraphOrdering: New Raters After Reorder Are Ordered",
+       test_GraphOrdering_NewRatersAfterReorderAreOrdered()},
+      {"Collaborative: External Precompute Matches In-Memory",
+       test_Collaborative_ExternalPrecomputeMatchesInMemory()},
+      {"ShardedPrecompute: Matches Single Process",
+       test_ShardedPrecompute_MatchesSingleProcess()},
+      {"ShardedPrecompute: Runs From Compressed Ratings File",
+       test_ShardedPrecompute_RunsFromCompressedRatingsFile()},
+      {"QuantizedNeighbors: Ranking Matches Float",
+       test_QuantizedNeighbors_RankingMatchesFloat()},
+      {"MemoryAccounting: Reports And Enforces Budgets",
+       test_MemoryAccounting_ReportsAndEnforcesBudgets()},
+      {"MemoryAccounting: Budgets Are Shared Across Engines",
+       test_MemoryAccounting_BudgetsAreSharedAcrossEngines()},
+      {"RatingLog: Replay And Micro-Batching",
+       test_RatingLog_ReplayAndMicroBatching()},
+      {"ModelStore: Readers See Consistent Versions",
+       test_ModelStore_ReadersSeeConsistentVersions()},
+      {"ModelStore: Batches Share Unchanged Structure",
+       test_ModelStore_BatchesShareUnchangedStructure()},
+      {"RecommendationServer: Serves Pipelined Requests",
+       test_RecommendationServer_ServesPipelinedRequests()},
+      {"ServerClient: Retries Interrupted Reads",
+       test_ServerClient_RetriesInterruptedReads()},
+      {"LoadGenerator: Reports Percentiles",
+       test_LoadGenerator_ReportsPercentiles()},
 
       // Scale tests with realistic scenarios
       {"Scale: Startup Phase (100 users, 50 movies)",
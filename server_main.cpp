@@ -0,0 +1,82 @@
+#include "BipartiteGraph.h"
+#include "Metrics.h"
+#include "ModelStore.h"
+#include "RecommendationServer.h"
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Defined in main.cpp
+void loadMovies(BipartiteGraph &bg, const string &filename);
+void loadRatings(BipartiteGraph &bg, const string &filename);
+
+// Usage: recommender_server movies.csv ratings.csv [--unix PATH] [--tcp PORT]
+//                           [--workers N] [--batch N] [--queue N]
+//
+// Loads the graph and builds every model once, then serves requests until
+// SIGINT or SIGTERM, printing the metrics on the way out.
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    cerr << "usage: " << argv[0]
+         << " movies.csv ratings.csv [--unix PATH] [--tcp PORT] [--workers N] [--batch N] [--queue N]\n";
+    return 1;
+  }
+
+  RecommendationServer::Options options;
+  for (int i = 3; i + 1 < argc; i += 2)
+  {
+    string flag = argv[i];
+    string value = argv[i + 1];
+    if (flag == "--unix")
+      options.unixPath = value;
+    else if (flag == "--tcp")
+      options.tcpPort = stoi(value);
+    else if (flag == "--workers")
+      options.workers = stoi(value);
+    else if (flag == "--batch")
+      options.maxBatchSize = stoul(value);
+    else if (flag == "--queue")
+      options.maxQueueSize = stoul(value);
+    else
+    {
+      cerr << "unknown option " << flag << "\n";
+      return 1;
+    }
+  }
+  if (options.unixPath.empty() && options.tcpPort < 0)
+    options.unixPath = "/tmp/recommender.sock";
+
+  BipartiteGraph bg;
+  loadMovies(bg, argv[1]);
+  loadRatings(bg, argv[2]);
+  ModelStore store(move(bg));
+
+  // Block the stop signals before any thread starts so only sigwait sees them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  RecommendationServer server(store, options);
+  if (!server.start())
+  {
+    cerr << "could not open listeners: " << strerror(errno) << "\n";
+    return 1;
+  }
+  if (!options.unixPath.empty())
+    cout << "listening on " << options.unixPath << "\n";
+  if (server.getTcpPort() >= 0)
+    cout << "listening on 127.0.0.1:" << server.getTcpPort() << "\n";
+
+  int signal;
+  sigwait(&signals, &signal);
+  server.stop();
+  cout << Metrics::snapshot().toText();
+  return 0;
+}
@@ -0,0 +1,20 @@
+#include "ShardedPrecompute.h"
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Usage: shard_worker GRAPH_FILE SHARD SHARD_COUNT K OUTPUT_FILE
+//
+// Worker side of ShardedPrecompute: scores one shard of a flattened graph
+// file and writes its sorted run. Started by ShardedPrecompute::run, one
+// process per shard; exits 0 once the run is in place.
+int main(int argc, char **argv)
+{
+  if (argc != 6)
+  {
+    cerr << "usage: " << argv[0] << " GRAPH_FILE SHARD SHARD_COUNT K OUTPUT_FILE\n";
+    return 2;
+  }
+  return ShardedPrecompute::runShard(argv[1], stoi(argv[2]), stoi(argv[3]), stoul(argv[4]), argv[5]) ? 0 : 1;
+}